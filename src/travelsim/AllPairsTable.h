@@ -0,0 +1,143 @@
+#ifndef ALL_PAIRS_TABLE_H
+#define ALL_PAIRS_TABLE_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "CommonLib.h"
+#include "ShortestPathTree.h"
+#include "TravelNetworkIndex.h"
+#include "TravelNetworkSnapshot.h"
+#include "WorkerPool.h"
+
+using std::vector;
+
+//=======================================================
+// AllPairsTable class
+//
+//   Distance and next hop between every pair of locations
+//   of a TravelNetworkSnapshot, for the allPairs engine of
+//   Conn. A shortest path is then a walk along the next
+//   hops, with no search at all.
+//
+//   The table is laid out by destination: the row of a
+//   destination is its complete reverse tree, grown with
+//   TravelNetworkSnapshot::reverseTreeNew(), so the rows
+//   are independent and are grown in parallel. This is
+//   one Dijkstra per location, O(V (V + E) log V), well
+//   below the O(V^3) of Floyd-Warshall on road networks,
+//   whose locations have a handful of segments each.
+//
+//   The table takes 16 bytes per pair of locations, so it
+//   is only meant for networks of a few hundred locations.
+//   It never changes once built, and is shared with
+//   std::shared_ptr so that it can be built on another
+//   thread than the one that reads it.
+//=======================================================
+
+class AllPairsTable {
+public:
+
+	typedef TravelNetworkIndex::Id Id;
+
+	/* Table of the network of 'snapshot'. Rows are grown on the workers of 'pool', or on the calling thread if it is null. */
+	static std::shared_ptr<const AllPairsTable> instanceNew(const std::shared_ptr<const TravelNetworkSnapshot>& snapshot,
+															WorkerPool* pool) {
+		return std::shared_ptr<const AllPairsTable>(new AllPairsTable(snapshot, pool));
+	}
+
+	/* Version of the index the table was built from (TravelNetworkIndex::version()) */
+	U64 version() const {
+		return version_;
+	}
+
+	/* Upper bound (exclusive) on the location ids of the table */
+	Id locationIdCount() const {
+		return locationIdCount_;
+	}
+
+	/* d(source, destination). ShortestPathTree::unreachableDistance() if there is no path, or if either id is not in the table. */
+	double distance(const Id source, const Id destination) const {
+		if ( (source >= locationIdCount_) || (destination >= locationIdCount_) ) {
+			return ShortestPathTree::unreachableDistance();
+		}
+
+		return minDist_[entry(source, destination)];
+	}
+
+	/* First segment of the shortest path from 'source' to 'destination', nullId if there is none */
+	Id nextSegment(const Id source, const Id destination) const {
+		if ( (source >= locationIdCount_) || (destination >= locationIdCount_) ) {
+			return TravelNetworkIndex::nullId;
+		}
+
+		return nextSegment_[entry(source, destination)];
+	}
+
+	/* Location that nextSegment() leads to */
+	Id nextLocation(const Id source, const Id destination) const {
+		if ( (source >= locationIdCount_) || (destination >= locationIdCount_) ) {
+			return TravelNetworkIndex::nullId;
+		}
+
+		return nextLocation_[entry(source, destination)];
+	}
+
+	/* Memory taken by the table */
+	U64 bytes() const {
+		return minDist_.size() * sizeof(double) + (nextSegment_.size() + nextLocation_.size()) * sizeof(Id);
+	}
+
+	AllPairsTable(const AllPairsTable&) = delete;
+
+	void operator =(const AllPairsTable&) = delete;
+	void operator ==(const AllPairsTable&) = delete;
+
+protected:
+
+	AllPairsTable(const std::shared_ptr<const TravelNetworkSnapshot>& snapshot, WorkerPool* pool) :
+		version_(snapshot->version()),
+		locationIdCount_(snapshot->locationIdCount())
+	{
+		const auto numLocations = static_cast<U64>(locationIdCount_);
+		minDist_.assign(numLocations * numLocations, ShortestPathTree::unreachableDistance());
+		nextSegment_.assign(numLocations * numLocations, TravelNetworkIndex::nullId);
+		nextLocation_.assign(numLocations * numLocations, TravelNetworkIndex::nullId);
+
+		// Each task only writes the row of its own destination
+		const auto rowIs = [this, &snapshot](unsigned int destId) {
+			if (snapshot->locationName(destId).empty()) {
+				return;
+			}
+
+			const auto tree = snapshot->reverseTreeNew(destId);
+			const auto row = entry(0, destId);
+			std::copy(tree->minDist.begin(), tree->minDist.end(), minDist_.begin() + row);
+			std::copy(tree->predSegment.begin(), tree->predSegment.end(), nextSegment_.begin() + row);
+			std::copy(tree->predLocation.begin(), tree->predLocation.end(), nextLocation_.begin() + row);
+		};
+
+		if (pool != nullptr) {
+			pool->run(locationIdCount_, rowIs);
+		} else {
+			for (auto destId = 0u; destId < locationIdCount_; destId++) {
+				rowIs(destId);
+			}
+		}
+	}
+
+private:
+
+	U64 entry(const Id source, const Id destination) const {
+		return static_cast<U64>(destination) * locationIdCount_ + source;
+	}
+
+	U64 version_;
+	Id locationIdCount_;
+	vector<double> minDist_;
+	vector<Id> nextSegment_;
+	vector<Id> nextLocation_;
+};
+
+#endif
@@ -2,12 +2,31 @@
 #ifndef CONN_H
 #define CONN_H
 
+#include <chrono>
 #include <climits>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
 #include <set>
 
+#include "AllPairsTable.h"
 #include "CommonLib.h"
+#include "ContractionHierarchy.h"
+#include "DeltaStepping.h"
+#include "FrequencySketch.h"
+#include "Histogram.h"
+#include "HubLabels.h"
+#include "LandmarkTable.h"
+#include "PathEnumeration.h"
+#include "RoutingPolicies.h"
 #include "Location.h"
 #include "Segment.h"
+#include "ShortestPathTree.h"
+#include "TravelNetworkIndex.h"
+#include "TravelNetworkSnapshot.h"
+#include "WorkerPool.h"
 
 using fwk::BaseNotifiee;
 using fwk::NamedInterface;
@@ -29,54 +48,210 @@ public:
 		return new Conn(name, mgr);
 	}
 
+	enum Engine {
+
+		/** Dijkstra that scans every unsettled location to pick the next one to settle. O(V^2) per query. */
+		linearScan,
+
+		/** Dijkstra backed by a binary heap with lazy deletion. O((V + E) log V) per query. */
+		binaryHeap,
+
+		/** Two binary-heap searches, forward from the source and backward from the destination, 
+		    that stop once they meet on a shortest path. Settles roughly half the locations of binaryHeap. */
+		bidirectional,
+
+		/** A* search whose lower bounds come from the distances to and from a few landmarks (ALT). 
+		    The landmark trees are grown on the first query and repaired as the network changes. */
+		alt,
+
+		/** Bidirectional search on the contraction hierarchy set with shortestPathHierarchyIs(). 
+		    Meant for networks that no longer change: the hierarchy is dropped on the first change 
+		    to the network, and queries fall back to binaryHeap until a new one is set. */
+		contractionHierarchy,
+
+		/** Delta-stepping search whose arc relaxations are spread over the shortestPathWorkerCount() 
+		    workers (see DeltaStepping.h). Meant for dense networks. Also grows the trees of reverseTrees fills. */
+		deltaStepping,
+
+		/** Walk along the next hops of a table of the shortest paths between every pair of locations 
+		    (see allPairsTable()). O(path length) per query once the table is built, but the table takes 
+		    O(V^2) memory, so only meant for networks of a few hundred locations. Queries fall back to 
+		    binaryHeap while the table is rebuilt after a change. */
+		allPairs,
+
+		/** Merge of the hub labels of the source and the destination (see HubLabels.h), set with 
+		    shortestPathHubLabelsIs(). O(label size) per query, with the segments of the path looked up 
+		    only when a path is asked for. Meant for networks that no longer change: the labels are dropped 
+		    on the first change to the network, and queries fall back to binaryHeap until new ones are set. */
+		hubLabels
+	};
+
+	/** How the shortest path cache is filled on a miss */
+	enum CacheFill {
+
+		/** With the shortest paths that the engine's search settles on its way to the destination */
+		settledPrefixes,
+
+		/** With the complete reverse shortest path tree of the destination, grown by one backward search. 
+		    Every later query to that destination is answered by the cache, whatever its source. */
+		reverseTrees
+	};
+
+	/** Which destination is evicted, with all its cached paths, once the cache grows past its byte budget */
+	enum CacheEviction {
+
+		/** The destination queried least recently */
+		leastRecentlyUsed,
+
+		/** The first destination not queried since the clock hand last passed it (second chance). 
+		    Cheaper than leastRecentlyUsed on hits, since queries only set a flag. */
+		clockSweep,
+
+		/** The destination queried least recently, unless a destination that just entered the cache 
+		    has been queried less often than it lately, in which case the newcomer is evicted instead 
+		    (TinyLFU admission). Query counts come from a FrequencySketch. */
+		frequencyAdmission
+	};
+
+	//=======================================================
+	// Path class
+	//
+	//   A path is a view on a range of a segment array that
+	//   other paths can share: copies, prefixes and suffixes
+	//   of a path are new views on the same array, and paths
+	//   returned by cache hits share the arrays built by
+	//   earlier hits to the same destination.
+	//
+	//   segmentIs() appends in place when the path ends
+	//   where its array ends, and otherwise first copies its
+	//   own range to a new array, so that appending never
+	//   changes the segments of another path.
+	//=======================================================
+
 	class Path : public PtrInterface {
 	public:
 
+		/* Walks the segments of a path in place, without copying them or touching their reference counts */
+		class SegmentIterator {
+		public:
+
+			const Ptr<Segment>& operator *() const {
+				return path_->storage_->segments[index_];
+			}
+
+			const Ptr<Segment>* operator ->() const {
+				return &(path_->storage_->segments[index_]);
+			}
+
+			SegmentIterator& operator ++() {
+				index_++;
+				return *this;
+			}
+
+			SegmentIterator operator ++(int) {
+				const auto it = *this;
+				index_++;
+				return it;
+			}
+
+			bool operator ==(const SegmentIterator& it) const {
+				return (path_ == it.path_) && (index_ == it.index_);
+			}
+
+			bool operator !=(const SegmentIterator& it) const {
+				return !(*this == it);
+			}
+
+		private:
+
+			friend class Path;
+
+			// Indexes rather than vector iterators, so that appending to another path sharing the array is harmless
+			SegmentIterator(const Path* path, const U32 index) :
+				path_(path),
+				index_(index)
+			{
+				// Nothing else to do
+			}
+
+			const Path* path_;
+			U32 index_;
+		};
+
 		static Ptr<Path> instanceNew() {
 			return new Path();
 		}
 
+		/* Same segments as 'p', sharing them */
 		static Ptr<Path> instanceNew(const Ptr<Path>& p) {
-			return new Path(p);
+			return new Path(p, 0);
+		}
+
+		/* Segments of 'p' from its segment 'first' on, sharing them */
+		static Ptr<Path> instanceNew(const Ptr<Path>& p, const U32 first) {
+			return new Path(p, first);
 		}
 
 		void segmentIs(const Ptr<Segment> segment) {
-			segments_.push_back(segment);
-			length_ = length_ + segment->length();
+			if (end_ != storage_->segments.size()) {
+				storage_ = Storage::instanceNew(storage_, begin_, end_);
+				end_ -= begin_;
+				begin_ = 0;
+			}
+
+			storage_->segments.push_back(segment);
+			storage_->prefixLengths.push_back(storage_->prefixLengths.back() + segment->length().value());
+			end_++;
+		}
+
+		/* Appends the segments of 'p' */
+		void segmentsIs(const Ptr<Path>& p) {
+			for (auto it = p->segmentIter(); it != p->segmentIterEnd(); it++) {
+				segmentIs(*it);
+			}
 		}
 
 		Ptr<Segment> segment(const U32 id) {
-			if (id < segments_.size()) {
-				return segments_[id];
+			if (id < segmentCount()) {
+				return storage_->segments[begin_ + id];
 			}
 
 			return null;
 		}
 
+		/* Copy of the segments. segmentIter() walks them without copying. */
 		vector< Ptr<Segment> > segments() const {
-			return segments_;
+			return vector< Ptr<Segment> >(storage_->segments.begin() + begin_, storage_->segments.begin() + end_);
+		}
+
+		SegmentIterator segmentIter() const {
+			return SegmentIterator(this, begin_);
+		}
+
+		SegmentIterator segmentIterEnd() const {
+			return SegmentIterator(this, end_);
 		}
 
 		unsigned int segmentCount() const {
-			return segments_.size();
+			return end_ - begin_;
 		}
 
+		/* Sum of the segment lengths at the time the segments were added */
 		Miles length() const {
-			return length_;
+			return storage_->prefixLengths[end_] - storage_->prefixLengths[begin_];
 		}
 
 		Ptr<Location> source() const {
-			if (segments_.size() > 0) {
-				return segments_[0]->source();
+			if (segmentCount() > 0) {
+				return storage_->segments[begin_]->source();
 			}
 
 			return null;
 		}
 
 		Ptr<Location> destination() const {
-			const auto numSegments = segments_.size();
-			if (numSegments > 0) {
-				return segments_[numSegments - 1]->destination();
+			if (segmentCount() > 0) {
+				return storage_->segments[end_ - 1]->destination();
 			}
 
 			return null;
@@ -84,14 +259,13 @@ public:
 
 		string stringRep() const {
             string str = "";
-            for (auto it = segments_.cbegin(); it != segments_.cend(); it++) {
-                auto seg = *it;
+            for (auto it = segmentIter(); it != segmentIterEnd(); it++) {
+                const auto& seg = *it;
                 str += seg->source()->name() + "(" + seg->name() + ":" + to_string(seg->length().value()) + ") ";
             }
 
-            if (segments_.size() > 0) {
-	            auto lastSegment = segments_[segments_.size() - 1];
-	            str += lastSegment->destination()->name();
+            if (segmentCount() > 0) {
+	            str += destination()->name();
 	        }
 
             return str;
@@ -99,23 +273,64 @@ public:
 
     protected:
 
+		//=======================================================
+		// Storage class
+		//    Segment array shared by the paths built on it,
+		//    with the length of each of its prefixes.
+		//=======================================================
+
+		class Storage : public PtrInterface {
+		public:
+
+			static Ptr<Storage> instanceNew() {
+				return new Storage();
+			}
+
+			/* Copy of the segments in [begin, end) of 'storage' */
+			static Ptr<Storage> instanceNew(const Ptr<Storage>& storage, const U32 begin, const U32 end) {
+				const auto copy = new Storage();
+				for (auto i = begin; i < end; i++) {
+					copy->segments.push_back(storage->segments[i]);
+					copy->prefixLengths.push_back(copy->prefixLengths.back() + storage->prefixLengths[i + 1] - storage->prefixLengths[i]);
+				}
+
+				return copy;
+			}
+
+			vector< Ptr<Segment> > segments;
+			// prefixLengths[i] is the length of the first i segments
+			vector<double> prefixLengths;
+
+		protected:
+
+			Storage() :
+				prefixLengths(1, 0)
+			{
+				// Nothing else to do
+			}
+		};
+
 		Path():
-			length_(0)
+			storage_(Storage::instanceNew()),
+			begin_(0),
+			end_(0)
 		{
 			// Nothing else to do
 		}
 
-		Path(const Ptr<Path>& p) :
-			segments_(p->segments()),
-			length_(p->length())
+		Path(const Ptr<Path>& p, const U32 first) :
+			storage_(p->storage_),
+			begin_(std::min(p->begin_ + first, p->end_)),
+			end_(p->end_)
 		{
 			// Nothing else to do
 		}
 
 	private:
 
-		vector< Ptr<Segment> > segments_;
-		Miles length_;
+		Ptr<Storage> storage_;
+		U32 begin_;
+		U32 end_;
 	};
 
 	class PathCacheStats : public PtrInterface {
@@ -133,6 +348,64 @@ public:
 			return requestCount_;
 		}
 
+		/* Number of network changes the cache has been invalidated for: location and segment 
+		   deletions, segments newly linked between two locations, rewired segments and length changes */
+		unsigned int invalidationCount() const {
+			return invalidationCount_;
+		}
+
+		/* Number of cache entries looked at by those invalidations. Without the invalidation 
+		   index this would be the whole cache on every deletion. */
+		unsigned int invalidationVisitCount() const {
+			return invalidationVisitCount_;
+		}
+
+		/* Number of cache entries erased by those invalidations */
+		unsigned int invalidatedEntryCount() const {
+			return invalidatedEntryCount_;
+		}
+
+		/* Number of cache entries given a new next hop in place, in complete reverse trees */
+		unsigned int repairedEntryCount() const {
+			return repairedEntryCount_;
+		}
+
+		/* Number of destinations evicted to keep the cache within its budget */
+		unsigned int evictionCount() const {
+			return evictionCount_;
+		}
+
+		/* Number of cache entries erased by those evictions */
+		unsigned int evictedEntryCount() const {
+			return evictedEntryCount_;
+		}
+
+		/* Number of those evictions in which frequencyAdmission evicted the newcomer rather than the victim */
+		unsigned int admissionRejectCount() const {
+			return admissionRejectCount_;
+		}
+
+		/* Estimated memory held by the cache and its indexes, in bytes */
+		U64 residentBytes() const {
+			return residentBytes_;
+		}
+
+		/* Number of segment deletions whose paths in complete reverse trees were patched in place 
+		   rather than dropped (see Conn::shortestPathCacheAlternatesIs()) */
+		unsigned int patchedDeletionCount() const {
+			return patchedDeletionCount_;
+		}
+
+		/* Number of locations whose repair started from their precomputed alternate next hop */
+		unsigned int alternateHitCount() const {
+			return alternateHitCount_;
+		}
+
+		/* Number of locations whose repair had to look at all their segments, the alternate being missing or out of date */
+		unsigned int alternateMissCount() const {
+			return alternateMissCount_;
+		}
+
 		PathCacheStats(const PathCacheStats&) = delete;
 
 		void operator =(const PathCacheStats&) = delete;
@@ -158,10 +431,65 @@ public:
 			requestCount_ += 1;
 		}
 
+		void invalidationCountIsIncByOne() {
+			invalidationCount_ += 1;
+		}
+
+		void invalidationVisitCountIsIncByOne() {
+			invalidationVisitCount_ += 1;
+		}
+
+		void invalidatedEntryCountIsIncByOne() {
+			invalidatedEntryCount_ += 1;
+		}
+
+		void repairedEntryCountIsIncByOne() {
+			repairedEntryCount_ += 1;
+		}
+
+		void evictionCountIsIncByOne() {
+			evictionCount_ += 1;
+		}
+
+		void evictedEntryCountIsIncByOne() {
+			evictedEntryCount_ += 1;
+		}
+
+		void admissionRejectCountIsIncByOne() {
+			admissionRejectCount_ += 1;
+		}
+
+		void residentBytesIs(U64 bytes) {
+			residentBytes_ = bytes;
+		}
+
+		void patchedDeletionCountIsIncByOne() {
+			patchedDeletionCount_ += 1;
+		}
+
+		void alternateHitCountIsIncByOne() {
+			alternateHitCount_ += 1;
+		}
+
+		void alternateMissCountIsIncByOne() {
+			alternateMissCount_ += 1;
+		}
+
 		PathCacheStats() :
 			hitCount_(0),
 			missCount_(0),
-			requestCount_(0)
+			requestCount_(0),
+			invalidationCount_(0),
+			invalidationVisitCount_(0),
+			invalidatedEntryCount_(0),
+			repairedEntryCount_(0),
+			evictionCount_(0),
+			evictedEntryCount_(0),
+			admissionRejectCount_(0),
+			residentBytes_(0),
+			patchedDeletionCount_(0),
+			alternateHitCount_(0),
+			alternateMissCount_(0)
 		{
 			// Nothing else to do
 		}
@@ -173,41 +501,492 @@ public:
 		unsigned int hitCount_;
 		unsigned int missCount_;
 		unsigned int requestCount_;
+		unsigned int invalidationCount_;
+		unsigned int invalidationVisitCount_;
+		unsigned int invalidatedEntryCount_;
+		unsigned int repairedEntryCount_;
+		unsigned int evictionCount_;
+		unsigned int evictedEntryCount_;
+		unsigned int admissionRejectCount_;
+		U64 residentBytes_;
+		unsigned int patchedDeletionCount_;
+		unsigned int alternateHitCount_;
+		unsigned int alternateMissCount_;
 
 	};
 
-protected:
+	//=======================================================
+	// QueryStats class
+	//    Distributions of the latency and the work of the
+	//    queries and of the time taken by invalidations, and
+	//    the hit rate of each destination, where
+	//    PathCacheStats only keeps totals.
+	//=======================================================
+
+	class QueryStats : public PtrInterface {
+	public:
+
+		/* Requests to one destination, and how many of them the cache answered */
+		struct DestinationCounts {
+			U64 requestCount;
+			U64 hitCount;
+		};
+
+		typedef unordered_map<string, DestinationCounts> DestinationMap;
+		typedef DestinationMap::const_iterator destinationConstIter;
+
+		/* Wall-clock time of the queries answered by the cache, in nanoseconds: shortestPath() calls, 
+		   and pairs of shortestPaths() batches */
+		const Histogram& cachedLatency() const {
+			return cachedLatency_;
+		}
+
+		/* Wall-clock time of the other queries, in nanoseconds: shortestPath() and shortestPathFromNearest() 
+		   calls, and pairs of shortestPaths() batches, which take the time of the search of their destination */
+		const Histogram& uncachedLatency() const {
+			return uncachedLatency_;
+		}
+
+		/* Number of locations settled by each search: one per shortestPath() or shortestPathFromNearest()
+		   call that searched, and one per destination of a shortestPaths() batch */
+		const Histogram& settledCount() const {
+			return settledCount_;
+		}
+
+		/* Number of arcs relaxed by each of those searches */
+		const Histogram& relaxedCount() const {
+			return relaxedCount_;
+		}
+
+		/* Wall-clock time of each invalidation: location and segment deletions, and repairs of the cache
+		   for the segments that got shorter or longer since the last query, in nanoseconds */
+		const Histogram& invalidationLatency() const {
+			return invalidationLatency_;
+		}
+
+		/* Counts of 'destName', zero if it was never requested */
+		DestinationCounts destinationCounts(const string& destName) const {
+			const auto it = destinations_.find(destName);
+			if (it != destinations_.end()) {
+				return it->second;
+			}
+
+			return DestinationCounts{ 0, 0 };
+		}
+
+		/* Fraction of the requests to 'destName' that hit the cache, 0 if there were none */
+		double destinationHitRate(const string& destName) const {
+			const auto counts = destinationCounts(destName);
+			return (counts.requestCount > 0) ? static_cast<double>(counts.hitCount) / counts.requestCount : 0;
+		}
+
+		unsigned int destinationCount() const {
+			return destinations_.size();
+		}
+
+		destinationConstIter destinationIter() const {
+			return destinations_.cbegin();
+		}
+
+		destinationConstIter destinationIterEnd() const {
+			return destinations_.cend();
+		}
+
+		QueryStats(const QueryStats&) = delete;
+
+		void operator =(const QueryStats&) = delete;
+		void operator ==(const QueryStats&) = delete;
+
+	protected:
+
+		friend class Conn;
+
+		static Ptr<QueryStats> instanceNew() {
+			return new QueryStats();
+		}
+
+		void cachedLatencySampleIs(U64 ns) {
+			cachedLatency_.sampleIs(ns);
+		}
+
+		void uncachedLatencySampleIs(U64 ns) {
+			uncachedLatency_.sampleIs(ns);
+		}
+
+		void searchSampleIs(U64 settled, U64 relaxed) {
+			settledCount_.sampleIs(settled);
+			relaxedCount_.sampleIs(relaxed);
+		}
+
+		void invalidationLatencySampleIs(U64 ns) {
+			invalidationLatency_.sampleIs(ns);
+		}
+
+		void destinationRequestIs(const string& destName, bool isHit) {
+			auto& counts = destinations_[destName];
+			counts.requestCount += 1;
+			if (isHit) {
+				counts.hitCount += 1;
+			}
+		}
+
+		QueryStats() { }
+
+		~QueryStats() { }
+
+	private:
+
+		Histogram cachedLatency_;
+		Histogram uncachedLatency_;
+		Histogram settledCount_;
+		Histogram relaxedCount_;
+		Histogram invalidationLatency_;
+		DestinationMap destinations_;
+	};
 
 	typedef vector< Ptr<Path> > PathVector;
-	typedef unordered_map< string, Miles> LocToMinDistMap;
+
+protected:
+
 	typedef unordered_map<string, string> LocToSeg;
 	typedef unordered_map< string, LocToSeg > ShortestPathCache;
 
+	/* A cache entry, as (destination name, source name) */
+	typedef std::pair<string, string> CacheEntryKey;
+
+	/* Segment or location name to the cache entries that depend on it */
+	typedef unordered_map< string, set<CacheEntryKey> > CacheEntryIndex;
+
+	/* Pairs of a shortestPaths() batch that share a destination, and what the backward search from it found */
+	struct ShortestPathGroup {
+		TravelNetworkIndex::Id destination;
+		// Positions of the pairs in the batch, and their sources
+		vector<U32> pairs;
+		vector<TravelNetworkIndex::Id> sources;
+		// Locations settled by the search, in order, with their next hop towards the destination
+		vector<TravelNetworkIndex::Id> settledLocations;
+		vector<TravelNetworkIndex::Id> settledSegments;
+		// Segments of the shortest path from each source, empty if it cannot reach the destination
+		vector< vector<TravelNetworkIndex::Id> > pathSegments;
+		// Alternate next hop of each settled location, and the length through it, when asked for
+		vector<TravelNetworkIndex::Id> alternateSegments;
+		vector<double> alternateLengths;
+		// Work and wall-clock time of the search, for QueryStats
+		U64 settledCount;
+		U64 relaxedCount;
+		U64 searchNanoseconds;
+	};
+
+	/* Best next hop of a location in a complete reverse tree other than its cached one, as of when it was found */
+	struct AlternateHop {
+		// The cached next hop at that time
+		string primary;
+		string segment;
+		// Length of the path through 'segment' at that time
+		double length;
+	};
+
+	typedef unordered_map<string, AlternateHop> LocToAlternateHop;
+
+	/* Source location name to the path already built from it by a cache hit, for one destination */
+	typedef unordered_map< string, Ptr<Path> > LocToPath;
+
+	/* Source location name to the length of its cached path, as found by distance(), for one destination */
+	typedef unordered_map<string, double> LocToDistance;
+
+	/* Eviction bookkeeping of a destination in the cache */
+	struct CacheDestination {
+		std::list<string>::iterator order;
+		bool isReferenced;
+	};
+
 public:
+
+	/* A (source, destination) pair of a shortestPaths() batch */
+	typedef std::pair< Ptr<Location>, Ptr<Location> > LocationPair;
+
+	/* Called by pathsVisit() with the segments of each path, as TravelNetworkIndex ids, and its length. 
+	   The segments are only valid during the call. Returning false stops the enumeration. */
+	typedef std::function<bool (const vector<TravelNetworkIndex::Id>& segments, const Miles& length)> PathCallback;
+
+	/* Every path from 'location' that does not go through a location twice and is no longer than 'maxLength' */
 	const PathVector paths(const Ptr<Location>& location, const Miles& maxLength) const {
-		set<string> locationsVisited;
-		locationsVisited.insert(location->name());
+		PathVector validPaths;
+		pathsVisit(location, maxLength, [this, &validPaths](const vector<TravelNetworkIndex::Id>& segments, const Miles&) {
+			validPaths.push_back(pathNew(segments));
+			return true;
+		});
+
+		return validPaths;
+	}
+
+	/* Enumerates the paths of paths() depth-first, in the order of Location::sourceSegments, without 
+	   building them: 'callback' sees each one as it is found. Returns the number of paths visited. */
+	U64 pathsVisit(const Ptr<Location>& location, const Miles& maxLength, const PathCallback& callback) const;
 
-		return getPathsFromLoc(location, Path::instanceNew(), maxLength, locationsVisited);
+	/* Number of paths paths() would return */
+	U64 pathCount(const Ptr<Location>& location, const Miles& maxLength) const {
+		return pathsVisit(location, maxLength, PathCallback());
 	}
 
+	/* Path made of the given segments, as TravelNetworkIndex ids */
+	Ptr<Path> pathNew(const vector<TravelNetworkIndex::Id>& segments) const;
+
+	/* The paths of paths(), in no particular order, enumerated on the shortestPathWorkerCount() workers 
+	   (see PathEnumeration.h) */
+	PathVector pathsInParallel(const Ptr<Location>& location, const Miles& maxLength);
+
+	/* Number of paths paths() would return, counted on the shortestPathWorkerCount() workers */
+	U64 pathCountInParallel(const Ptr<Location>& location, const Miles& maxLength);
+
 	Ptr<Path> shortestPath(const Ptr<Location>& source, const Ptr<Location>& destination);
 
+	/* Distance returned when there is no path */
+	static Miles unreachable() {
+		return Miles(ShortestPathTree::unreachableDistance());
+	}
+
+	/* Length of shortestPath(), from the same engines and cache, without building the path: no Path is 
+	   allocated and, once the cache has answered for a source, no segment is looked up. 0 if 'source' and 
+	   'destination' are the same, and unreachable() if there is no path or either is not part of the network. */
+	Miles distance(const Ptr<Location>& source, const Ptr<Location>& destination);
+
+	/* Shortest path to 'destination' from the nearest of 'sources', found with a single backward search over 
+	   destination segments that stops as soon as that source is settled. Sources at the same distance are 
+	   preferred in the order given. The path is empty if 'destination' is itself one of the sources, and null 
+	   if none of them can reach it. The hubLabels engine compares the sources with label merges instead. */
+	Ptr<Path> shortestPathFromNearest(const vector< Ptr<Location> >& sources, const Ptr<Location>& destination);
+
+	/* The source of shortestPathFromNearest() and the length of its path, from the same search, without building 
+	   the path. (null, unreachable()) if none of the sources can reach 'destination'. */
+	std::pair< Ptr<Location>, Miles > distanceFromNearest(const vector< Ptr<Location> >& sources, const Ptr<Location>& destination);
+
+	/* Shortest path from 'source' to 'destination' by 'weight' over the segments that 'filter' allows 
+	   (see RoutingPolicies.h), e.g. shortestPath(a, b, TimeWeight(car->speed()), RoadsOnly()). Found with a 
+	   Dijkstra compiled for the two policies, whatever shortestPathEngine() is. The path's length() is still 
+	   in miles. Empty if 'source' and 'destination' are the same, null if there is no such path.
+	   
+	   Each combination of policies caches the complete reverse trees of its destinations apart from the cache 
+	   of shortestPath(source, destination), keyed by the policies' cacheKey(). The trees count towards its 
+	   budget and are evicted before its destinations, least recently queried first. A tree larger than the 
+	   whole budget is not cached. All trees are dropped on any change to the network. */
+	template <class Weight, class Filter>
+	Ptr<Path> shortestPath(const Ptr<Location>& source, const Ptr<Location>& destination, const Weight& weight, const Filter& filter);
+
+	/* Weight of that path, without building it: 0 if 'source' and 'destination' are the same, and 
+	   ShortestPathTree::unreachableDistance() if there is no such path. */
+	template <class Weight, class Filter>
+	double shortestPathWeight(const Ptr<Location>& source, const Ptr<Location>& destination, const Weight& weight, const Filter& filter);
+
+	/* Shortest paths of a batch of (source, destination) pairs, in the order of the pairs. Pairs missing 
+	   the cache are grouped by destination and each group is served by a single backward search. The 
+	   searches are spread over shortestPathWorkerCount() workers. The path of a pair is empty if its 
+	   source and destination are the same, and null if there is none. */
+	PathVector shortestPaths(const vector<LocationPair>& pairs);
+
+	/* Number of threads that run the searches of shortestPaths(), the relaxations of the deltaStepping engine 
+	   and the enumeration of pathsInParallel(), the calling thread included */
+	unsigned int shortestPathWorkerCount() const {
+		return shortestPathWorkerCount_;
+	}
+
+	void shortestPathWorkerCountIs(unsigned int n) {
+		n = std::max(n, 1u);
+		if (shortestPathWorkerCount_ != n) {
+			shortestPathWorkerCount_ = n;
+			shortestPathWorkerPool_ = null;
+		}
+	}
+
+	/* Latest snapshot of the network published with snapshotNew(), null before the first one.
+	   The only method of Conn that threads other than the one changing the network may call. */
+	std::shared_ptr<const TravelNetworkSnapshot> snapshot() const {
+		return std::atomic_load(&snapshot_);
+	}
+
+	/* Publishes a snapshot of the network as it is now. Readers holding an older snapshot keep it until they let go. */
+	std::shared_ptr<const TravelNetworkSnapshot> snapshotNew();
+
+	/* True if the network changed since the latest snapshot was published, or none was */
+	bool isSnapshotStale();
+
+	/* Number of reverse trees each snapshot keeps for its queries */
+	unsigned int snapshotTreeCapacity() const {
+		return snapshotTreeCapacity_;
+	}
+
+	void snapshotTreeCapacityIs(unsigned int n) {
+		if (snapshotTreeCapacity_ != n) {
+			snapshotTreeCapacity_ = n;
+		}
+	}
+
 	// This method should ideally be in 'private' scope. Placing it here only for testing purposes.
-	Ptr<Path> shortestPathCached(const Ptr<Location>& source, const Ptr<Location>& destination) const;
+	Ptr<Path> shortestPathCached(const Ptr<Location>& source, const Ptr<Location>& destination);
 
 	void pathCacheIsEmpty();
 
+	/* Hash of the locations and segments of the network: their names, and the ends and length of the segments. 
+	   The same from one run to the next for the same network, whatever order it was built in. */
+	U64 topologyHash();
+
+	/* Writes the shortest path cache to 'fileName', keyed by the topologyHash() of the network. Paths kept for 
+	   cache hits and alternates are not written, as they are rebuilt from the entries. False if the file cannot be written. */
+	bool shortestPathCacheSave(const string& fileName);
+
+	/* Replaces the cache with the one written to 'fileName' by shortestPathCacheSave(), for a warm start. 
+	   False, with the cache left as is, if there is no such file or it was written for another network. */
+	bool shortestPathCacheLoad(const string& fileName);
+
 	Ptr<PathCacheStats> shortestPathCacheStats() const {
 		return shortestPathCacheStats_;
 	}
 
+	Ptr<QueryStats> queryStats() const {
+		return queryStats_;
+	}
+
+	/* The counters of shortestPathCacheStats() and the distributions of queryStats() as a single line of
+	   JSON, for scripts to collect. Latencies are in nanoseconds. */
+	string statsJson() const;
+
 	void shortestPathCacheIsEnabledIs(bool b) {
 		if (shortestPathCacheIsEnabled_ != b) {
 			shortestPathCacheIsEnabled_ = b;
 		}
 	}
 
+	CacheFill shortestPathCacheFill() const {
+		return shortestPathCacheFill_;
+	}
+
+	void shortestPathCacheFillIs(CacheFill f) {
+		if (shortestPathCacheFill_ != f) {
+			shortestPathCacheFill_ = f;
+		}
+	}
+
+	/* Bound on the estimated memory of the cache, in bytes. 0 (the default) leaves the cache unbounded. */
+	U64 shortestPathCacheBudget() const {
+		return shortestPathCacheBudget_;
+	}
+
+	/* A lower budget evicts destinations right away */
+	void shortestPathCacheBudgetIs(U64 bytes) {
+		if (shortestPathCacheBudget_ != bytes) {
+			shortestPathCacheBudget_ = bytes;
+			evictFromShortestPathCache();
+		}
+	}
+
+	CacheEviction shortestPathCacheEviction() const {
+		return shortestPathCacheEviction_;
+	}
+
+	void shortestPathCacheEvictionIs(CacheEviction e) {
+		if (shortestPathCacheEviction_ != e) {
+			shortestPathCacheEviction_ = e;
+		}
+	}
+
+	/* True if every location of complete reverse trees keeps a precomputed alternate next hop: its best one 
+	   other than the cached one. Segment deletions are then patched in place in those trees, starting from 
+	   the alternates, rather than dropping the paths through the segment. Off by default, as the alternates 
+	   take about as much memory as the entries. */
+	bool shortestPathCacheAlternates() const {
+		return shortestPathCacheAlternates_;
+	}
+
+	void shortestPathCacheAlternatesIs(bool b) {
+		if (shortestPathCacheAlternates_ != b) {
+			shortestPathCacheAlternates_ = b;
+			if (!b) {
+				alternateHopsDelAll();
+			}
+		}
+	}
+
+	/* True if the cache holds the complete reverse shortest path tree of 'destination' */
+	bool isShortestPathTreeCached(const Ptr<Location>& destination) const {
+		return (destination != null) && (isElemPresentInSet(completeCacheDestinations_, destination->name()));
+	}
+
+	Engine shortestPathEngine() const {
+		return shortestPathEngine_;
+	}
+
+	void shortestPathEngineIs(Engine e) {
+		if (shortestPathEngine_ != e) {
+			shortestPathEngine_ = e;
+		}
+	}
+
+	/* Number of landmarks used by the alt engine */
+	unsigned int landmarkCount() const {
+		return landmarkCount_;
+	}
+
+	void landmarkCountIs(unsigned int n) {
+		if (landmarkCount_ != n) {
+			landmarkCount_ = n;
+			landmarkTable_ = null;
+		}
+	}
+
+	// This method should ideally be in 'private' scope. Placing it here only for testing purposes.
+	Ptr<LandmarkTable> landmarkTable();
+
+	/* Bucket width of the deltaStepping engine. 0 (the default) picks one from the network (DeltaStepping::bucketWidth()). */
+	double deltaSteppingBucketWidth() const {
+		return deltaSteppingBucketWidth_;
+	}
+
+	void deltaSteppingBucketWidthIs(double width) {
+		width = std::max(width, 0.0);
+		if (deltaSteppingBucketWidth_ != width) {
+			deltaSteppingBucketWidth_ = width;
+		}
+	}
+
+	/* Table of the allPairs engine for the network as it is now. Built on the first call, on the 
+	   shortestPathWorkerCount() workers. Once the network changes, it is rebuilt on a thread of its own if 
+	   allPairsRebuildIsBackground(), and null until the rebuild is done; otherwise it is rebuilt before returning. */
+	std::shared_ptr<const AllPairsTable> allPairsTable();
+
+	/* True (the default) if the allPairs table is rebuilt in the background after a change to the network */
+	bool allPairsRebuildIsBackground() const {
+		return allPairsRebuildIsBackground_;
+	}
+
+	void allPairsRebuildIsBackgroundIs(bool b) {
+		if (allPairsRebuildIsBackground_ != b) {
+			allPairsRebuildIsBackground_ = b;
+		}
+	}
+
+	/* Number of allPairs tables built */
+	unsigned int allPairsBuildCount() const {
+		return allPairsBuildCount_;
+	}
+
+	/* Hierarchy used by the contractionHierarchy engine. Null until one is set, and again once the network changes. */
+	Ptr<ContractionHierarchy> shortestPathHierarchy();
+
+	void shortestPathHierarchyIs(const Ptr<ContractionHierarchy>& ch) {
+		if (shortestPathHierarchy_ != ch) {
+			shortestPathHierarchy_ = ch;
+		}
+	}
+
+	/* Labels used by the hubLabels engine. Null until some are set, and again once the network changes. */
+	Ptr<HubLabels> shortestPathHubLabels();
+
+	void shortestPathHubLabelsIs(const Ptr<HubLabels>& labels) {
+		if (shortestPathHubLabels_ != labels) {
+			shortestPathHubLabels_ = labels;
+		}
+	}
+
 	// TODO: Delete this method. Its for test purposes alone.
 	/*
 	void printShortestPathCache() {
@@ -229,6 +1008,7 @@ public:
 	//*/
 
 	ShortestPathCache& shortestPathCache() {
+		repairShortestPathCache();
 		return shortestPathCache_;
 	}
 
@@ -245,81 +1025,366 @@ protected:
 
 	void onSegmentDel(const Ptr<Segment>& segment);
 
+	/* Starts following the arcs of 'index', which must be the index of the travel network manager */
+	void indexIs(const Ptr<TravelNetworkIndex>& index);
+
+	//=======================================================
+	// IndexTracker class
+	//    Records the segments whose arc got shorter (newly
+	//    linked, or shortened) or longer (unlinked, rewired
+	//    away, or lengthened), so that the cache is repaired
+	//    before the next query.
+	//=======================================================
+
+	class IndexTracker : public TravelNetworkIndex::Notifiee {
+	public:
+
+		static IndexTracker* instanceNew(const Ptr<TravelNetworkIndex>& index, Conn* conn) {
+			const auto tracker = new IndexTracker(conn);
+			tracker->notifierIs(index);
+			return tracker;
+		}
+
+		void onArcNew(const TravelNetworkIndex::ArcChange& arc) {
+			conn_->segmentIsShorter(notifier()->segment(arc.segment));
+		}
+
+		void onArcDel(const TravelNetworkIndex::ArcChange& arc) {
+			conn_->segmentIsLonger(notifier()->segment(arc.segment));
+		}
+
+		void onArcLength(const TravelNetworkIndex::ArcChange& arc) {
+			if (arc.length < arc.previousLength) {
+				conn_->segmentIsShorter(notifier()->segment(arc.segment));
+			} else {
+				conn_->segmentIsLonger(notifier()->segment(arc.segment));
+			}
+		}
+
+	protected:
+
+		explicit IndexTracker(Conn* conn) :
+			conn_(conn)
+		{
+			// Nothing else to do
+		}
+
+	private:
+
+		// Not a Ptr since the Conn owns its tracker
+		Conn* conn_;
+	};
+
 	Conn(const string& name, const Ptr<TravelNetworkManager>& mgr):
 		NamedInterface(name),
 		travelNetworkManager_(mgr),
 		shortestPathCacheStats_(PathCacheStats::instanceNew()),
-		shortestPathCacheIsEnabled_(true)
+		queryStats_(QueryStats::instanceNew()),
+		searchSettledCount_(0),
+		searchRelaxedCount_(0),
+		shortestPathCacheIsEnabled_(true),
+		shortestPathCacheFill_(settledPrefixes),
+		policyTreesVersion_(0),
+		shortestPathCacheAlternates_(false),
+		shortestPathCacheBudget_(0),
+		shortestPathCacheBytes_(0),
+		shortestPathCacheEviction_(leastRecentlyUsed),
+		shortestPathEngine_(binaryHeap),
+		landmarkCount_(8),
+		shortestPathWorkerCount_(std::max(std::thread::hardware_concurrency(), 1u)),
+		deltaSteppingBucketWidth_(0),
+		networkBucketWidth_(0),
+		networkBucketWidthVersion_(0),
+		snapshotTreeCapacity_(256),
+		allPairsRebuildIsBackground_(true),
+		allPairsBuildCount_(0),
+		indexTracker_(nullptr)
 	{
-		// Nothing else to do
+		clockHand_ = cacheDestinationOrder_.end();
 	}
 
-	~Conn() { }
+	~Conn() {
+		delete indexTracker_;
+	}
 
 private:
 
-	PathVector getPathsFromLoc(const Ptr<Location>& location,
-							   const Ptr<Path>& pathFromStartLocation,
-							   const Miles& maxLength, 
-							   set<string> locationsVisited
-							  ) const {
-		PathVector validPaths;
+	/* Distance from the root of the forward tree 'tree' to 'locId', with the segments of the path appended 
+	   to 'segments' in order unless it is null */
+	static double shortestPathFromTree(const ShortestPathTree& tree, 
+									   const TravelNetworkIndex::Id locId, 
+									   vector<TravelNetworkIndex::Id>* segments);
 
-		if (location != null) {
-			for (auto i = 0u; i < location->sourceSegmentCount(); i++) {		
-				auto segment = location->sourceSegment(i);
-				Miles totalLengthOfPath = pathFromStartLocation->length() + segment->length();
-				auto destination = segment->destination();
-
-				if ((totalLengthOfPath <= maxLength) && 
-					(destination != null) &&
-					(locationsVisited.find(destination->name()) == locationsVisited.end())) {
-						Ptr<Path> p = Path::instanceNew(pathFromStartLocation);
-						p->segmentIs(segment);
-						validPaths.push_back(p);
-
-						locationsVisited.insert(destination->name());
-						auto otherPaths = getPathsFromLoc(destination, p, maxLength, locationsVisited);
-						locationsVisited.erase(destination->name());
-
-						for (auto p : otherPaths) {
-							validPaths.push_back(p);
-						}
-				}
-			}
-		}
+	void insertIntoShortestPathCache(const Ptr<TravelNetworkIndex>& index, 
+									 const ShortestPathTree& tree, 
+									 const TravelNetworkIndex::Id locId);
 
-		return validPaths;
+	/* Caches 'segName' as the next hop from 'srcName' to 'destName', unless that entry is already cached */
+	void insertIntoShortestPathCache(LocToSeg& srcToSeg, const string& destName, const string& srcName, const string& segName);
+
+	/* Cache entries to 'destName', set up for eviction if the destination is new to the cache */
+	LocToSeg& shortestPathCacheDestination(const string& destName);
+
+	/* Erases every cache entry to 'destName' and forgets the destination. Returns the number of entries erased. */
+	unsigned int shortestPathCacheDestinationDel(const string& destName);
+
+	/* Records a query to 'destName' for the eviction policy */
+	void cacheDestinationIsUsed(const string& destName);
+
+	/* Evicts policy trees, then destinations, until the cache is back within its budget */
+	void evictFromShortestPathCache();
+
+	/* Next destination to evict under the current policy, ignoring admission */
+	string shortestPathCacheVictim();
+
+	void shortestPathCacheBytesIs(U64 bytes);
+
+	/* Estimated memory of one policy tree with its map and order list nodes */
+	static U64 policyTreeBytes(const ShortestPathTree& tree);
+
+	/* Drops the policy tree of 'destination', and its policy key once it has no tree left */
+	void policyTreeDel(const PolicyKey& key, const TravelNetworkIndex::Id destination);
+
+	/* Estimated memory of one cache entry and its two index references */
+	static U64 cacheEntryBytes(const string& destName, const string& srcName, const string& segName);
+
+	/* Estimated memory of a destination's map and eviction bookkeeping, without its entries */
+	static U64 cacheDestinationBytes(const string& destName);
+
+	/* Estimated memory of one path kept for cache hits */
+	static U64 cachedPathBytes(const string& srcName);
+
+	/* Estimated memory of one distance kept for cache hits */
+	static U64 cachedDistanceBytes(const string& srcName);
+
+	static U64 stringHeapBytes(const string& s);
+
+	// Start of the files written by shortestPathCacheSave(): "TSPC", then the version of their format
+	static const U32 shortestPathCacheFileMagic = 0x43505354;
+	static const U32 shortestPathCacheFileVersion = 1;
+
+	/* Writes 'value' to 'file' as it is in memory, in the byte order of the host */
+	template<typename T>
+	static void fileValueIs(std::ofstream& file, const T& value) {
+		file.write(reinterpret_cast<const char*>(&value), sizeof(value));
 	}
 
-	void insertIntoShortestPathCache(const Ptr<Path>& path);
+	template<typename T>
+	static bool fileValue(std::ifstream& file, T& value) {
+		return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(value)));
+	}
 
-	string findNextLocWithMinDist(unordered_map<string, Miles> locsToConsiderNextToMinDist) {
-		string minDistLocName = "__no_loc_found__";
+	/* Estimated memory of one alternate next hop */
+	static U64 alternateHopBytes(const string& srcName, const AlternateHop& hop);
 
-		if (locsToConsiderNextToMinDist.size() > 0) {
-			Miles minDist = Miles(ULONG_MAX);
+	/* Drops the paths and distances kept for cache hits to 'destName' */
+	void cachedPathsDel(const string& destName);
 
-			for (auto it = locsToConsiderNextToMinDist.begin(); it != locsToConsiderNextToMinDist.end(); it++) {
-				const auto dist = it->second;
-				if (dist < minDist) {
-					minDistLocName = it->first;
-					minDist = dist;
-				}
-			}
+	void cachedPathsDelAll();
 
-			return minDistLocName;
-		}
+	/* Best out arc of each of 'locations' in the complete reverse tree 'tree', other than its next hop, and 
+	   the length through it. nullId if there is none. */
+	static void alternateHopsFind(const TravelNetworkIndex* index, 
+								  const ShortestPathTree& tree, 
+								  const vector<TravelNetworkIndex::Id>& locations, 
+								  vector<TravelNetworkIndex::Id>& segments, 
+								  vector<double>& lengths);
+
+	/* Keeps 'segName' as the alternate next hop from 'srcName' to 'destName', 'length' away through it */
+	void alternateHopIs(const string& destName, const string& srcName, const string& segName, double length);
+
+	void alternateHopDel(const string& destName, const string& srcName);
+
+	void alternateHopsDel(const string& destName);
+
+	void alternateHopsDelAll();
+
+	/* Best next hop from 'srcName' to 'destName' other than its cached one, from the current cache. 
+	   Kept as its alternate if there is one. */
+	void alternateHopFind(const string& destName, const string& srcName, unordered_map<string, double>& cachedDist);
+
+	/* Erases one cache entry along with its references in the invalidation index */
+	void shortestPathCacheEntryDel(const string& destName, const string& srcName);
+
+	/* Erases every cache entry that 'index' lists under 'name', along with their cached subtrees */
+	void shortestPathCacheEntriesDel(CacheEntryIndex& index, const string& name);
+
+	/* Erases the entry from 'srcName' to 'destName' and every entry whose cached path goes through it */
+	void shortestPathCacheSubtreeDel(const string& destName, const string& srcName);
+
+	/* Adds 'srcName' and the sources of all the entries to 'destName' whose cached path goes through it */
+	void cachedSubtree(const string& destName, const string& srcName, set<string>& subtree) const;
+
+	void segmentIsShorter(const Ptr<Segment>& segment);
+
+	void segmentIsLonger(const Ptr<Segment>& segment);
+
+	/* Brings the cache in line with the segments that got shorter or longer since the last query */
+	void repairShortestPathCache();
+
+	/* Complete reverse trees are repaired in place, in the style of Ramalingam-Reps. A longer segment 
+	   only affects the subtree that used it, and a shorter one only the locations it brings closer. */
+	void repairShortestPathTreeAfterLonger(const string& destName, const set<string>& affected);
+
+	void repairShortestPathTreeAfterShorter(const string& destName, const Ptr<Segment>& segment);
+
+	/* Erases the entries to destinations without a complete tree that 'segment' makes shorter */
+	void invalidateShortestPathCacheAfterShorter(const Ptr<Segment>& segment);
+
+	/* Overwrites the next hop from 'srcName' to 'destName' */
+	void shortestPathCacheEntryIs(const string& destName, const string& srcName, const string& segName);
+
+	/* Length of the cached path from 'srcName' to the destination of 'srcToSeg'. Unreachable if the chain 
+	   of next hops is broken. Lengths found along the way are kept in 'cachedDist'. */
+	double cachedPathLength(const LocToSeg& srcToSeg, 
+							const string& destName, 
+							const string& srcName, 
+							unordered_map<string, double>& cachedDist) const;
 
-		return minDistLocName;
+	/* Backward search from the destination of 'group' until all its sources are settled, or over the 
+	   whole network if 'isTreeComplete', along with the alternate next hops of the settled locations 
+	   if 'isAlternateNeeded'. Runs on the workers, so it only reads 'index'. */
+	static void shortestPathsToDestination(const TravelNetworkIndex* index, 
+										   ShortestPathGroup& group, 
+										   const bool isTreeComplete, 
+										   const bool isAlternateNeeded);
+
+	/* The engines: length of the shortest path from 'source' to 'destination', unreachableDistance() if there is 
+	   none, with the ids of its segments appended to 'segments' in order unless it is null. They fill the cache 
+	   as they go, and leave the work of their search in searchSettledCount_ and searchRelaxedCount_. */
+	double shortestPathSearch(const Ptr<Location>& source, const Ptr<Location>& destination, vector<TravelNetworkIndex::Id>* segments);
+
+	double shortestPathByReverseTree(const Ptr<Location>& source, const Ptr<Location>& destination, vector<TravelNetworkIndex::Id>* segments);
+
+	double shortestPathByLinearScan(const Ptr<Location>& source, const Ptr<Location>& destination, vector<TravelNetworkIndex::Id>* segments);
+
+	double shortestPathByBinaryHeap(const Ptr<Location>& source, const Ptr<Location>& destination, vector<TravelNetworkIndex::Id>* segments);
+
+	double shortestPathByBidirectionalSearch(const Ptr<Location>& source, const Ptr<Location>& destination, vector<TravelNetworkIndex::Id>* segments);
+
+	double shortestPathByAlt(const Ptr<Location>& source, const Ptr<Location>& destination, vector<TravelNetworkIndex::Id>* segments);
+
+	double shortestPathByContractionHierarchy(const Ptr<Location>& source, const Ptr<Location>& destination, vector<TravelNetworkIndex::Id>* segments);
+
+	double shortestPathByDeltaStepping(const Ptr<Location>& source, const Ptr<Location>& destination, vector<TravelNetworkIndex::Id>* segments);
+
+	/* Delta-stepping search over 'index' on the workers, with the bucket width in use */
+	DeltaStepping deltaSteppingSearch(const Ptr<TravelNetworkIndex>& index);
+
+	double shortestPathByAllPairs(const Ptr<Location>& source, const Ptr<Location>& destination, vector<TravelNetworkIndex::Id>* segments);
+
+	double shortestPathByHubLabels(const Ptr<Location>& source, const Ptr<Location>& destination, vector<TravelNetworkIndex::Id>* segments);
+
+	WorkerPool* shortestPathWorkerPool();
+
+	/* Length of the cached path from 'source' to 'destination', unreachableDistance() on a miss. Walks the 
+	   next hops as shortestPathCached() does, keeping the distance of each location along the way. */
+	double distanceCached(const Ptr<Location>& source, const Ptr<Location>& destination);
+
+	/* Backward search from 'destination' that stops once the nearest of 'sources' is settled, grown into 'tree'. 
+	   Returns that source, nullId if there is none. */
+	TravelNetworkIndex::Id nearestSourceSearch(const vector< Ptr<Location> >& sources, 
+											   const Ptr<Location>& destination, 
+											   ShortestPathTree& tree);
+
+	/* The nearest of 'sources' to 'destination' by merges of their hub labels, with its distance in 'length'. 
+	   Returns nullId if there is none. */
+	TravelNetworkIndex::Id nearestSourceByHubLabels(const Ptr<HubLabels>& labels, 
+													const vector< Ptr<Location> >& sources, 
+													const Ptr<Location>& destination, 
+													double& length);
+
+	/* Records the locations settled and arcs relaxed since the last call as one search, if there were any */
+	void searchIsDone();
+
+	static U64 nanosecondsSince(const std::chrono::steady_clock::time_point& start) {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	static double unreachableDistance() {
+		return ShortestPathTree::unreachableDistance();
 	}
 
-	bool isLocationPartOfTravelNetwork(const Ptr<Location>& loc);
+	/* Reverse tree of 'destination' by the given policies: from the policy trees, grown completely on a miss 
+	   (into 'tree' if the budget cannot hold it), or grown into 'tree' up to 'source' when the cache is disabled. */
+	template <class Weight, class Filter>
+	const ShortestPathTree& policyTree(const Ptr<TravelNetworkIndex>& index, 
+									   const TravelNetworkIndex::Id source, 
+									   const TravelNetworkIndex::Id destination, 
+									   const Weight& weight, 
+									   const Filter& filter, 
+									   ShortestPathTree& tree);
+
+	bool isLocationPartOfTravelNetwork(const Ptr<Location>& loc) const;
 
 	Ptr<TravelNetworkManager> travelNetworkManager_;
 	ShortestPathCache shortestPathCache_;
 	Ptr<PathCacheStats> shortestPathCacheStats_;
+	Ptr<QueryStats> queryStats_;
+	// Work of the search in progress, which the engines add to as they settle locations and relax arcs
+	U64 searchSettledCount_;
+	U64 searchRelaxedCount_;
 	bool shortestPathCacheIsEnabled_;
+	CacheFill shortestPathCacheFill_;
+	set<string> completeCacheDestinations_;
+	// Invalidation index: segment name to the entries that use it as next hop, 
+	// and source location name to the entries from it
+	CacheEntryIndex shortestPathCacheSegmentIndex_;
+	CacheEntryIndex shortestPathCacheSourceIndex_;
+	// Paths built by cache hits, by destination. Every location along a built path keeps the suffix 
+	// from it, so later hits share the same segments. Dropped whenever an entry of the destination 
+	// is erased or changed, and on any change of segment length or ends.
+	unordered_map<string, LocToPath> cachedPaths_;
+	// Lengths of the cached paths found by distance() hits, by destination, kept and dropped along with the paths above
+	unordered_map<string, LocToDistance> cachedDistances_;
+	// Reverse trees of the queries by a weight and filter, by their policy key and destination id, all grown 
+	// on index version policyTreesVersion_. They count towards the budget, and are evicted first.
+	struct PolicyTree {
+		ShortestPathTree tree;
+		std::list< std::pair<PolicyKey, TravelNetworkIndex::Id> >::iterator order;
+	};
+	typedef unordered_map<TravelNetworkIndex::Id, PolicyTree> IdToPolicyTree;
+	unordered_map<PolicyKey, IdToPolicyTree, PolicyKeyHash> policyCaches_;
+	// Policy trees in order of last query
+	std::list< std::pair<PolicyKey, TravelNetworkIndex::Id> > policyTreeOrder_;
+	U64 policyTreesVersion_;
+	bool shortestPathCacheAlternates_;
+	// Alternate next hops by destination, for complete reverse trees only. They stay exact as long as no 
+	// distance gets shorter, so they are all dropped on the first shorter segment.
+	unordered_map<string, LocToAlternateHop> alternateHops_;
+	// Names of the segments that got shorter or longer since the cache was last repaired
+	set<string> shorterSegments_;
+	set<string> longerSegments_;
+	U64 shortestPathCacheBudget_;
+	U64 shortestPathCacheBytes_;
+	CacheEviction shortestPathCacheEviction_;
+	// Destinations in the cache, in order of last query (leastRecentlyUsed) or of arrival (clockSweep)
+	std::list<string> cacheDestinationOrder_;
+	unordered_map<string, CacheDestination> cacheDestinations_;
+	std::list<string>::iterator clockHand_;
+	// Destinations that entered the cache since the last eviction, which frequencyAdmission may turn away
+	set<string> newCacheDestinations_;
+	FrequencySketch cacheDestinationFrequency_;
+	Engine shortestPathEngine_;
+	unsigned int landmarkCount_;
+	Ptr<LandmarkTable> landmarkTable_;
+	Ptr<ContractionHierarchy> shortestPathHierarchy_;
+	Ptr<HubLabels> shortestPathHubLabels_;
+	unsigned int shortestPathWorkerCount_;
+	Ptr<WorkerPool> shortestPathWorkerPool_;
+	double deltaSteppingBucketWidth_;
+	// Picked by DeltaStepping::bucketWidth() for the index version below, when deltaSteppingBucketWidth_ is 0
+	double networkBucketWidth_;
+	U64 networkBucketWidthVersion_;
+	// Read by other threads, so only accessed through std::atomic_load and std::atomic_store
+	std::shared_ptr<const TravelNetworkSnapshot> snapshot_;
+	unsigned int snapshotTreeCapacity_;
+	std::shared_ptr<const AllPairsTable> allPairsTable_;
+	// The table being rebuilt in the background, if any. Its thread only reads the snapshot it was given.
+	std::future< std::shared_ptr<const AllPairsTable> > allPairsRebuild_;
+	bool allPairsRebuildIsBackground_;
+	unsigned int allPairsBuildCount_;
+	IndexTracker* indexTracker_;
 };
 
 
@@ -3,6 +3,114 @@
 #define CONN_IMPL_H
 
 #include <climits>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <queue>
+#include <sstream>
+
+U64 Conn::pathsVisit(const Ptr<Location>& location, const Miles& maxLength, const PathCallback& callback) const {
+	if (!isLocationPartOfTravelNetwork(location)) {
+		return 0;
+	}
+
+	const auto index = travelNetworkManager_->index();
+	const auto startId = index->locationId(location);
+
+	// One frame per location of the current path, with the next of its out arcs to follow
+	struct Frame {
+		TravelNetworkIndex::Id location;
+		const TravelNetworkIndex::Arc* nextArc;
+	};
+
+	vector<Frame> stack;
+	vector<TravelNetworkIndex::Id> segments;
+	vector<double> lengths;
+	vector<bool> isOnPath(index->locationIdCount(), false);
+	U64 pathCount = 0;
+
+	stack.reserve(index->locationIdCount());
+	segments.reserve(index->locationIdCount());
+	lengths.reserve(index->locationIdCount());
+
+	stack.push_back(Frame{ startId, index->outArcIter(startId) });
+	lengths.push_back(0);
+	isOnPath[startId] = true;
+
+	while (!stack.empty()) {
+		auto& frame = stack.back();
+		if (frame.nextArc == index->outArcIterEnd(frame.location)) {
+			isOnPath[frame.location] = false;
+			stack.pop_back();
+			lengths.pop_back();
+			if (!segments.empty()) {
+				segments.pop_back();
+			}
+
+			continue;
+		}
+
+		const auto arc = frame.nextArc++;
+		const auto length = lengths.back() + arc->length;
+		if ( (length <= maxLength.value()) && (!isOnPath[arc->location]) ) {
+			segments.push_back(arc->segment);
+			pathCount++;
+			if ( (callback) && (!callback(segments, Miles(length))) ) {
+				break;
+			}
+
+			lengths.push_back(length);
+			isOnPath[arc->location] = true;
+			stack.push_back(Frame{ arc->location, index->outArcIter(arc->location) });
+		}
+	}
+
+	return pathCount;
+}
+
+Ptr<Conn::Path> Conn::pathNew(const vector<TravelNetworkIndex::Id>& segments) const {
+	const auto index = travelNetworkManager_->index();
+	auto p = Path::instanceNew();
+	for (auto id : segments) {
+		p->segmentIs(index->segment(id));
+	}
+
+	return p;
+}
+
+Conn::PathVector Conn::pathsInParallel(const Ptr<Location>& location, const Miles& maxLength) {
+	PathVector validPaths;
+	if (!isLocationPartOfTravelNetwork(location)) {
+		return validPaths;
+	}
+
+	const auto index = travelNetworkManager_->index();
+	PathEnumeration enumeration(index.ptr(), index->locationId(location), maxLength.value(), true);
+	enumeration.run(shortestPathWorkerPool());
+
+	// Paths are built here, since the workers cannot touch reference counts
+	validPaths.reserve(enumeration.pathCount());
+	for (auto w = 0u; w < enumeration.workerCount(); w++) {
+		for (auto i = U64(0); i < enumeration.pathCount(w); i++) {
+			validPaths.push_back(pathNew(enumeration.path(w, i)));
+		}
+	}
+
+	return validPaths;
+}
+
+U64 Conn::pathCountInParallel(const Ptr<Location>& location, const Miles& maxLength) {
+	if (!isLocationPartOfTravelNetwork(location)) {
+		return 0;
+	}
+
+	const auto index = travelNetworkManager_->index();
+	PathEnumeration enumeration(index.ptr(), index->locationId(location), maxLength.value(), false);
+	enumeration.run(shortestPathWorkerPool());
+
+	return enumeration.pathCount();
+}
 
 Ptr<Conn::Path> Conn::shortestPath(
 		    const Ptr<Location>& source, 
@@ -18,190 +126,2513 @@ Ptr<Conn::Path> Conn::shortestPath(
 		return Path::instanceNew();
 	}
 
+	repairShortestPathCache();
+
+	const auto startTime = std::chrono::steady_clock::now();
 	if (shortestPathCacheIsEnabled_) {
+		cacheDestinationIsUsed(destination->name());
+
 		const auto csp = shortestPathCached(source, destination);
 		if (csp != null) {
+			evictFromShortestPathCache();
+			queryStats_->cachedLatencySampleIs(nanosecondsSince(startTime));
 			return csp;
 		}
 	}
 
-	unordered_map< string, Miles> locsToConsiderNextToMinDist;
-	unordered_map< string, Ptr<Path> > locToMinPath;
-	std::set< string > locationsVisited;
+	vector<TravelNetworkIndex::Id> segments;
+	Ptr<Path> p;
+	if (shortestPathSearch(source, destination, &segments) != unreachableDistance()) {
+		p = pathNew(segments);
+	}
 
-	const auto sourceName = source->name();
-	const auto destName = destination->name();
-	const Miles maxPathLength(ULONG_MAX);
+	queryStats_->uncachedLatencySampleIs(nanosecondsSince(startTime));
 
-	for (auto it = travelNetworkManager_->locationIter(); it != travelNetworkManager_->locationIterEnd(); it++) {
-		const auto locName = it->first;
-		if (locName == sourceName) {
-			locsToConsiderNextToMinDist.insert(LocToMinDistMap::value_type(locName, 0));
-		} else {
-			locsToConsiderNextToMinDist.insert(LocToMinDistMap::value_type(locName, maxPathLength));
+	return p;
+}
+
+Miles Conn::distance(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination) {
+	if ( (source == null) || 
+		 (destination == null) || 
+		 (!isLocationPartOfTravelNetwork(source)) || 
+		 (!isLocationPartOfTravelNetwork(destination)) ) {
+		return unreachable();
+	}
+
+	if (source == destination) {
+		return Miles(0);
+	}
+
+	repairShortestPathCache();
+
+	const auto startTime = std::chrono::steady_clock::now();
+	if (shortestPathCacheIsEnabled_) {
+		cacheDestinationIsUsed(destination->name());
+
+		const auto length = distanceCached(source, destination);
+		if (length != unreachableDistance()) {
+			evictFromShortestPathCache();
+			queryStats_->cachedLatencySampleIs(nanosecondsSince(startTime));
+			return Miles(length);
 		}
 	}
 
-	locToMinPath[sourceName] = Path::instanceNew();
+	const auto length = shortestPathSearch(source, destination, nullptr);
+	queryStats_->uncachedLatencySampleIs(nanosecondsSince(startTime));
 
-	// Main loop of Djikstra's algorithm
-	while(locsToConsiderNextToMinDist.size() > 0) {
-		const auto locName = findNextLocWithMinDist(locsToConsiderNextToMinDist);
-		if (locName == "__no_loc_found__") {
+	return Miles(length);
+}
+
+double Conn::shortestPathSearch(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    vector<TravelNetworkIndex::Id>* segments) {
+	auto length = unreachableDistance();
+	if ( (shortestPathCacheIsEnabled_) && (shortestPathCacheFill_ == reverseTrees) ) {
+		length = shortestPathByReverseTree(source, destination, segments);
+	} else {
+		switch(shortestPathEngine_) {
+			case linearScan:
+				length = shortestPathByLinearScan(source, destination, segments);
+				break;
+			case binaryHeap:
+				length = shortestPathByBinaryHeap(source, destination, segments);
+				break;
+			case bidirectional:
+				length = shortestPathByBidirectionalSearch(source, destination, segments);
+				break;
+			case alt:
+				length = shortestPathByAlt(source, destination, segments);
+				break;
+			case contractionHierarchy:
+				length = shortestPathByContractionHierarchy(source, destination, segments);
+				break;
+			case deltaStepping:
+				length = shortestPathByDeltaStepping(source, destination, segments);
+				break;
+			case allPairs:
+				length = shortestPathByAllPairs(source, destination, segments);
+				break;
+			case hubLabels:
+				length = shortestPathByHubLabels(source, destination, segments);
+				break;
+		}
+	}
+
+	// The engines fill the cache as they search, so it is brought back within budget once they are done
+	evictFromShortestPathCache();
+
+	searchIsDone();
+
+	return length;
+}
+
+Ptr<Conn::Path> Conn::shortestPathFromNearest(
+		    const vector< Ptr<Location> >& sources, 
+		    const Ptr<Location>& destination) {
+	if ( (destination == null) || (!isLocationPartOfTravelNetwork(destination)) ) {
+		return null;
+	}
+
+	const auto index = travelNetworkManager_->index();
+	const auto destId = index->locationId(destination);
+	const auto labels = (shortestPathEngine_ == hubLabels) ? shortestPathHubLabels() : Ptr<HubLabels>(null);
+	if ( (labels != null) && (labels->isLocationLabeled(destId)) ) {
+		auto length = unreachableDistance();
+		const auto nearestId = nearestSourceByHubLabels(labels, sources, destination, length);
+		if (nearestId == TravelNetworkIndex::nullId) {
 			return null;
 		}
 
-		const auto loc = travelNetworkManager_->location(locName);
-		const auto minPathToLoc = locToMinPath[locName];
+		vector<TravelNetworkIndex::Id> segments;
+		labels->shortestPath(nearestId, destId, segments);
+		return pathNew(segments);
+	}
 
-		// Update path cache
-		if ( (minPathToLoc->segmentCount() > 0) && (shortestPathCacheIsEnabled_) ){
-			insertIntoShortestPathCache(minPathToLoc);
+	ShortestPathTree tree;
+	const auto nearestId = nearestSourceSearch(sources, destination, tree);
+	if (nearestId == TravelNetworkIndex::nullId) {
+		return null;
+	}
+
+	auto p = Path::instanceNew();
+	for (auto id = nearestId; tree.predSegment[id] != TravelNetworkIndex::nullId; id = tree.predLocation[id]) {
+		p->segmentIs(index->segment(tree.predSegment[id]));
+	}
+
+	return p;
+}
+
+std::pair< Ptr<Location>, Miles > Conn::distanceFromNearest(
+		    const vector< Ptr<Location> >& sources, 
+		    const Ptr<Location>& destination) {
+	if ( (destination == null) || (!isLocationPartOfTravelNetwork(destination)) ) {
+		return std::make_pair(Ptr<Location>(null), unreachable());
+	}
+
+	const auto index = travelNetworkManager_->index();
+	const auto labels = (shortestPathEngine_ == hubLabels) ? shortestPathHubLabels() : Ptr<HubLabels>(null);
+	if ( (labels != null) && (labels->isLocationLabeled(index->locationId(destination))) ) {
+		auto length = unreachableDistance();
+		const auto nearestId = nearestSourceByHubLabels(labels, sources, destination, length);
+		if (nearestId == TravelNetworkIndex::nullId) {
+			return std::make_pair(Ptr<Location>(null), unreachable());
+		}
+
+		return std::make_pair(index->location(nearestId), Miles(length));
+	}
+
+	ShortestPathTree tree;
+	const auto nearestId = nearestSourceSearch(sources, destination, tree);
+	if (nearestId == TravelNetworkIndex::nullId) {
+		return std::make_pair(Ptr<Location>(null), unreachable());
+	}
+
+	return std::make_pair(index->location(nearestId), Miles(tree.minDist[nearestId]));
+}
+
+template <class Weight, class Filter>
+Ptr<Conn::Path> Conn::shortestPath(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    const Weight& weight, 
+		    const Filter& filter) {
+	if ( (source == null) || 
+		 (destination == null) || 
+		 (!isLocationPartOfTravelNetwork(source)) || 
+		 (!isLocationPartOfTravelNetwork(destination)) ) {
+		return null;
+	}
+
+	if (source == destination) {
+		return Path::instanceNew();
+	}
+
+	const auto index = travelNetworkManager_->index();
+	const auto sourceId = index->locationId(source);
+	ShortestPathTree scratch;
+	const auto& tree = policyTree(index, sourceId, index->locationId(destination), weight, filter, scratch);
+	if (tree.minDist[sourceId] == unreachableDistance()) {
+		return null;
+	}
+
+	vector<TravelNetworkIndex::Id> segments;
+	for (auto id = sourceId; tree.predSegment[id] != TravelNetworkIndex::nullId; id = tree.predLocation[id]) {
+		segments.push_back(tree.predSegment[id]);
+	}
+
+	return pathNew(segments);
+}
+
+template <class Weight, class Filter>
+double Conn::shortestPathWeight(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    const Weight& weight, 
+		    const Filter& filter) {
+	if ( (source == null) || 
+		 (destination == null) || 
+		 (!isLocationPartOfTravelNetwork(source)) || 
+		 (!isLocationPartOfTravelNetwork(destination)) ) {
+		return unreachableDistance();
+	}
+
+	if (source == destination) {
+		return 0;
+	}
+
+	const auto index = travelNetworkManager_->index();
+	const auto sourceId = index->locationId(source);
+	ShortestPathTree scratch;
+	return policyTree(index, sourceId, index->locationId(destination), weight, filter, scratch).minDist[sourceId];
+}
+
+template <class Weight, class Filter>
+const ShortestPathTree& Conn::policyTree(
+		    const Ptr<TravelNetworkIndex>& index, 
+		    const TravelNetworkIndex::Id source, 
+		    const TravelNetworkIndex::Id destination, 
+		    const Weight& weight, 
+		    const Filter& filter, 
+		    ShortestPathTree& tree) {
+	const auto startTime = std::chrono::steady_clock::now();
+	if (!shortestPathCacheIsEnabled_) {
+		tree.rootIs(index, destination, ShortestPathTree::backward, weight, filter, source);
+		searchSettledCount_ += tree.settledCount;
+		searchRelaxedCount_ += tree.relaxedCount;
+		searchIsDone();
+		queryStats_->uncachedLatencySampleIs(nanosecondsSince(startTime));
+		return tree;
+	}
+
+	shortestPathCacheStats_->requestCountIsIncByOne();
+
+	// Ids are only meaningful for the index version the trees were grown on
+	if (policyTreesVersion_ != index->version()) {
+		while (!policyTreeOrder_.empty()) {
+			policyTreeDel(policyTreeOrder_.front().first, policyTreeOrder_.front().second);
 		}
+		policyTreesVersion_ = index->version();
+	}
 
-		if (loc == destination) {
-			return locToMinPath[destName];
+	auto key = weight.cacheKey();
+	key.filter = filter.cacheKey();
+	const auto cache = policyCaches_.find(key);
+	if (cache != policyCaches_.end()) {
+		const auto it = cache->second.find(destination);
+		if (it != cache->second.end()) {
+			shortestPathCacheStats_->hitCountIsIncByOne();
+			policyTreeOrder_.splice(policyTreeOrder_.end(), policyTreeOrder_, it->second.order);
+			queryStats_->cachedLatencySampleIs(nanosecondsSince(startTime));
+			return it->second.tree;
 		}
+	}
 
-		locsToConsiderNextToMinDist.erase(locName);
-		locationsVisited.insert(locName);
+	shortestPathCacheStats_->missCountIsIncByOne();
 
-		for (auto it2 = loc->sourceSegmentIter(); it2 != loc->sourceSegmentIterEnd(); it2++) {
-			const auto seg = *it2;
-			const auto dst = seg->destination();
-			if (dst != null) {
-				const auto dstName = dst->name();
+	tree.rootIs(index, destination, ShortestPathTree::backward, weight, filter);
+	searchSettledCount_ += tree.settledCount;
+	searchRelaxedCount_ += tree.relaxedCount;
+	searchIsDone();
 
-				if (!isKeyPresent(locToMinPath, dstName)) {
-					locToMinPath[dstName] = Path::instanceNew();
-				}
+	// A tree the budget cannot hold is only kept for this query. Room is made before the tree joins the 
+	// cache, which may drop the map of its key.
+	const auto bytes = policyTreeBytes(tree);
+	if ( (shortestPathCacheBudget_ > 0) && (bytes > shortestPathCacheBudget_) ) {
+		queryStats_->uncachedLatencySampleIs(nanosecondsSince(startTime));
+		return tree;
+	}
 
-				if (!isElemPresentInSet(locationsVisited, dstName)) {
-					const auto minPathToLoc = locToMinPath[locName];
-					const auto tmp = minPathToLoc->length() + seg->length();
-					const auto minPathToDst = locToMinPath[dstName];
-					if ( (minPathToDst->segmentCount() == 0) || (minPathToDst->length() > tmp) ) {
-						Ptr<Path> p = Path::instanceNew(minPathToLoc);
-						p->segmentIs(seg);
-						locToMinPath[dstName] = p;
-						locsToConsiderNextToMinDist[dstName] = p->length();
-					}
-				}
+	shortestPathCacheBytesIs(shortestPathCacheBytes_ + bytes);
+	evictFromShortestPathCache();
+
+	auto& destTree = policyCaches_[key][destination];
+	destTree.tree = std::move(tree);
+	destTree.order = policyTreeOrder_.insert(policyTreeOrder_.end(), std::make_pair(key, destination));
+	queryStats_->uncachedLatencySampleIs(nanosecondsSince(startTime));
+
+	return destTree.tree;
+}
+
+TravelNetworkIndex::Id Conn::nearestSourceByHubLabels(
+		    const Ptr<HubLabels>& labels, 
+		    const vector< Ptr<Location> >& sources, 
+		    const Ptr<Location>& destination, 
+		    double& length) {
+	const auto startTime = std::chrono::steady_clock::now();
+	const auto index = travelNetworkManager_->index();
+	const auto destId = index->locationId(destination);
+
+	// Strictly nearer only, so that sources at the same distance are preferred in the order given
+	auto nearestId = TravelNetworkIndex::nullId;
+	length = unreachableDistance();
+	for (const auto& source : sources) {
+		const auto id = (source != null) ? index->locationId(source) : TravelNetworkIndex::nullId;
+		if (id == TravelNetworkIndex::nullId) {
+			continue;
+		}
+
+		const auto d = (id == destId) ? 0 : labels->distance(id, destId);
+		if (d < length) {
+			length = d;
+			nearestId = id;
+		}
+	}
+
+	queryStats_->uncachedLatencySampleIs(nanosecondsSince(startTime));
+
+	return nearestId;
+}
+
+TravelNetworkIndex::Id Conn::nearestSourceSearch(
+		    const vector< Ptr<Location> >& sources, 
+		    const Ptr<Location>& destination, 
+		    ShortestPathTree& tree) {
+	typedef std::pair<double, TravelNetworkIndex::Id> HeapEntry;
+	std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > locsToConsiderNext;
+
+	repairShortestPathCache();
+
+	const auto startTime = std::chrono::steady_clock::now();
+	if (shortestPathCacheIsEnabled_) {
+		cacheDestinationIsUsed(destination->name());
+	}
+
+	const auto index = travelNetworkManager_->index();
+	const auto numLocations = index->locationIdCount();
+	const auto destId = index->locationId(destination);
+
+	// Position of each location in 'sources', used to break ties between equally near sources
+	const U32 notASource = std::numeric_limits<U32>::max();
+	vector<U32> sourceOrder(numLocations, notASource);
+	for (auto i = 0u; i < sources.size(); i++) {
+		const auto id = (sources[i] != null) ? index->locationId(sources[i]) : TravelNetworkIndex::nullId;
+		if ( (id != TravelNetworkIndex::nullId) && (sourceOrder[id] == notASource) ) {
+			sourceOrder[id] = i;
+		}
+	}
+
+	// Grown over destination segments, so predLocation is the next location on the way to the destination
+	tree = ShortestPathTree(numLocations);
+	vector<bool> locationsVisited(numLocations, false);
+	auto nearestId = TravelNetworkIndex::nullId;
+
+	tree.minDist[destId] = 0;
+	locsToConsiderNext.push(HeapEntry(0, destId));
+
+	while(!locsToConsiderNext.empty()) {
+		const auto locDist = locsToConsiderNext.top().first;
+		const auto locId = locsToConsiderNext.top().second;
+		locsToConsiderNext.pop();
+
+		if (locationsVisited[locId]) {
+			continue;
+		}
+
+		// Keep settling the locations as near as the first source found, in case one of them comes earlier in 'sources'
+		if ( (nearestId != TravelNetworkIndex::nullId) && (locDist > tree.minDist[nearestId]) ) {
+			break;
+		}
+
+		locationsVisited[locId] = true;
+		searchSettledCount_++;
+
+		if ( (sourceOrder[locId] != notASource) && 
+			 ( (nearestId == TravelNetworkIndex::nullId) || (sourceOrder[locId] < sourceOrder[nearestId]) ) ) {
+			nearestId = locId;
+		}
+
+		// Settled locations know their next hop on the shortest path to the destination
+		if ( (locId != destId) && (shortestPathCacheIsEnabled_) ) {
+			auto& srcToSeg = shortestPathCacheDestination(destination->name());
+			insertIntoShortestPathCache(srcToSeg, destination->name(), index->location(locId)->name(), 
+										index->segment(tree.predSegment[locId])->name());
+		}
+
+		searchRelaxedCount_ += index->inArcIterEnd(locId) - index->inArcIter(locId);
+		for (auto arc = index->inArcIter(locId); arc != index->inArcIterEnd(locId); arc++) {
+			const auto srcId = arc->location;
+			const auto tmp = locDist + arc->length;
+			if ( (!locationsVisited[srcId]) && (tmp < tree.minDist[srcId]) ) {
+				tree.minDist[srcId] = tmp;
+				tree.predLocation[srcId] = locId;
+				tree.predSegment[srcId] = arc->segment;
+				locsToConsiderNext.push(HeapEntry(tmp, srcId));
 			}
 		}
 	}
 
-	return null;
+	searchIsDone();
+	evictFromShortestPathCache();
+	queryStats_->uncachedLatencySampleIs(nanosecondsSince(startTime));
+
+	return nearestId;
 }
 
-Ptr<Conn::Path> Conn::shortestPathCached(const Ptr<Location>& source, const Ptr<Location>& destination) const {
-	const auto sourceName = source->name();
-	const auto destName = destination->name();
+Conn::PathVector Conn::shortestPaths(const vector<LocationPair>& pairs) {
+	PathVector paths(pairs.size());
 
-	shortestPathCacheStats_->requestCountIsIncByOne();
+	repairShortestPathCache();
+
+	const auto index = travelNetworkManager_->index();
+	const auto isTreeComplete = (shortestPathCacheIsEnabled_) && (shortestPathCacheFill_ == reverseTrees);
+	const auto isAlternateNeeded = (isTreeComplete) && (shortestPathCacheAlternates_);
+
+	// Pairs that the cache cannot answer, grouped by destination in the order they first appear
+	vector<ShortestPathGroup> groups;
+	unordered_map<TravelNetworkIndex::Id, U32> destToGroup;
+	for (auto i = 0u; i < pairs.size(); i++) {
+		const auto& source = pairs[i].first;
+		const auto& destination = pairs[i].second;
+		if ( (source == null) || 
+			 (destination == null) || 
+			 (!isLocationPartOfTravelNetwork(source)) || 
+			 (!isLocationPartOfTravelNetwork(destination)) ) {
+			continue;
+		}
+
+		if (source == destination) {
+			paths[i] = Path::instanceNew();
+			continue;
+		}
+
+		if (shortestPathCacheIsEnabled_) {
+			const auto startTime = std::chrono::steady_clock::now();
+			cacheDestinationIsUsed(destination->name());
+
+			paths[i] = shortestPathCached(source, destination);
+			if ( (paths[i] != null) || ( (isTreeComplete) && (isShortestPathTreeCached(destination)) ) ) {
+				queryStats_->cachedLatencySampleIs(nanosecondsSince(startTime));
+				continue;
+			}
+		}
+
+		const auto destId = index->locationId(destination);
+		auto it = destToGroup.find(destId);
+		if (it == destToGroup.end()) {
+			it = destToGroup.insert(std::make_pair(destId, groups.size())).first;
+			groups.push_back(ShortestPathGroup());
+			groups.back().destination = destId;
+			groups.back().settledCount = 0;
+			groups.back().relaxedCount = 0;
+			groups.back().searchNanoseconds = 0;
+		}
+
+		groups[it->second].pairs.push_back(i);
+		groups[it->second].sources.push_back(index->locationId(source));
+	}
+
+	if (groups.size() > 1) {
+		const auto indexPtr = index.ptr();
+		shortestPathWorkerPool()->run(groups.size(), [&groups, indexPtr, isTreeComplete, isAlternateNeeded](unsigned int g) {
+			shortestPathsToDestination(indexPtr, groups[g], isTreeComplete, isAlternateNeeded);
+		});
+	} else if (groups.size() == 1) {
+		shortestPathsToDestination(index.ptr(), groups[0], isTreeComplete, isAlternateNeeded);
+	}
+
+	// Paths and cache entries are built here, since the workers cannot touch reference counts
+	for (auto& group : groups) {
+		searchSettledCount_ += group.settledCount;
+		searchRelaxedCount_ += group.relaxedCount;
+		searchIsDone();
+		for (auto k = 0u; k < group.pairs.size(); k++) {
+			queryStats_->uncachedLatencySampleIs(group.searchNanoseconds);
+		}
 
-	if (isKeyPresent(shortestPathCache_, destName)) {
-		const auto d = shortestPathCache_.at(destName);
-		if (isKeyPresent(d, sourceName)) {
-			auto p = Path::instanceNew();
-			auto currLocName = sourceName;
-			const auto shortestPathsToDest = shortestPathCache_.at(destName);
-			while(currLocName != destName) {
-				if (!isKeyPresent(shortestPathsToDest, currLocName)) {
-					shortestPathCacheStats_->missCountIsIncByOne();
-					return null;
+		const auto destName = index->location(group.destination)->name();
+		if (shortestPathCacheIsEnabled_) {
+			if (isTreeComplete) {
+				for (auto i = 0u; i < group.settledLocations.size(); i++) {
+					shortestPathCacheEntryIs(destName, index->location(group.settledLocations[i])->name(), 
+											 index->segment(group.settledSegments[i])->name());
 				}
 
-				const auto segName = shortestPathsToDest.at(currLocName);
-				const auto seg = travelNetworkManager_->segment(segName);
-				p->segmentIs(seg);
-				currLocName = seg->destination()->name();
+				completeCacheDestinations_.insert(destName);
+
+				for (auto i = 0u; i < group.alternateSegments.size(); i++) {
+					if (group.alternateSegments[i] != TravelNetworkIndex::nullId) {
+						alternateHopIs(destName, index->location(group.settledLocations[i])->name(), 
+									   index->segment(group.alternateSegments[i])->name(), group.alternateLengths[i]);
+					}
+				}
+			} else {
+				auto& srcToSeg = shortestPathCacheDestination(destName);
+				for (auto i = 0u; i < group.settledLocations.size(); i++) {
+					insertIntoShortestPathCache(srcToSeg, destName, index->location(group.settledLocations[i])->name(), 
+												index->segment(group.settledSegments[i])->name());
+				}
 			}
+		}
 
-			shortestPathCacheStats_->hitCountIsIncByOne();
+		for (auto k = 0u; k < group.pairs.size(); k++) {
+			if (!group.pathSegments[k].empty()) {
+				auto p = Path::instanceNew();
+				for (auto segId : group.pathSegments[k]) {
+					p->segmentIs(index->segment(segId));
+				}
 
-			return p;
+				paths[group.pairs[k]] = p;
+			}
 		}
 	}
 
-	shortestPathCacheStats_->missCountIsIncByOne();
+	evictFromShortestPathCache();
 
-	return null;
+	return paths;
 }
 
-void Conn::insertIntoShortestPathCache(const Ptr<Conn::Path>& path) {
-	const auto numSegments = path->segmentCount();
-	if (numSegments > 0) {
-		const auto destName = path->destination()->name();
-		if (!isKeyPresent(shortestPathCache_, destName)) {
-			unordered_map<string, string> tmp;
-			shortestPathCache_.insert(ShortestPathCache::value_type(destName, tmp));
+void Conn::shortestPathsToDestination(const TravelNetworkIndex* index, 
+									  ShortestPathGroup& group, 
+									  const bool isTreeComplete, 
+									  const bool isAlternateNeeded) {
+	typedef std::pair<double, TravelNetworkIndex::Id> HeapEntry;
+	std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > locsToConsiderNext;
+
+	const auto startTime = std::chrono::steady_clock::now();
+	const auto numLocations = index->locationIdCount();
+	const auto destId = group.destination;
+
+	vector<bool> isSource(numLocations, false);
+	auto numSourcesLeft = 0u;
+	for (auto srcId : group.sources) {
+		if (!isSource[srcId]) {
+			isSource[srcId] = true;
+			numSourcesLeft++;
+		}
+	}
+
+	// Grown over destination segments, so predLocation is the next location on the way to the destination
+	ShortestPathTree tree(numLocations);
+	vector<bool> locationsVisited(numLocations, false);
+
+	tree.minDist[destId] = 0;
+	locsToConsiderNext.push(HeapEntry(0, destId));
+
+	while( (!locsToConsiderNext.empty()) && ( (isTreeComplete) || (numSourcesLeft > 0) ) ) {
+		const auto locDist = locsToConsiderNext.top().first;
+		const auto locId = locsToConsiderNext.top().second;
+		locsToConsiderNext.pop();
+
+		if (locationsVisited[locId]) {
+			continue;
+		}
+
+		locationsVisited[locId] = true;
+		group.settledCount++;
+
+		if (locId != destId) {
+			group.settledLocations.push_back(locId);
+			group.settledSegments.push_back(tree.predSegment[locId]);
+		}
+
+		if (isSource[locId]) {
+			numSourcesLeft--;
+		}
+
+		group.relaxedCount += index->inArcIterEnd(locId) - index->inArcIter(locId);
+		for (auto arc = index->inArcIter(locId); arc != index->inArcIterEnd(locId); arc++) {
+			const auto srcId = arc->location;
+			const auto tmp = locDist + arc->length;
+			if ( (!locationsVisited[srcId]) && (tmp < tree.minDist[srcId]) ) {
+				tree.minDist[srcId] = tmp;
+				tree.predLocation[srcId] = locId;
+				tree.predSegment[srcId] = arc->segment;
+				locsToConsiderNext.push(HeapEntry(tmp, srcId));
+			}
 		}
+	}
+
+	if (isAlternateNeeded) {
+		alternateHopsFind(index, tree, group.settledLocations, group.alternateSegments, group.alternateLengths);
+	}
 
-		const auto it = shortestPathCache_.find(destName);
-		for (auto i = 0u; i < numSegments; i++) {
-			const auto seg = path->segment(i);
-			const auto source = seg->source();
-			it->second.insert(LocToSeg::value_type(source->name(), seg->name()));
+	group.pathSegments.resize(group.sources.size());
+	for (auto k = 0u; k < group.sources.size(); k++) {
+		if (locationsVisited[group.sources[k]]) {
+			for (auto id = group.sources[k]; tree.predSegment[id] != TravelNetworkIndex::nullId; id = tree.predLocation[id]) {
+				group.pathSegments[k].push_back(tree.predSegment[id]);
+			}
 		}
 	}
+
+	group.searchNanoseconds = nanosecondsSince(startTime);
 }
 
-void Conn::onLocationDel(const Ptr<Location>& location) {
-	auto it = shortestPathCache_.find(location->name());
-	if (it != shortestPathCache_.end()) {
-		shortestPathCache_.erase(it);
+double Conn::shortestPathByReverseTree(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    vector<TravelNetworkIndex::Id>* segments) {
+	const auto destName = destination->name();
+
+	// The complete tree is already cached, so the source cannot reach the destination
+	if (isShortestPathTreeCached(destination)) {
+		return unreachableDistance();
 	}
 
-	std::set<string> destinationSegNames;
-	for (auto it = location->destinationSegmentIter(); it != location->destinationSegmentIterEnd(); it++) {
-		const auto seg = *it;
-		destinationSegNames.insert(seg->name());
+	const auto index = travelNetworkManager_->index();
+	const auto destId = index->locationId(destination);
+
+	ShortestPathTree tree;
+	if (shortestPathEngine_ == deltaStepping) {
+		deltaSteppingSearch(index).rootIs(destId, ShortestPathTree::backward, tree);
+	} else {
+		tree.rootIs(index, destId, ShortestPathTree::backward);
 	}
 
-	const auto locName = location->name();
+	searchSettledCount_ += tree.settledCount;
+	searchRelaxedCount_ += tree.relaxedCount;
 
-	for (auto it1 = shortestPathCache_.begin(); it1 != shortestPathCache_.end(); it1++) {
-		const auto destName = it1->first;
-		auto srcToSeg = it1->second;
-		auto it2 = srcToSeg.begin();
+	// Next hops already cached for this destination may come from another tree when there are ties
+	vector<TravelNetworkIndex::Id> settledLocations;
+	for (auto id = 0u; id < index->locationIdCount(); id++) {
+		if (tree.predSegment[id] != TravelNetworkIndex::nullId) {
+			shortestPathCacheEntryIs(destName, index->location(id)->name(), index->segment(tree.predSegment[id])->name());
+			settledLocations.push_back(id);
+		}
+	}
+
+	completeCacheDestinations_.insert(destName);
 
-		while(it2 != srcToSeg.end()) {
-			const auto srcName = it2->first;
-			const auto segName = it2->second;
-			if ( (srcName == locName) || (isElemPresentInSet(destinationSegNames, segName)) ) {
-				it1->second.erase(srcName);
+	if (shortestPathCacheAlternates_) {
+		vector<TravelNetworkIndex::Id> alternateSegments;
+		vector<double> alternateLengths;
+		alternateHopsFind(index.ptr(), tree, settledLocations, alternateSegments, alternateLengths);
+		for (auto i = 0u; i < settledLocations.size(); i++) {
+			if (alternateSegments[i] != TravelNetworkIndex::nullId) {
+				alternateHopIs(destName, index->location(settledLocations[i])->name(), 
+							   index->segment(alternateSegments[i])->name(), alternateLengths[i]);
 			}
+		}
+	}
+
+	const auto sourceId = index->locationId(source);
+	if (tree.predSegment[sourceId] == TravelNetworkIndex::nullId) {
+		return unreachableDistance();
+	}
 
-			it2++;
+	if (segments != nullptr) {
+		for (auto id = sourceId; tree.predSegment[id] != TravelNetworkIndex::nullId; id = tree.predLocation[id]) {
+			segments->push_back(tree.predSegment[id]);
 		}
 	}
+
+	return tree.minDist[sourceId];
 }
 
-void Conn::onSegmentDel(const Ptr<Segment>& segment) {
-	const auto deletedSegName = segment->name();
-	for (auto it1 = shortestPathCache_.begin(); it1 != shortestPathCache_.end(); it1++) {
-		const auto destName = it1->first;
-		auto srcToSeg = it1->second;
-		auto it2 = srcToSeg.begin();
+double Conn::shortestPathByLinearScan(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    vector<TravelNetworkIndex::Id>* segments) {
+	const auto index = travelNetworkManager_->index();
+	const auto numLocations = index->locationIdCount();
+	const auto sourceId = index->locationId(source);
+	const auto destId = index->locationId(destination);
+
+	ShortestPathTree tree(numLocations);
+	vector<bool> locationsVisited(numLocations, false);
 
-		while(it2 != srcToSeg.end()) {
-			const auto srcName = it2->first;
-			const auto segName = it2->second;
-			if (deletedSegName == segName) {
-				it1->second.erase(srcName);
+	tree.minDist[sourceId] = 0;
+
+	// Main loop of Djikstra's algorithm
+	while(true) {
+		auto locId = TravelNetworkIndex::nullId;
+		auto locDist = unreachableDistance();
+		for (auto id = 0u; id < numLocations; id++) {
+			if ( (!locationsVisited[id]) && (tree.minDist[id] < locDist) ) {
+				locId = id;
+				locDist = tree.minDist[id];
 			}
+		}
 
-			it2++;
+		if (locId == TravelNetworkIndex::nullId) {
+			return unreachableDistance();
 		}
-	}
+
+		searchSettledCount_++;
+
+		// Update path cache
+		if ( (locId != sourceId) && (shortestPathCacheIsEnabled_) ){
+			insertIntoShortestPathCache(index, tree, locId);
+		}
+
+		if (locId == destId) {
+			return shortestPathFromTree(tree, destId, segments);
+		}
+
+		locationsVisited[locId] = true;
+
+		searchRelaxedCount_ += index->outArcIterEnd(locId) - index->outArcIter(locId);
+		for (auto arc = index->outArcIter(locId); arc != index->outArcIterEnd(locId); arc++) {
+			const auto dstId = arc->location;
+			const auto tmp = locDist + arc->length;
+			if ( (!locationsVisited[dstId]) && (tmp < tree.minDist[dstId]) ) {
+				tree.minDist[dstId] = tmp;
+				tree.predLocation[dstId] = locId;
+				tree.predSegment[dstId] = arc->segment;
+			}
+		}
+	}
+
+	return unreachableDistance();
+}
+
+double Conn::shortestPathByBinaryHeap(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    vector<TravelNetworkIndex::Id>* segments) {
+	typedef std::pair<double, TravelNetworkIndex::Id> HeapEntry;
+	std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > locsToConsiderNext;
+
+	const auto index = travelNetworkManager_->index();
+	const auto numLocations = index->locationIdCount();
+	const auto sourceId = index->locationId(source);
+	const auto destId = index->locationId(destination);
+
+	ShortestPathTree tree(numLocations);
+	vector<bool> locationsVisited(numLocations, false);
+
+	tree.minDist[sourceId] = 0;
+	locsToConsiderNext.push(HeapEntry(0, sourceId));
+
+	// Main loop of Djikstra's algorithm. Locations whose distance has been improved 
+	// are pushed again instead of being updated in place, so stale entries are skipped here.
+	while(!locsToConsiderNext.empty()) {
+		const auto locDist = locsToConsiderNext.top().first;
+		const auto locId = locsToConsiderNext.top().second;
+		locsToConsiderNext.pop();
+
+		if (locationsVisited[locId]) {
+			continue;
+		}
+
+		searchSettledCount_++;
+
+		// Update path cache
+		if ( (locId != sourceId) && (shortestPathCacheIsEnabled_) ){
+			insertIntoShortestPathCache(index, tree, locId);
+		}
+
+		if (locId == destId) {
+			return shortestPathFromTree(tree, destId, segments);
+		}
+
+		locationsVisited[locId] = true;
+
+		searchRelaxedCount_ += index->outArcIterEnd(locId) - index->outArcIter(locId);
+		for (auto arc = index->outArcIter(locId); arc != index->outArcIterEnd(locId); arc++) {
+			const auto dstId = arc->location;
+			const auto tmp = locDist + arc->length;
+			if ( (!locationsVisited[dstId]) && (tmp < tree.minDist[dstId]) ) {
+				tree.minDist[dstId] = tmp;
+				tree.predLocation[dstId] = locId;
+				tree.predSegment[dstId] = arc->segment;
+				locsToConsiderNext.push(HeapEntry(tmp, dstId));
+			}
+		}
+	}
+
+	return unreachableDistance();
+}
+
+double Conn::shortestPathByBidirectionalSearch(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    vector<TravelNetworkIndex::Id>* segments) {
+	typedef std::pair<double, TravelNetworkIndex::Id> HeapEntry;
+	typedef std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > Heap;
+
+	const auto index = travelNetworkManager_->index();
+	const auto numLocations = index->locationIdCount();
+	const auto sourceId = index->locationId(source);
+	const auto destId = index->locationId(destination);
+
+	// The backward tree is grown over destination segments, so its predLocation points towards the destination
+	ShortestPathTree forwardTree(numLocations);
+	ShortestPathTree backwardTree(numLocations);
+	vector<bool> forwardVisited(numLocations, false);
+	vector<bool> backwardVisited(numLocations, false);
+	Heap forwardHeap;
+	Heap backwardHeap;
+
+	forwardTree.minDist[sourceId] = 0;
+	backwardTree.minDist[destId] = 0;
+	forwardHeap.push(HeapEntry(0, sourceId));
+	backwardHeap.push(HeapEntry(0, destId));
+
+	// Length of the shortest source-destination path seen so far and the location where its two halves meet
+	auto minPathLength = unreachableDistance();
+	auto meetingLocId = TravelNetworkIndex::nullId;
+
+	while (true) {
+		while ( (!forwardHeap.empty()) && (forwardVisited[forwardHeap.top().second]) ) {
+			forwardHeap.pop();
+		}
+
+		while ( (!backwardHeap.empty()) && (backwardVisited[backwardHeap.top().second]) ) {
+			backwardHeap.pop();
+		}
+
+		if ( (forwardHeap.empty()) || (backwardHeap.empty()) ) {
+			break;
+		}
+
+		// No unsettled location can be on a path shorter than the best one found so far
+		if (forwardHeap.top().first + backwardHeap.top().first >= minPathLength) {
+			break;
+		}
+
+		const bool isForward = (forwardHeap.top().first <= backwardHeap.top().first);
+		auto& heap = isForward ? forwardHeap : backwardHeap;
+		auto& tree = isForward ? forwardTree : backwardTree;
+		auto& visited = isForward ? forwardVisited : backwardVisited;
+		const auto& otherTree = isForward ? backwardTree : forwardTree;
+
+		const auto locDist = heap.top().first;
+		const auto locId = heap.top().second;
+		heap.pop();
+		visited[locId] = true;
+		searchSettledCount_++;
+
+		if (shortestPathCacheIsEnabled_) {
+			if (isForward) {
+				if (locId != sourceId) {
+					insertIntoShortestPathCache(index, forwardTree, locId);
+				}
+			} else if (locId != destId) {
+				// Settled backward locations know their next hop on the shortest path to the destination
+				auto& srcToSeg = shortestPathCacheDestination(destination->name());
+				insertIntoShortestPathCache(srcToSeg, destination->name(), index->location(locId)->name(), 
+											index->segment(backwardTree.predSegment[locId])->name());
+			}
+		}
+
+		const auto arcBegin = isForward ? index->outArcIter(locId) : index->inArcIter(locId);
+		const auto arcEnd = isForward ? index->outArcIterEnd(locId) : index->inArcIterEnd(locId);
+		searchRelaxedCount_ += arcEnd - arcBegin;
+		for (auto arc = arcBegin; arc != arcEnd; arc++) {
+			const auto nextId = arc->location;
+			const auto tmp = locDist + arc->length;
+			if ( (!visited[nextId]) && (tmp < tree.minDist[nextId]) ) {
+				tree.minDist[nextId] = tmp;
+				tree.predLocation[nextId] = locId;
+				tree.predSegment[nextId] = arc->segment;
+				heap.push(HeapEntry(tmp, nextId));
+			}
+
+			if ( (otherTree.minDist[nextId] != unreachableDistance()) &&
+				 (tree.minDist[nextId] + otherTree.minDist[nextId] < minPathLength) ) {
+				minPathLength = tree.minDist[nextId] + otherTree.minDist[nextId];
+				meetingLocId = nextId;
+			}
+		}
+	}
+
+	if (meetingLocId == TravelNetworkIndex::nullId) {
+		return unreachableDistance();
+	}
+
+	vector<TravelNetworkIndex::Id> pathSegments;
+	shortestPathFromTree(forwardTree, meetingLocId, &pathSegments);
+	for (auto id = meetingLocId; backwardTree.predSegment[id] != TravelNetworkIndex::nullId; id = backwardTree.predLocation[id]) {
+		pathSegments.push_back(backwardTree.predSegment[id]);
+	}
+
+	// Neither search settled the destination from the source, so the path itself is cached here
+	if (shortestPathCacheIsEnabled_) {
+		auto& srcToSeg = shortestPathCacheDestination(destination->name());
+		for (auto segId : pathSegments) {
+			const auto seg = index->segment(segId);
+			insertIntoShortestPathCache(srcToSeg, destination->name(), seg->source()->name(), seg->name());
+		}
+	}
+
+	if (segments != nullptr) {
+		segments->insert(segments->end(), pathSegments.begin(), pathSegments.end());
+	}
+
+	return minPathLength;
+}
+
+double Conn::shortestPathByAlt(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    vector<TravelNetworkIndex::Id>* segments) {
+	typedef std::pair<double, TravelNetworkIndex::Id> HeapEntry;
+	std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > locsToConsiderNext;
+
+	const auto landmarks = landmarkTable();
+	const auto index = travelNetworkManager_->index();
+	const auto numLocations = index->locationIdCount();
+	const auto sourceId = index->locationId(source);
+	const auto destId = index->locationId(destination);
+
+	// Lower bound on the distance from each location to the destination, computed the first time it is reached
+	vector<double> potential(numLocations, -1);
+
+	ShortestPathTree tree(numLocations);
+	vector<bool> locationsVisited(numLocations, false);
+
+	potential[sourceId] = landmarks->lowerBound(sourceId, destId);
+	if (potential[sourceId] == unreachableDistance()) {
+		return unreachableDistance();
+	}
+
+	tree.minDist[sourceId] = 0;
+	locsToConsiderNext.push(HeapEntry(potential[sourceId], sourceId));
+
+	// Dijkstra's algorithm on lengths reduced by the potentials. Since the landmark bounds are 
+	// consistent, the first time a location is popped its distance is final, just as in binaryHeap.
+	while(!locsToConsiderNext.empty()) {
+		const auto locId = locsToConsiderNext.top().second;
+		locsToConsiderNext.pop();
+
+		if (locationsVisited[locId]) {
+			continue;
+		}
+
+		searchSettledCount_++;
+
+		// Update path cache
+		if ( (locId != sourceId) && (shortestPathCacheIsEnabled_) ){
+			insertIntoShortestPathCache(index, tree, locId);
+		}
+
+		if (locId == destId) {
+			return shortestPathFromTree(tree, destId, segments);
+		}
+
+		locationsVisited[locId] = true;
+
+		const auto locDist = tree.minDist[locId];
+		searchRelaxedCount_ += index->outArcIterEnd(locId) - index->outArcIter(locId);
+		for (auto arc = index->outArcIter(locId); arc != index->outArcIterEnd(locId); arc++) {
+			const auto dstId = arc->location;
+			const auto tmp = locDist + arc->length;
+			if ( (!locationsVisited[dstId]) && (tmp < tree.minDist[dstId]) ) {
+				if (potential[dstId] < 0) {
+					potential[dstId] = landmarks->lowerBound(dstId, destId);
+				}
+
+				// The landmarks prove that the destination cannot be reached from there
+				if (potential[dstId] == unreachableDistance()) {
+					continue;
+				}
+
+				tree.minDist[dstId] = tmp;
+				tree.predLocation[dstId] = locId;
+				tree.predSegment[dstId] = arc->segment;
+				locsToConsiderNext.push(HeapEntry(tmp + potential[dstId], dstId));
+			}
+		}
+	}
+
+	return unreachableDistance();
+}
+
+Ptr<LandmarkTable> Conn::landmarkTable() {
+	if (landmarkTable_ == null) {
+		landmarkTable_ = LandmarkTable::instanceNew(travelNetworkManager_->index(), landmarkCount_);
+	}
+
+	if (landmarkTable_->isStale()) {
+		landmarkTable_->isStaleIs(false);
+	}
+
+	return landmarkTable_;
+}
+
+double Conn::shortestPathByContractionHierarchy(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    vector<TravelNetworkIndex::Id>* segments) {
+	const auto ch = shortestPathHierarchy();
+	const auto index = travelNetworkManager_->index();
+	const auto sourceId = index->locationId(source);
+	const auto destId = index->locationId(destination);
+
+	if ( (ch == null) || (!ch->isLocationContracted(sourceId)) || (!ch->isLocationContracted(destId)) ) {
+		return shortestPathByBinaryHeap(source, destination, segments);
+	}
+
+	vector<TravelNetworkIndex::Id> segmentIds;
+	const auto length = ch->shortestPath(sourceId, destId, segmentIds);
+	searchSettledCount_ += ch->settledCount();
+	searchRelaxedCount_ += ch->relaxedCount();
+	if (length == unreachableDistance()) {
+		return unreachableDistance();
+	}
+
+	// Every suffix of a shortest path is a shortest path to the same destination
+	if (shortestPathCacheIsEnabled_) {
+		auto& srcToSeg = shortestPathCacheDestination(destination->name());
+		for (auto segId : segmentIds) {
+			const auto seg = index->segment(segId);
+			insertIntoShortestPathCache(srcToSeg, destination->name(), seg->source()->name(), seg->name());
+		}
+	}
+
+	if (segments != nullptr) {
+		segments->insert(segments->end(), segmentIds.begin(), segmentIds.end());
+	}
+
+	return length;
+}
+
+double Conn::shortestPathByDeltaStepping(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    vector<TravelNetworkIndex::Id>* segments) {
+	const auto index = travelNetworkManager_->index();
+	const auto sourceId = index->locationId(source);
+	const auto destId = index->locationId(destination);
+
+	ShortestPathTree tree;
+	auto search = deltaSteppingSearch(index);
+	search.rootIs(sourceId, ShortestPathTree::forward, tree, destId);
+	searchSettledCount_ += tree.settledCount;
+	searchRelaxedCount_ += tree.relaxedCount;
+
+	// Update path cache with every location settled along the way, as binaryHeap does
+	if (shortestPathCacheIsEnabled_) {
+		for (auto locId : search.settledLocations()) {
+			if (locId != sourceId) {
+				insertIntoShortestPathCache(index, tree, locId);
+			}
+		}
+	}
+
+	if (tree.minDist[destId] == unreachableDistance()) {
+		return unreachableDistance();
+	}
+
+	return shortestPathFromTree(tree, destId, segments);
+}
+
+DeltaStepping Conn::deltaSteppingSearch(const Ptr<TravelNetworkIndex>& index) {
+	auto width = deltaSteppingBucketWidth_;
+	if (width == 0) {
+		if ( (networkBucketWidth_ == 0) || (networkBucketWidthVersion_ != index->version()) ) {
+			networkBucketWidth_ = DeltaStepping::bucketWidth(index.ptr());
+			networkBucketWidthVersion_ = index->version();
+		}
+
+		width = networkBucketWidth_;
+	}
+
+	return DeltaStepping(index.ptr(), width, shortestPathWorkerPool());
+}
+
+WorkerPool* Conn::shortestPathWorkerPool() {
+	if (shortestPathWorkerPool_ == null) {
+		shortestPathWorkerPool_ = WorkerPool::instanceNew(shortestPathWorkerCount_);
+	}
+
+	return shortestPathWorkerPool_.ptr();
+}
+
+void Conn::searchIsDone() {
+	if ( (searchSettledCount_ > 0) || (searchRelaxedCount_ > 0) ) {
+		queryStats_->searchSampleIs(searchSettledCount_, searchRelaxedCount_);
+	}
+
+	searchSettledCount_ = 0;
+	searchRelaxedCount_ = 0;
+}
+
+Ptr<ContractionHierarchy> Conn::shortestPathHierarchy() {
+	if ( (shortestPathHierarchy_ != null) && (shortestPathHierarchy_->isStale()) ) {
+		shortestPathHierarchy_ = null;
+	}
+
+	return shortestPathHierarchy_;
+}
+
+double Conn::shortestPathByAllPairs(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    vector<TravelNetworkIndex::Id>* segments) {
+	const auto table = allPairsTable();
+	if (table == nullptr) {
+		return shortestPathByBinaryHeap(source, destination, segments);
+	}
+
+	const auto index = travelNetworkManager_->index();
+	const auto sourceId = index->locationId(source);
+	const auto destId = index->locationId(destination);
+	if (table->nextSegment(sourceId, destId) == TravelNetworkIndex::nullId) {
+		return unreachableDistance();
+	}
+
+	if (segments != nullptr) {
+		for (auto id = sourceId; id != destId; id = table->nextLocation(id, destId)) {
+			segments->push_back(table->nextSegment(id, destId));
+		}
+	}
+
+	return table->distance(sourceId, destId);
+}
+
+double Conn::shortestPathByHubLabels(
+		    const Ptr<Location>& source, 
+		    const Ptr<Location>& destination, 
+		    vector<TravelNetworkIndex::Id>* segments) {
+	const auto labels = shortestPathHubLabels();
+	const auto index = travelNetworkManager_->index();
+	const auto sourceId = index->locationId(source);
+	const auto destId = index->locationId(destination);
+
+	if ( (labels == null) || (!labels->isLocationLabeled(sourceId)) || (!labels->isLocationLabeled(destId)) ) {
+		return shortestPathByBinaryHeap(source, destination, segments);
+	}
+
+	// Like allPairs, the engine does not fill the cache: a merge costs about as much as a cache hit
+	if (segments != nullptr) {
+		return labels->shortestPath(sourceId, destId, *segments);
+	}
+
+	return labels->distance(sourceId, destId);
+}
+
+Ptr<HubLabels> Conn::shortestPathHubLabels() {
+	if ( (shortestPathHubLabels_ != null) && (shortestPathHubLabels_->isStale()) ) {
+		shortestPathHubLabels_ = null;
+	}
+
+	return shortestPathHubLabels_;
+}
+
+std::shared_ptr<const AllPairsTable> Conn::allPairsTable() {
+	const auto index = travelNetworkManager_->index();
+
+	if ( (allPairsRebuild_.valid()) && 
+		 ( (!allPairsRebuildIsBackground_) || 
+		   (allPairsRebuild_.wait_for(std::chrono::seconds(0)) == std::future_status::ready) ) ) {
+		allPairsTable_ = allPairsRebuild_.get();
+	}
+
+	if ( (allPairsTable_ != nullptr) && (allPairsTable_->version() == index->version()) ) {
+		return allPairsTable_;
+	}
+
+	// The rebuild works on a snapshot, so that the network can go on changing meanwhile. A network that 
+	// changed again by the time it is done gets another rebuild.
+	if ( (allPairsRebuildIsBackground_) && (allPairsTable_ != nullptr) ) {
+		if (!allPairsRebuild_.valid()) {
+			const auto snapshot = TravelNetworkSnapshot::instanceNew(index, 0);
+			allPairsRebuild_ = std::async(std::launch::async, [snapshot]() {
+				return AllPairsTable::instanceNew(snapshot, nullptr);
+			});
+			allPairsBuildCount_++;
+		}
+
+		return nullptr;
+	}
+
+	allPairsTable_ = AllPairsTable::instanceNew(TravelNetworkSnapshot::instanceNew(index, 0), shortestPathWorkerPool());
+	allPairsBuildCount_++;
+
+	return allPairsTable_;
+}
+
+double Conn::shortestPathFromTree(const ShortestPathTree& tree, 
+								  const TravelNetworkIndex::Id locId, 
+								  vector<TravelNetworkIndex::Id>* segments) {
+	if (segments != nullptr) {
+		const auto first = segments->size();
+		for (auto id = locId; tree.predSegment[id] != TravelNetworkIndex::nullId; id = tree.predLocation[id]) {
+			segments->push_back(tree.predSegment[id]);
+		}
+
+		std::reverse(segments->begin() + first, segments->end());
+	}
+
+	return tree.minDist[locId];
+}
+
+Ptr<Conn::Path> Conn::shortestPathCached(const Ptr<Location>& source, const Ptr<Location>& destination) {
+	const auto sourceName = source->name();
+	const auto destName = destination->name();
+
+	shortestPathCacheStats_->requestCountIsIncByOne();
+
+	const auto it = shortestPathCache_.find(destName);
+	if ( (it == shortestPathCache_.end()) || (!isKeyPresent(it->second, sourceName)) ) {
+		shortestPathCacheStats_->missCountIsIncByOne();
+		queryStats_->destinationRequestIs(destName, false);
+		return null;
+	}
+
+	// Follow the next hops up to the first location that an earlier hit already built the path from
+	const auto& shortestPathsToDest = it->second;
+	auto& pathsToDest = cachedPaths_[destName];
+	vector<string> locNames;
+	auto rest = Path::instanceNew();
+	auto p = Path::instanceNew();
+	auto currLocName = sourceName;
+	while(currLocName != destName) {
+		const auto pathIt = pathsToDest.find(currLocName);
+		if (pathIt != pathsToDest.end()) {
+			rest = pathIt->second;
+			break;
+		}
+
+		const auto segIt = shortestPathsToDest.find(currLocName);
+		if (segIt == shortestPathsToDest.end()) {
+			shortestPathCacheStats_->missCountIsIncByOne();
+			queryStats_->destinationRequestIs(destName, false);
+			return null;
+		}
+
+		const auto seg = travelNetworkManager_->segment(segIt->second);
+		p->segmentIs(seg);
+		locNames.push_back(currLocName);
+		currLocName = seg->destination()->name();
+	}
+
+	if (locNames.empty()) {
+		p = rest;
+	} else {
+		p->segmentsIs(rest);
+		for (auto i = 0u; i < locNames.size(); i++) {
+			pathsToDest[locNames[i]] = Path::instanceNew(p, i);
+			shortestPathCacheBytesIs(shortestPathCacheBytes_ + cachedPathBytes(locNames[i]));
+		}
+	}
+
+	shortestPathCacheStats_->hitCountIsIncByOne();
+	queryStats_->destinationRequestIs(destName, true);
+
+	// A view of its own, so that appending to it leaves the kept path alone
+	return Path::instanceNew(p);
+}
+
+double Conn::distanceCached(const Ptr<Location>& source, const Ptr<Location>& destination) {
+	const auto& sourceName = source->name();
+	const auto& destName = destination->name();
+
+	shortestPathCacheStats_->requestCountIsIncByOne();
+
+	const auto it = shortestPathCache_.find(destName);
+	if ( (it == shortestPathCache_.end()) || (!isKeyPresent(it->second, sourceName)) ) {
+		shortestPathCacheStats_->missCountIsIncByOne();
+		queryStats_->destinationRequestIs(destName, false);
+		return unreachableDistance();
+	}
+
+	// Follow the next hops up to the first location whose distance an earlier hit already found
+	const auto& shortestPathsToDest = it->second;
+	auto& distancesToDest = cachedDistances_[destName];
+	vector< std::pair<string, double> > hops;
+	auto length = 0.0;
+	auto currLocName = sourceName;
+	while(currLocName != destName) {
+		const auto distIt = distancesToDest.find(currLocName);
+		if (distIt != distancesToDest.end()) {
+			length = distIt->second;
+			break;
+		}
+
+		const auto segIt = shortestPathsToDest.find(currLocName);
+		if (segIt == shortestPathsToDest.end()) {
+			shortestPathCacheStats_->missCountIsIncByOne();
+			queryStats_->destinationRequestIs(destName, false);
+			return unreachableDistance();
+		}
+
+		const auto seg = travelNetworkManager_->segment(segIt->second);
+		hops.push_back(std::make_pair(currLocName, seg->length().value()));
+		currLocName = seg->destination()->name();
+	}
+
+	for (auto hop = hops.rbegin(); hop != hops.rend(); hop++) {
+		length += hop->second;
+		distancesToDest[hop->first] = length;
+		shortestPathCacheBytesIs(shortestPathCacheBytes_ + cachedDistanceBytes(hop->first));
+	}
+
+	shortestPathCacheStats_->hitCountIsIncByOne();
+	queryStats_->destinationRequestIs(destName, true);
+
+	return length;
+}
+
+void Conn::insertIntoShortestPathCache(const Ptr<TravelNetworkIndex>& index,
+									   const ShortestPathTree& tree, 
+									   const TravelNetworkIndex::Id locId) {
+	if (tree.predSegment[locId] != TravelNetworkIndex::nullId) {
+		const auto destName = index->location(locId)->name();
+		auto& srcToSeg = shortestPathCacheDestination(destName);
+		for (auto id = locId; tree.predSegment[id] != TravelNetworkIndex::nullId; id = tree.predLocation[id]) {
+			const auto srcId = tree.predLocation[id];
+			insertIntoShortestPathCache(srcToSeg, destName, index->location(srcId)->name(), index->segment(tree.predSegment[id])->name());
+		}
+	}
+}
+
+void Conn::insertIntoShortestPathCache(LocToSeg& srcToSeg, 
+									   const string& destName, 
+									   const string& srcName, 
+									   const string& segName) {
+	if (srcToSeg.insert(LocToSeg::value_type(srcName, segName)).second) {
+		const auto key = CacheEntryKey(destName, srcName);
+		shortestPathCacheSegmentIndex_[segName].insert(key);
+		shortestPathCacheSourceIndex_[srcName].insert(key);
+		shortestPathCacheBytesIs(shortestPathCacheBytes_ + cacheEntryBytes(destName, srcName, segName));
+	}
+}
+
+void Conn::shortestPathCacheEntryDel(const string& destName, const string& srcName) {
+	const auto it1 = shortestPathCache_.find(destName);
+	if (it1 == shortestPathCache_.end()) {
+		return;
+	}
+
+	const auto it2 = it1->second.find(srcName);
+	if (it2 == it1->second.end()) {
+		return;
+	}
+
+	cachedPathsDel(destName);
+	alternateHopDel(destName, srcName);
+
+	const auto key = CacheEntryKey(destName, srcName);
+	shortestPathCacheBytesIs(shortestPathCacheBytes_ - cacheEntryBytes(destName, srcName, it2->second));
+
+	const auto segIt = shortestPathCacheSegmentIndex_.find(it2->second);
+	if (segIt != shortestPathCacheSegmentIndex_.end()) {
+		segIt->second.erase(key);
+		if (segIt->second.empty()) {
+			shortestPathCacheSegmentIndex_.erase(segIt);
+		}
+	}
+
+	const auto srcIt = shortestPathCacheSourceIndex_.find(srcName);
+	if (srcIt != shortestPathCacheSourceIndex_.end()) {
+		srcIt->second.erase(key);
+		if (srcIt->second.empty()) {
+			shortestPathCacheSourceIndex_.erase(srcIt);
+		}
+	}
+
+	it1->second.erase(it2);
+}
+
+Conn::LocToSeg& Conn::shortestPathCacheDestination(const string& destName) {
+	const auto it = shortestPathCache_.find(destName);
+	if (it != shortestPathCache_.end()) {
+		return it->second;
+	}
+
+	// Under clockSweep a new destination goes right behind the hand, so it is the last one the hand reaches
+	const auto pos = (shortestPathCacheEviction_ == clockSweep) ? clockHand_ : cacheDestinationOrder_.end();
+	const auto order = cacheDestinationOrder_.insert(pos, destName);
+	cacheDestinations_[destName] = CacheDestination { order, false };
+	newCacheDestinations_.insert(destName);
+	shortestPathCacheBytesIs(shortestPathCacheBytes_ + cacheDestinationBytes(destName));
+
+	return shortestPathCache_[destName];
+}
+
+unsigned int Conn::shortestPathCacheDestinationDel(const string& destName) {
+	auto numEntries = 0u;
+
+	const auto it = shortestPathCache_.find(destName);
+	if (it != shortestPathCache_.end()) {
+		vector<string> srcNames;
+		for (auto& entry : it->second) {
+			srcNames.push_back(entry.first);
+		}
+
+		for (auto& srcName : srcNames) {
+			shortestPathCacheEntryDel(destName, srcName);
+		}
+
+		numEntries = srcNames.size();
+		shortestPathCache_.erase(destName);
+	}
+
+	cachedPathsDel(destName);
+	alternateHopsDel(destName);
+	completeCacheDestinations_.erase(destName);
+	newCacheDestinations_.erase(destName);
+
+	const auto destIt = cacheDestinations_.find(destName);
+	if (destIt != cacheDestinations_.end()) {
+		if (clockHand_ == destIt->second.order) {
+			clockHand_++;
+		}
+
+		cacheDestinationOrder_.erase(destIt->second.order);
+		cacheDestinations_.erase(destIt);
+		shortestPathCacheBytesIs(shortestPathCacheBytes_ - cacheDestinationBytes(destName));
+	}
+
+	return numEntries;
+}
+
+void Conn::cacheDestinationIsUsed(const string& destName) {
+	cacheDestinationFrequency_.frequencyIsIncByOne(destName);
+
+	const auto it = cacheDestinations_.find(destName);
+	if (it == cacheDestinations_.end()) {
+		return;
+	}
+
+	if (shortestPathCacheEviction_ == clockSweep) {
+		it->second.isReferenced = true;
+	} else {
+		cacheDestinationOrder_.splice(cacheDestinationOrder_.end(), cacheDestinationOrder_, it->second.order);
+	}
+}
+
+string Conn::shortestPathCacheVictim() {
+	if (shortestPathCacheEviction_ == clockSweep) {
+		// Every destination passed over loses its second chance, so at most one full turn is needed
+		while (true) {
+			if (clockHand_ == cacheDestinationOrder_.end()) {
+				clockHand_ = cacheDestinationOrder_.begin();
+			}
+
+			auto& dest = cacheDestinations_[*clockHand_];
+			if (!dest.isReferenced) {
+				return *clockHand_;
+			}
+
+			dest.isReferenced = false;
+			clockHand_++;
+		}
+	}
+
+	// Newcomers are the candidates for admission, not victims, unless nothing else is left
+	if (shortestPathCacheEviction_ == frequencyAdmission) {
+		for (auto& name : cacheDestinationOrder_) {
+			if (!isElemPresentInSet(newCacheDestinations_, name)) {
+				return name;
+			}
+		}
+	}
+
+	return cacheDestinationOrder_.front();
+}
+
+void Conn::evictFromShortestPathCache() {
+	// Policy trees go first, least recently queried first: each holds every location of the network, 
+	// more than most destinations of the cache
+	while ( (shortestPathCacheBudget_ > 0) && 
+			(shortestPathCacheBytes_ > shortestPathCacheBudget_) && 
+			(!policyTreeOrder_.empty()) ) {
+		policyTreeDel(policyTreeOrder_.front().first, policyTreeOrder_.front().second);
+		shortestPathCacheStats_->evictedEntryCountIsIncByOne();
+		shortestPathCacheStats_->evictionCountIsIncByOne();
+	}
+
+	while ( (shortestPathCacheBudget_ > 0) && 
+			(shortestPathCacheBytes_ > shortestPathCacheBudget_) && 
+			(!cacheDestinationOrder_.empty()) ) {
+		auto victim = shortestPathCacheVictim();
+
+		// The least queried newcomer only stays if it has been queried more often lately than the victim
+		if (shortestPathCacheEviction_ == frequencyAdmission) {
+			auto candidate = victim;
+			auto candidateFreq = FrequencySketch::maxFrequency() + 1;
+			for (auto& name : newCacheDestinations_) {
+				const auto freq = cacheDestinationFrequency_.frequency(name);
+				if (freq < candidateFreq) {
+					candidate = name;
+					candidateFreq = freq;
+				}
+			}
+
+			if ( (candidate != victim) && (candidateFreq <= cacheDestinationFrequency_.frequency(victim)) ) {
+				shortestPathCacheStats_->admissionRejectCountIsIncByOne();
+				victim = candidate;
+			}
+		}
+
+		const auto numEntries = shortestPathCacheDestinationDel(victim);
+		for (auto i = 0u; i < numEntries; i++) {
+			shortestPathCacheStats_->evictedEntryCountIsIncByOne();
+		}
+
+		shortestPathCacheStats_->evictionCountIsIncByOne();
+	}
+
+	// Whatever is still cached has been admitted
+	newCacheDestinations_.clear();
+}
+
+void Conn::shortestPathCacheBytesIs(U64 bytes) {
+	shortestPathCacheBytes_ = bytes;
+	shortestPathCacheStats_->residentBytesIs(bytes);
+}
+
+void Conn::policyTreeDel(const PolicyKey& key, const TravelNetworkIndex::Id destination) {
+	const auto cache = policyCaches_.find(key);
+	const auto it = cache->second.find(destination);
+	shortestPathCacheBytesIs(shortestPathCacheBytes_ - policyTreeBytes(it->second.tree));
+	policyTreeOrder_.erase(it->second.order);
+	cache->second.erase(it);
+	if (cache->second.empty()) {
+		policyCaches_.erase(cache);
+	}
+}
+
+// Node sizes are those of the usual node-based containers: hash nodes hold a next pointer and the 
+// cached hash, tree nodes a color and three pointers, list nodes two pointers
+U64 Conn::cacheEntryBytes(const string& destName, const string& srcName, const string& segName) {
+	const U64 hashNodeOverhead = 2 * sizeof(void*) + sizeof(size_t);
+	const U64 treeNodeOverhead = 4 * sizeof(void*);
+
+	// One LocToSeg node, and one node in each of the segment and source indexes
+	return hashNodeOverhead + sizeof(LocToSeg::value_type) + 
+		   2 * (treeNodeOverhead + sizeof(CacheEntryKey)) + 
+		   3 * stringHeapBytes(srcName) + 2 * stringHeapBytes(destName) + stringHeapBytes(segName);
+}
+
+U64 Conn::cacheDestinationBytes(const string& destName) {
+	const U64 hashNodeOverhead = 2 * sizeof(void*) + sizeof(size_t);
+	const U64 listNodeOverhead = 2 * sizeof(void*);
+
+	// Its ShortestPathCache node holding an empty LocToSeg, its order list node and its bookkeeping node
+	return hashNodeOverhead + sizeof(ShortestPathCache::value_type) + 
+		   listNodeOverhead + sizeof(string) + 
+		   hashNodeOverhead + sizeof(unordered_map<string, CacheDestination>::value_type) + 
+		   3 * stringHeapBytes(destName);
+}
+
+U64 Conn::alternateHopBytes(const string& srcName, const AlternateHop& hop) {
+	const U64 hashNodeOverhead = 2 * sizeof(void*) + sizeof(size_t);
+
+	return hashNodeOverhead + sizeof(LocToAlternateHop::value_type) + 
+		   stringHeapBytes(srcName) + stringHeapBytes(hop.primary) + stringHeapBytes(hop.segment);
+}
+
+U64 Conn::policyTreeBytes(const ShortestPathTree& tree) {
+	const U64 hashNodeOverhead = 2 * sizeof(void*) + sizeof(size_t);
+	const U64 listNodeOverhead = 2 * sizeof(void*);
+
+	return hashNodeOverhead + sizeof(IdToPolicyTree::value_type) + 
+		   listNodeOverhead + sizeof(std::pair<PolicyKey, TravelNetworkIndex::Id>) + 
+		   tree.minDist.size() * sizeof(double) + 
+		   (tree.predLocation.size() + tree.predSegment.size()) * sizeof(TravelNetworkIndex::Id);
+}
+
+U64 Conn::cachedDistanceBytes(const string& srcName) {
+	const U64 hashNodeOverhead = 2 * sizeof(void*) + sizeof(size_t);
+
+	return hashNodeOverhead + sizeof(LocToDistance::value_type) + stringHeapBytes(srcName);
+}
+
+U64 Conn::cachedPathBytes(const string& srcName) {
+	const U64 hashNodeOverhead = 2 * sizeof(void*) + sizeof(size_t);
+
+	// Its LocToPath node, the Path view, and its share of the segment array
+	return hashNodeOverhead + sizeof(LocToPath::value_type) + sizeof(Path) + 
+		   sizeof(Ptr<Segment>) + sizeof(double) + stringHeapBytes(srcName);
+}
+
+void Conn::cachedPathsDel(const string& destName) {
+	const auto it = cachedPaths_.find(destName);
+	if (it != cachedPaths_.end()) {
+		for (auto& entry : it->second) {
+			shortestPathCacheBytesIs(shortestPathCacheBytes_ - cachedPathBytes(entry.first));
+		}
+
+		cachedPaths_.erase(it);
+	}
+
+	const auto distIt = cachedDistances_.find(destName);
+	if (distIt != cachedDistances_.end()) {
+		for (auto& entry : distIt->second) {
+			shortestPathCacheBytesIs(shortestPathCacheBytes_ - cachedDistanceBytes(entry.first));
+		}
+
+		cachedDistances_.erase(distIt);
+	}
+}
+
+void Conn::cachedPathsDelAll() {
+	// Copies of the names: cachedPathsDel() erases the entries that hold them
+	while (!cachedPaths_.empty()) {
+		const auto destName = cachedPaths_.begin()->first;
+		cachedPathsDel(destName);
+	}
+
+	while (!cachedDistances_.empty()) {
+		const auto destName = cachedDistances_.begin()->first;
+		cachedPathsDel(destName);
+	}
+}
+
+void Conn::alternateHopsFind(const TravelNetworkIndex* index, 
+							 const ShortestPathTree& tree, 
+							 const vector<TravelNetworkIndex::Id>& locations, 
+							 vector<TravelNetworkIndex::Id>& segments, 
+							 vector<double>& lengths) {
+	segments.assign(locations.size(), TravelNetworkIndex::nullId);
+	lengths.assign(locations.size(), unreachableDistance());
+	for (auto i = 0u; i < locations.size(); i++) {
+		const auto locId = locations[i];
+		for (auto arc = index->outArcIter(locId); arc != index->outArcIterEnd(locId); arc++) {
+			if ( (arc->segment == tree.predSegment[locId]) || (tree.minDist[arc->location] == unreachableDistance()) ) {
+				continue;
+			}
+
+			const auto tmp = tree.minDist[arc->location] + arc->length;
+			if (tmp < lengths[i]) {
+				segments[i] = arc->segment;
+				lengths[i] = tmp;
+			}
+		}
+	}
+}
+
+void Conn::alternateHopIs(const string& destName, const string& srcName, const string& segName, const double length) {
+	const auto cacheIt = shortestPathCache_.find(destName);
+	if ( (cacheIt == shortestPathCache_.end()) || (!isKeyPresent(cacheIt->second, srcName)) ) {
+		return;
+	}
+
+	alternateHopDel(destName, srcName);
+
+	AlternateHop hop;
+	hop.primary = cacheIt->second.at(srcName);
+	hop.segment = segName;
+	hop.length = length;
+	shortestPathCacheBytesIs(shortestPathCacheBytes_ + alternateHopBytes(srcName, hop));
+	alternateHops_[destName][srcName] = hop;
+}
+
+void Conn::alternateHopDel(const string& destName, const string& srcName) {
+	const auto it1 = alternateHops_.find(destName);
+	if (it1 == alternateHops_.end()) {
+		return;
+	}
+
+	const auto it2 = it1->second.find(srcName);
+	if (it2 != it1->second.end()) {
+		shortestPathCacheBytesIs(shortestPathCacheBytes_ - alternateHopBytes(srcName, it2->second));
+		it1->second.erase(it2);
+	}
+
+	if (it1->second.empty()) {
+		alternateHops_.erase(it1);
+	}
+}
+
+void Conn::alternateHopsDel(const string& destName) {
+	const auto it = alternateHops_.find(destName);
+	if (it == alternateHops_.end()) {
+		return;
+	}
+
+	for (auto& entry : it->second) {
+		shortestPathCacheBytesIs(shortestPathCacheBytes_ - alternateHopBytes(entry.first, entry.second));
+	}
+
+	alternateHops_.erase(it);
+}
+
+void Conn::alternateHopsDelAll() {
+	while (!alternateHops_.empty()) {
+		alternateHopsDel(alternateHops_.begin()->first);
+	}
+}
+
+void Conn::alternateHopFind(const string& destName, const string& srcName, unordered_map<string, double>& cachedDist) {
+	alternateHopDel(destName, srcName);
+
+	const auto& srcToSeg = shortestPathCache_[destName];
+	const auto loc = travelNetworkManager_->location(srcName);
+	const auto cachedIt = srcToSeg.find(srcName);
+	if ( (loc == null) || (cachedIt == srcToSeg.end()) ) {
+		return;
+	}
+
+	string bestSegName;
+	auto bestLength = unreachableDistance();
+	for (auto it = loc->sourceSegmentIter(); it != loc->sourceSegmentIterEnd(); it++) {
+		const auto seg = *it;
+		const auto next = seg->destination();
+		if ( (next == null) || (seg->name() == cachedIt->second) ) {
+			continue;
+		}
+
+		const auto nextDist = (next->name() == destName) ? 0.0 : 
+							  (isKeyPresent(srcToSeg, next->name())) ? cachedPathLength(srcToSeg, destName, next->name(), cachedDist) : 
+							  unreachableDistance();
+		if ( (nextDist != unreachableDistance()) && (nextDist + seg->length().value() < bestLength) ) {
+			bestSegName = seg->name();
+			bestLength = nextDist + seg->length().value();
+		}
+	}
+
+	if (bestLength != unreachableDistance()) {
+		alternateHopIs(destName, srcName, bestSegName, bestLength);
+	}
+}
+
+U64 Conn::stringHeapBytes(const string& s) {
+	// Short strings live in the string object itself
+	return (s.size() > 15) ? s.size() + 1 : 0;
+}
+
+void Conn::shortestPathCacheEntryIs(const string& destName, const string& srcName, const string& segName) {
+	auto& srcToSeg = shortestPathCacheDestination(destName);
+	const auto it = srcToSeg.find(srcName);
+	if ( (it != srcToSeg.end()) && (it->second != segName) ) {
+		shortestPathCacheEntryDel(destName, srcName);
+	}
+
+	insertIntoShortestPathCache(srcToSeg, destName, srcName, segName);
+}
+
+void Conn::cachedSubtree(const string& destName, const string& srcName, set<string>& subtree) const {
+	if (!subtree.insert(srcName).second) {
+		return;
+	}
+
+	// Walk up the cached tree: an entry whose next hop ends at a location of the subtree belongs to it
+	vector<string> locsToConsiderNext(1, srcName);
+	while (!locsToConsiderNext.empty()) {
+		const auto loc = travelNetworkManager_->location(locsToConsiderNext.back());
+		locsToConsiderNext.pop_back();
+		if (loc == null) {
+			continue;
+		}
+
+		for (auto it = loc->destinationSegmentIter(); it != loc->destinationSegmentIterEnd(); it++) {
+			const auto segIt = shortestPathCacheSegmentIndex_.find((*it)->name());
+			if (segIt == shortestPathCacheSegmentIndex_.end()) {
+				continue;
+			}
+
+			const auto& keys = segIt->second;
+			for (auto keyIt = keys.lower_bound(CacheEntryKey(destName, "")); 
+				 (keyIt != keys.end()) && (keyIt->first == destName); keyIt++) {
+				if (subtree.insert(keyIt->second).second) {
+					locsToConsiderNext.push_back(keyIt->second);
+				}
+			}
+		}
+	}
+}
+
+void Conn::shortestPathCacheSubtreeDel(const string& destName, const string& srcName) {
+	set<string> subtree;
+	cachedSubtree(destName, srcName, subtree);
+
+	const auto it = shortestPathCache_.find(destName);
+	for (auto& name : subtree) {
+		shortestPathCacheStats_->invalidationVisitCountIsIncByOne();
+		if ( (it != shortestPathCache_.end()) && (isKeyPresent(it->second, name)) ) {
+			shortestPathCacheStats_->invalidatedEntryCountIsIncByOne();
+			shortestPathCacheEntryDel(destName, name);
+		}
+	}
+
+	completeCacheDestinations_.erase(destName);
+	alternateHopsDel(destName);
+}
+
+void Conn::shortestPathCacheEntriesDel(CacheEntryIndex& index, const string& name) {
+	const auto it = index.find(name);
+	if (it == index.end()) {
+		return;
+	}
+
+	// Copied since erasing the entries also erases them from the index
+	const auto keys = it->second;
+	for (auto& key : keys) {
+		shortestPathCacheSubtreeDel(key.first, key.second);
+	}
+}
+
+void Conn::onLocationDel(const Ptr<Location>& location) {
+	const auto startTime = std::chrono::steady_clock::now();
+	const auto locName = location->name();
+
+	shortestPathCacheStats_->invalidationCountIsIncByOne();
+
+	// Paths to the location
+	const auto numEntries = shortestPathCacheDestinationDel(locName);
+	for (auto i = 0u; i < numEntries; i++) {
+		shortestPathCacheStats_->invalidationVisitCountIsIncByOne();
+		shortestPathCacheStats_->invalidatedEntryCountIsIncByOne();
+	}
+
+	// Paths from the location, and paths through it
+	shortestPathCacheEntriesDel(shortestPathCacheSourceIndex_, locName);
+	for (auto it = location->destinationSegmentIter(); it != location->destinationSegmentIterEnd(); it++) {
+		shortestPathCacheEntriesDel(shortestPathCacheSegmentIndex_, (*it)->name());
+	}
+
+	queryStats_->invalidationLatencySampleIs(nanosecondsSince(startTime));
+}
+
+void Conn::onSegmentDel(const Ptr<Segment>& segment) {
+	const auto startTime = std::chrono::steady_clock::now();
+	shortestPathCacheStats_->invalidationCountIsIncByOne();
+	if (!shortestPathCacheAlternates_) {
+		shortestPathCacheEntriesDel(shortestPathCacheSegmentIndex_, segment->name());
+	} else {
+		const auto it = shortestPathCacheSegmentIndex_.find(segment->name());
+		if (it != shortestPathCacheSegmentIndex_.end()) {
+			// Complete trees are patched once the segment is unlinked, as for a segment that got longer
+			const auto keys = it->second;
+			auto isPatched = false;
+			for (auto& key : keys) {
+				if (isElemPresentInSet(completeCacheDestinations_, key.first)) {
+					isPatched = true;
+				} else {
+					shortestPathCacheSubtreeDel(key.first, key.second);
+				}
+			}
+
+			if (isPatched) {
+				shortestPathCacheStats_->patchedDeletionCountIsIncByOne();
+			}
+		}
+	}
+
+	queryStats_->invalidationLatencySampleIs(nanosecondsSince(startTime));
+}
+
+void Conn::indexIs(const Ptr<TravelNetworkIndex>& index) {
+	delete indexTracker_;
+	indexTracker_ = IndexTracker::instanceNew(index, this);
+}
+
+void Conn::segmentIsShorter(const Ptr<Segment>& segment) {
+	// Kept paths hold the lengths the segments had when they were built
+	cachedPathsDelAll();
+
+	// An alternate may no longer be the best next hop once any distance gets shorter
+	alternateHopsDelAll();
+
+	// Entries cached later are computed on the network that already has the change
+	if ( (segment != null) && (!shortestPathCache_.empty()) ) {
+		shorterSegments_.insert(segment->name());
+	}
+}
+
+void Conn::segmentIsLonger(const Ptr<Segment>& segment) {
+	cachedPathsDelAll();
+
+	if ( (segment != null) && (!shortestPathCache_.empty()) ) {
+		longerSegments_.insert(segment->name());
+	}
+}
+
+void Conn::repairShortestPathCache() {
+	if ( (shorterSegments_.empty()) && (longerSegments_.empty()) ) {
+		return;
+	}
+
+	// Segments are linked before their length is set, so the changes are only looked at once the network settles
+	const auto shorterSegNames = shorterSegments_;
+	const auto longerSegNames = longerSegments_;
+	shorterSegments_.clear();
+	longerSegments_.clear();
+
+	if (shortestPathCache_.empty()) {
+		return;
+	}
+
+	const auto startTime = std::chrono::steady_clock::now();
+
+	// Longer segments first, so that every cached path left has its current length as an upper bound. 
+	// Their subtrees are all gathered before any repair, since a repair must not go through another one.
+	unordered_map< string, set<string> > affectedByDest;
+	for (auto& segName : longerSegNames) {
+		const auto segIt = shortestPathCacheSegmentIndex_.find(segName);
+		if (segIt == shortestPathCacheSegmentIndex_.end()) {
+			continue;
+		}
+
+		shortestPathCacheStats_->invalidationCountIsIncByOne();
+		for (auto& key : segIt->second) {
+			cachedSubtree(key.first, key.second, affectedByDest[key.first]);
+		}
+	}
+
+	for (auto it = affectedByDest.begin(); it != affectedByDest.end(); it++) {
+		const auto destName = it->first;
+		if (isElemPresentInSet(completeCacheDestinations_, destName)) {
+			repairShortestPathTreeAfterLonger(destName, it->second);
+		} else {
+			for (auto& name : it->second) {
+				shortestPathCacheStats_->invalidationVisitCountIsIncByOne();
+				shortestPathCacheStats_->invalidatedEntryCountIsIncByOne();
+				shortestPathCacheEntryDel(destName, name);
+			}
+		}
+	}
+
+	for (auto& segName : shorterSegNames) {
+		const auto seg = travelNetworkManager_->segment(segName);
+		if ( (seg == null) || (seg->source() == null) || (seg->destination() == null) ) {
+			continue;
+		}
+
+		shortestPathCacheStats_->invalidationCountIsIncByOne();
+
+		// Copied since the repairs may drop a destination from the set
+		const auto completeDestNames = completeCacheDestinations_;
+		for (auto& destName : completeDestNames) {
+			repairShortestPathTreeAfterShorter(destName, seg);
+		}
+
+		if (completeCacheDestinations_.size() < shortestPathCache_.size()) {
+			invalidateShortestPathCacheAfterShorter(seg);
+		}
+	}
+
+	queryStats_->invalidationLatencySampleIs(nanosecondsSince(startTime));
+}
+
+void Conn::repairShortestPathTreeAfterLonger(const string& destName, const set<string>& affected) {
+	typedef std::pair<double, string> HeapEntry;
+	std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > locsToConsiderNext;
+
+	const auto& srcToSeg = shortestPathCache_[destName];
+	unordered_map<string, double> cachedDist;
+	unordered_map<string, double> minDist;
+	unordered_map<string, string> nextSegment;
+
+	const auto alternatesIt = alternateHops_.find(destName);
+	vector<string> alternatesToFind;
+
+	// Length of the path through 'seg' if it leaves the affected subtree, unreachableDistance() otherwise
+	const auto exitLength = [&](const Ptr<Segment>& seg) {
+		const auto next = seg->destination();
+		if ( (next == null) || (isElemPresentInSet(affected, next->name())) ) {
+			return unreachableDistance();
+		}
+
+		const auto nextDist = (next->name() == destName) ? 0.0 : 
+							  (isKeyPresent(srcToSeg, next->name())) ? cachedPathLength(srcToSeg, destName, next->name(), cachedDist) : 
+							  unreachableDistance();
+		if (nextDist == unreachableDistance()) {
+			return unreachableDistance();
+		}
+
+		return nextDist + seg->length().value();
+	};
+
+	const auto exitIs = [&](const string& name, const Ptr<Segment>& seg) {
+		const auto tmp = exitLength(seg);
+		if ( (tmp != unreachableDistance()) && ( (!isKeyPresent(minDist, name)) || (tmp < minDist[name]) ) ) {
+			minDist[name] = tmp;
+			nextSegment[name] = seg->name();
+			locsToConsiderNext.push(HeapEntry(tmp, name));
+		}
+	};
+
+	// Each affected location starts from its best next hop out of the affected subtree
+	for (auto& name : affected) {
+		shortestPathCacheStats_->invalidationVisitCountIsIncByOne();
+
+		const auto loc = travelNetworkManager_->location(name);
+		if (loc == null) {
+			continue;
+		}
+
+		// No distance got shorter since the alternate was found, so if it still leaves the subtree at the same 
+		// length, no segment but the cached next hop can do better, and the others need not be looked at
+		if (alternatesIt != alternateHops_.end()) {
+			const auto hopIt = alternatesIt->second.find(name);
+			const auto cachedIt = srcToSeg.find(name);
+			if ( (hopIt != alternatesIt->second.end()) && (cachedIt != srcToSeg.end()) && (hopIt->second.primary == cachedIt->second) ) {
+				const auto& hop = hopIt->second;
+				const auto alternate = travelNetworkManager_->segment(hop.segment);
+				const auto primary = travelNetworkManager_->segment(hop.primary);
+				if ( (alternate != null) && (alternate->source() == loc) && (exitLength(alternate) <= hop.length) ) {
+					shortestPathCacheStats_->alternateHitCountIsIncByOne();
+					exitIs(name, alternate);
+					if ( (primary != null) && (primary->source() == loc) ) {
+						exitIs(name, primary);
+					}
+
+					continue;
+				}
+			}
+
+			shortestPathCacheStats_->alternateMissCountIsIncByOne();
+		}
+
+		if (shortestPathCacheAlternates_) {
+			alternatesToFind.push_back(name);
+		}
+
+		for (auto it = loc->sourceSegmentIter(); it != loc->sourceSegmentIterEnd(); it++) {
+			exitIs(name, *it);
+		}
+	}
+
+	// Dijkstra's algorithm over destination segments, restricted to the affected subtree
+	set<string> locationsVisited;
+	while (!locsToConsiderNext.empty()) {
+		const auto locDist = locsToConsiderNext.top().first;
+		const auto name = locsToConsiderNext.top().second;
+		locsToConsiderNext.pop();
+
+		if (!locationsVisited.insert(name).second) {
+			continue;
+		}
+
+		if ( (!isKeyPresent(srcToSeg, name)) || (srcToSeg.at(name) != nextSegment[name]) ) {
+			shortestPathCacheStats_->repairedEntryCountIsIncByOne();
+			shortestPathCacheEntryIs(destName, name, nextSegment[name]);
+			if (shortestPathCacheAlternates_) {
+				alternatesToFind.push_back(name);
+			}
+		}
+
+		const auto loc = travelNetworkManager_->location(name);
+		for (auto it = loc->destinationSegmentIter(); it != loc->destinationSegmentIterEnd(); it++) {
+			const auto seg = *it;
+			const auto prev = seg->source();
+			if ( (prev == null) || (!isElemPresentInSet(affected, prev->name())) || 
+				 (isElemPresentInSet(locationsVisited, prev->name())) ) {
+				continue;
+			}
+
+			const auto tmp = locDist + seg->length().value();
+			if ( (!isKeyPresent(minDist, prev->name())) || (tmp < minDist[prev->name()]) ) {
+				minDist[prev->name()] = tmp;
+				nextSegment[prev->name()] = seg->name();
+				locsToConsiderNext.push(HeapEntry(tmp, prev->name()));
+			}
+		}
+	}
+
+	// The tree stays complete: affected locations left over can no longer reach the destination
+	for (auto& name : affected) {
+		if (!isElemPresentInSet(locationsVisited, name)) {
+			shortestPathCacheStats_->invalidatedEntryCountIsIncByOne();
+			shortestPathCacheEntryDel(destName, name);
+		}
+	}
+
+	// Alternates of the locations given a new next hop, or whose alternate was out of date, from the repaired tree
+	unordered_map<string, double> repairedDist;
+	for (auto& name : alternatesToFind) {
+		alternateHopFind(destName, name, repairedDist);
+	}
+}
+
+void Conn::repairShortestPathTreeAfterShorter(const string& destName, const Ptr<Segment>& segment) {
+	typedef std::pair<double, string> HeapEntry;
+	std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > locsToConsiderNext;
+
+	const auto& srcToSeg = shortestPathCache_[destName];
+	const auto srcName = segment->source()->name();
+	const auto dstName = segment->destination()->name();
+	if (srcName == destName) {
+		return;
+	}
+
+	// Cached lengths are upper bounds on the current distances, and the missing locations cannot reach the destination
+	unordered_map<string, double> cachedDist;
+	unordered_map<string, double> minDist;
+	unordered_map<string, string> nextSegment;
+	auto currDist = [&](const string& name) {
+		if (isKeyPresent(minDist, name)) {
+			return minDist[name];
+		}
+
+		return (isKeyPresent(srcToSeg, name)) ? cachedPathLength(srcToSeg, destName, name, cachedDist) : unreachableDistance();
+	};
+
+	const auto srcIt = srcToSeg.find(srcName);
+	if ( (srcIt != srcToSeg.end()) && (srcIt->second == segment->name()) ) {
+		// The whole subtree that already goes through the segment got closer, and its neighbors may follow
+		set<string> subtree;
+		cachedSubtree(destName, srcName, subtree);
+		for (auto& name : subtree) {
+			const auto dist = currDist(name);
+			if (dist != unreachableDistance()) {
+				minDist[name] = dist;
+				nextSegment[name] = srcToSeg.at(name);
+				locsToConsiderNext.push(HeapEntry(dist, name));
+			}
+		}
+	} else {
+		const auto dstDist = (dstName == destName) ? 0.0 : currDist(dstName);
+		if (dstDist == unreachableDistance()) {
+			return;
+		}
+
+		const auto tmp = dstDist + segment->length().value();
+		if (tmp >= currDist(srcName)) {
+			return;
+		}
+
+		minDist[srcName] = tmp;
+		nextSegment[srcName] = segment->name();
+		locsToConsiderNext.push(HeapEntry(tmp, srcName));
+	}
+
+	// Dijkstra's algorithm over destination segments, from the locations the segment brings closer
+	while (!locsToConsiderNext.empty()) {
+		const auto locDist = locsToConsiderNext.top().first;
+		const auto name = locsToConsiderNext.top().second;
+		locsToConsiderNext.pop();
+
+		if (locDist > minDist[name]) {
+			continue;
+		}
+
+		if ( (!isKeyPresent(srcToSeg, name)) || (srcToSeg.at(name) != nextSegment[name]) ) {
+			shortestPathCacheStats_->repairedEntryCountIsIncByOne();
+			shortestPathCacheEntryIs(destName, name, nextSegment[name]);
+		}
+
+		const auto loc = travelNetworkManager_->location(name);
+		for (auto it = loc->destinationSegmentIter(); it != loc->destinationSegmentIterEnd(); it++) {
+			const auto seg = *it;
+			const auto prev = seg->source();
+			if ( (prev == null) || (prev->name() == destName) ) {
+				continue;
+			}
+
+			const auto prevDist = locDist + seg->length().value();
+			if (prevDist < currDist(prev->name())) {
+				minDist[prev->name()] = prevDist;
+				nextSegment[prev->name()] = seg->name();
+				locsToConsiderNext.push(HeapEntry(prevDist, prev->name()));
+			}
+		}
+	}
+}
+
+void Conn::invalidateShortestPathCacheAfterShorter(const Ptr<Segment>& segment) {
+	const auto index = travelNetworkManager_->index();
+	const auto arcSourceId = index->locationId(segment->source());
+	const auto arcDestinationId = index->locationId(segment->destination());
+	const auto arcLength = segment->length().value();
+
+	// An entry from S to D is stale if d(S, source) + length + d(destination, D) is below its cached length
+	ShortestPathTree toSource;
+	ShortestPathTree fromDestination;
+	toSource.rootIs(index, arcSourceId, ShortestPathTree::backward);
+	fromDestination.rootIs(index, arcDestinationId, ShortestPathTree::forward);
+
+	vector<CacheEntryKey> staleEntries;
+
+	for (auto it1 = shortestPathCache_.begin(); it1 != shortestPathCache_.end(); it1++) {
+		const auto destName = it1->first;
+		if (isElemPresentInSet(completeCacheDestinations_, destName)) {
+			continue;
+		}
+
+		const auto destId = index->locationId(travelNetworkManager_->location(destName));
+		if ( (destId == TravelNetworkIndex::nullId) || (fromDestination.minDist[destId] == unreachableDistance()) ) {
+			continue;
+		}
+
+		const auto& srcToSeg = it1->second;
+		const auto distViaArc = arcLength + fromDestination.minDist[destId];
+		unordered_map<string, double> cachedDist;
+
+		for (auto it2 = srcToSeg.begin(); it2 != srcToSeg.end(); it2++) {
+			shortestPathCacheStats_->invalidationVisitCountIsIncByOne();
+
+			const auto srcId = index->locationId(travelNetworkManager_->location(it2->first));
+			if ( (srcId == TravelNetworkIndex::nullId) || (toSource.minDist[srcId] == unreachableDistance()) ) {
+				continue;
+			}
+
+			if (toSource.minDist[srcId] + distViaArc < cachedPathLength(srcToSeg, destName, it2->first, cachedDist)) {
+				staleEntries.push_back(CacheEntryKey(destName, it2->first));
+			}
+		}
+	}
+
+	for (auto& key : staleEntries) {
+		shortestPathCacheStats_->invalidatedEntryCountIsIncByOne();
+		shortestPathCacheEntryDel(key.first, key.second);
+	}
+}
+
+double Conn::cachedPathLength(const LocToSeg& srcToSeg, 
+							  const string& destName, 
+							  const string& srcName, 
+							  unordered_map<string, double>& cachedDist) const {
+	// Follow the next hops until the destination or a location whose length is already known
+	vector< std::pair<string, double> > chain;
+	auto currLocName = srcName;
+	auto length = 0.0;
+
+	while ( (currLocName != destName) && (!isKeyPresent(cachedDist, currLocName)) ) {
+		const auto it = srcToSeg.find(currLocName);
+		const auto seg = (it != srcToSeg.end()) ? travelNetworkManager_->segment(it->second) : null;
+		if ( (seg == null) || (seg->source() == null) || (seg->source()->name() != currLocName) || 
+			 (seg->destination() == null) || (chain.size() > srcToSeg.size()) ) {
+			length = unreachableDistance();
+			break;
+		}
+
+		chain.push_back(std::make_pair(currLocName, seg->length().value()));
+		currLocName = seg->destination()->name();
+	}
+
+	if (length != unreachableDistance()) {
+		length = (currLocName == destName) ? 0.0 : cachedDist[currLocName];
+	}
+
+	for (auto it = chain.rbegin(); it != chain.rend(); it++) {
+		if (length != unreachableDistance()) {
+			length += it->second;
+		}
+
+		cachedDist[it->first] = length;
+	}
+
+	return cachedDist[srcName];
+}
+
+std::shared_ptr<const TravelNetworkSnapshot> Conn::snapshotNew() {
+	const auto snapshot = TravelNetworkSnapshot::instanceNew(travelNetworkManager_->index(), snapshotTreeCapacity_);
+	std::atomic_store(&snapshot_, snapshot);
+	return snapshot;
+}
+
+bool Conn::isSnapshotStale() {
+	const auto snapshot = std::atomic_load(&snapshot_);
+	return (snapshot == nullptr) || (snapshot->version() != travelNetworkManager_->index()->version());
+}
+
+U64 Conn::topologyHash() {
+	// Sorted, since the manager keeps its locations and segments in hash maps
+	vector<string> locNames;
+	for (auto it = travelNetworkManager_->locationIter(); it != travelNetworkManager_->locationIterEnd(); it++) {
+		locNames.push_back(it->first);
+	}
+
+	vector< std::pair<string, const Segment*> > segs;
+	for (auto it = travelNetworkManager_->segmentIter(); it != travelNetworkManager_->segmentIterEnd(); it++) {
+		segs.push_back(std::make_pair(it->first, it->second.ptr()));
+	}
+
+	std::sort(locNames.begin(), locNames.end());
+	std::sort(segs.begin(), segs.end());
+
+	// 64-bit FNV-1a, which unlike std::hash is the same on every platform and run
+	U64 hash = 14695981039346656037ULL;
+	const auto hashIs = [&hash](const void* data, const size_t size) {
+		const auto bytes = static_cast<const unsigned char*>(data);
+		for (auto i = 0u; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 1099511628211ULL;
+		}
+	};
+
+	// Names are hashed with their terminating null, so that consecutive names cannot run into each other
+	for (auto& name : locNames) {
+		hashIs(name.c_str(), name.size() + 1);
+	}
+
+	for (auto& seg : segs) {
+		const auto source = seg.second->source();
+		const auto destination = seg.second->destination();
+		const auto length = seg.second->length().value();
+		hashIs(seg.first.c_str(), seg.first.size() + 1);
+		hashIs((source != null) ? source->name().c_str() : "", (source != null) ? source->name().size() + 1 : 1);
+		hashIs((destination != null) ? destination->name().c_str() : "", (destination != null) ? destination->name().size() + 1 : 1);
+		hashIs(&length, sizeof(length));
+	}
+
+	return hash;
+}
+
+const U32 Conn::shortestPathCacheFileMagic;
+const U32 Conn::shortestPathCacheFileVersion;
+
+bool Conn::shortestPathCacheSave(const string& fileName) {
+	repairShortestPathCache();
+
+	std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+	if (!file) {
+		return false;
+	}
+
+	// Names are written once, and entries refer to them by their position
+	vector<string> names;
+	unordered_map<string, U32> nameIds;
+	const auto nameId = [&names, &nameIds](const string& name) {
+		const auto it = nameIds.find(name);
+		if (it != nameIds.end()) {
+			return it->second;
+		}
+
+		nameIds[name] = names.size();
+		names.push_back(name);
+		return static_cast<U32>(names.size() - 1);
+	};
+
+	// Destinations least recently used first, as in the cache, so that a budget evicts the same ones after a load
+	vector<U32> entries;
+	for (auto& destName : cacheDestinationOrder_) {
+		const auto& srcToSeg = shortestPathCache_.at(destName);
+		entries.push_back(nameId(destName));
+		entries.push_back(isElemPresentInSet(completeCacheDestinations_, destName) ? 1 : 0);
+		entries.push_back(srcToSeg.size());
+		for (auto& entry : srcToSeg) {
+			entries.push_back(nameId(entry.first));
+			entries.push_back(nameId(entry.second));
+		}
+	}
+
+	fileValueIs(file, shortestPathCacheFileMagic);
+	fileValueIs(file, shortestPathCacheFileVersion);
+	fileValueIs(file, topologyHash());
+
+	fileValueIs(file, static_cast<U32>(names.size()));
+	for (auto& name : names) {
+		fileValueIs(file, static_cast<U32>(name.size()));
+		file.write(name.data(), name.size());
+	}
+
+	fileValueIs(file, static_cast<U32>(cacheDestinationOrder_.size()));
+	file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(U32));
+
+	return static_cast<bool>(file.flush());
+}
+
+bool Conn::shortestPathCacheLoad(const string& fileName) {
+	std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+	if (!file) {
+		return false;
+	}
+
+	// Bounds the sizes read from the file, so that a damaged one cannot ask for more memory than it holds
+	const auto fileSize = static_cast<U64>(file.tellg());
+	file.seekg(0);
+
+	U32 magic = 0;
+	U32 version = 0;
+	U64 hash = 0;
+	if ( (!fileValue(file, magic)) || (magic != shortestPathCacheFileMagic) || 
+		 (!fileValue(file, version)) || (version != shortestPathCacheFileVersion) ) {
+		logError(WARNING, "'" + fileName + "' is not a shortest path cache file. Skipping it.");
+		return false;
+	}
+
+	if ( (!fileValue(file, hash)) || (hash != topologyHash()) ) {
+		return false;
+	}
+
+	// Read in full before the cache is touched, so that a damaged file leaves it as it was
+	struct LoadedDestination {
+		U32 name;
+		bool isComplete;
+		vector< std::pair<U32, U32> > entries;
+	};
+
+	U32 numNames = 0;
+	auto isValid = fileValue(file, numNames);
+	vector<string> names;
+	for (auto i = 0u; (isValid) && (i < numNames); i++) {
+		U32 size = 0;
+		isValid = (fileValue(file, size)) && (size <= fileSize);
+		string name(isValid ? size : 0, '\0');
+		isValid = (isValid) && (file.read(&name[0], size));
+		names.push_back(name);
+	}
+
+	U32 numDests = 0;
+	isValid = (isValid) && (fileValue(file, numDests));
+	vector<LoadedDestination> dests;
+	for (auto i = 0u; (isValid) && (i < numDests); i++) {
+		LoadedDestination dest;
+		U32 isComplete = 0;
+		U32 numEntries = 0;
+		isValid = (fileValue(file, dest.name)) && (fileValue(file, isComplete)) && (fileValue(file, numEntries)) && (dest.name < numNames);
+		dest.isComplete = (isComplete != 0);
+		for (auto j = 0u; (isValid) && (j < numEntries); j++) {
+			std::pair<U32, U32> entry;
+			isValid = (fileValue(file, entry.first)) && (fileValue(file, entry.second)) && 
+					  (entry.first < numNames) && (entry.second < numNames);
+
+			// Same network, so every next hop is still a segment leaving its location
+			const auto seg = isValid ? travelNetworkManager_->segment(names[entry.second]) : null;
+			isValid = (seg != null) && (seg->source() != null) && (seg->source()->name() == names[entry.first]);
+			dest.entries.push_back(entry);
+		}
+
+		dests.push_back(std::move(dest));
+	}
+
+	if (!isValid) {
+		logError(WARNING, "Shortest path cache file '" + fileName + "' is damaged. Skipping it.");
+		return false;
+	}
+
+	pathCacheIsEmpty();
+	for (auto& dest : dests) {
+		const auto& destName = names[dest.name];
+		shortestPathCacheDestination(destName);
+		for (auto& entry : dest.entries) {
+			shortestPathCacheEntryIs(destName, names[entry.first], names[entry.second]);
+		}
+
+		if (dest.isComplete) {
+			completeCacheDestinations_.insert(destName);
+			if (shortestPathCacheAlternates_) {
+				unordered_map<string, double> cachedDist;
+				for (auto& entry : dest.entries) {
+					alternateHopFind(destName, names[entry.first], cachedDist);
+				}
+			}
+		}
+	}
+
+	// Loaded destinations are not new to the cache: they were admitted by the run that wrote them
+	newCacheDestinations_.clear();
+	evictFromShortestPathCache();
+
+	return true;
+}
+
+string Conn::statsJson() const {
+	const auto quoted = [](const string& str) {
+		std::ostringstream out;
+		out << '"';
+		for (auto c : str) {
+			if ( (c == '"') || (c == '\\') ) {
+				out << '\\' << c;
+			} else if (static_cast<unsigned char>(c) < 0x20) {
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+			} else {
+				out << c;
+			}
+		}
+
+		out << '"';
+		return out.str();
+	};
+
+	const auto histogram = [](const Histogram& h) {
+		std::ostringstream out;
+		out << "{\"count\":" << h.sampleCount() << ",\"sum\":" << h.sum() << ",\"min\":" << h.min() 
+			<< ",\"max\":" << h.max() << ",\"mean\":" << h.mean() << ",\"p50\":" << h.percentile(0.5) 
+			<< ",\"p90\":" << h.percentile(0.9) << ",\"p99\":" << h.percentile(0.99) << "}";
+		return out.str();
+	};
+
+	const auto& cache = shortestPathCacheStats_;
+	std::ostringstream out;
+	out << "{\"conn\":" << quoted(name()) 
+		<< ",\"cache\":{\"requests\":" << cache->requestCount() << ",\"hits\":" << cache->hitCount() 
+		<< ",\"misses\":" << cache->missCount() << ",\"residentBytes\":" << cache->residentBytes() 
+		<< ",\"invalidations\":" << cache->invalidationCount() << ",\"invalidationVisits\":" << cache->invalidationVisitCount() 
+		<< ",\"invalidatedEntries\":" << cache->invalidatedEntryCount() << ",\"repairedEntries\":" << cache->repairedEntryCount() 
+		<< ",\"patchedDeletions\":" << cache->patchedDeletionCount() << ",\"alternateHits\":" << cache->alternateHitCount() 
+		<< ",\"alternateMisses\":" << cache->alternateMissCount() << ",\"evictions\":" << cache->evictionCount() 
+		<< ",\"evictedEntries\":" << cache->evictedEntryCount() << ",\"admissionRejects\":" << cache->admissionRejectCount() << "}" 
+		<< ",\"cachedLatencyNs\":" << histogram(queryStats_->cachedLatency()) 
+		<< ",\"uncachedLatencyNs\":" << histogram(queryStats_->uncachedLatency()) 
+		<< ",\"settledLocations\":" << histogram(queryStats_->settledCount()) 
+		<< ",\"relaxedArcs\":" << histogram(queryStats_->relaxedCount()) 
+		<< ",\"invalidationLatencyNs\":" << histogram(queryStats_->invalidationLatency());
+
+	// By name, so that runs can be compared line by line
+	std::map<string, QueryStats::DestinationCounts> destinations(queryStats_->destinationIter(), queryStats_->destinationIterEnd());
+	out << ",\"destinations\":[";
+	for (auto it = destinations.begin(); it != destinations.end(); it++) {
+		out << ( (it == destinations.begin()) ? "" : "," ) 
+			<< "{\"name\":" << quoted(it->first) << ",\"requests\":" << it->second.requestCount 
+			<< ",\"hits\":" << it->second.hitCount << "}";
+	}
+
+	out << "]}";
+	return out.str();
 }
 
 void Conn::pathCacheIsEmpty() {
+	shorterSegments_.clear();
+	longerSegments_.clear();
 	shortestPathCache_.clear();
+	completeCacheDestinations_.clear();
+	shortestPathCacheSegmentIndex_.clear();
+	shortestPathCacheSourceIndex_.clear();
+	cachedPaths_.clear();
+	cachedDistances_.clear();
+	policyCaches_.clear();
+	policyTreeOrder_.clear();
+	alternateHops_.clear();
+	cacheDestinationOrder_.clear();
+	cacheDestinations_.clear();
+	clockHand_ = cacheDestinationOrder_.end();
+	newCacheDestinations_.clear();
+	shortestPathCacheBytesIs(0);
 }
 
-bool Conn::isLocationPartOfTravelNetwork(const Ptr<Location>& loc) {
+bool Conn::isLocationPartOfTravelNetwork(const Ptr<Location>& loc) const {
 	if (loc != null) {
 		const auto locInNetwork = travelNetworkManager_->location(loc->name());
 		if (loc == locInNetwork) {
@@ -0,0 +1,642 @@
+#ifndef CONTRACTION_HIERARCHY_H
+#define CONTRACTION_HIERARCHY_H
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "CommonLib.h"
+#include "ShortestPathTree.h"
+#include "TravelNetworkIndex.h"
+
+using fwk::Ptr;
+using fwk::PtrInterface;
+
+using std::vector;
+
+//=======================================================
+// ContractionHierarchy class
+//
+//   Contraction hierarchy (CH) of a snapshot of the travel
+//   network, for fast point-to-point queries on networks
+//   that no longer change.
+//
+//   Locations are contracted one at a time, least important
+//   first (edge difference + contracted neighbours). When a
+//   location is contracted, a shortcut u -> w is added for
+//   every u -> v -> w that a bounded witness search cannot
+//   match without v. The rank of a location is its position
+//   in that order.
+//
+//   Contraction stops when even the cheapest location left
+//   is too densely connected; the locations left form the
+//   core and are ranked above all others.
+//
+//   A query is a bidirectional Dijkstra that only moves up
+//   the ranks, from the source over out edges and from the
+//   destination over in edges, and moves freely inside the
+//   core. Shortcuts of the resulting path are unpacked back
+//   into segments.
+//
+//   The hierarchy is not maintained: any arc change in the
+//   index marks it as stale, and it should then be dropped.
+//=======================================================
+
+class ContractionHierarchy : public PtrInterface {
+public:
+
+	typedef TravelNetworkIndex::Id Id;
+
+	/* Contracts the current network of 'index' */
+	static Ptr<ContractionHierarchy> instanceNew(const Ptr<TravelNetworkIndex>& index) {
+		return new ContractionHierarchy(index);
+	}
+
+	/* True once the network has changed since the hierarchy was built */
+	bool isStale() const {
+		return isStale_;
+	}
+
+	/* Upper bound (exclusive) on the location ids known to the hierarchy */
+	Id locationIdCount() const {
+		return rank_.size();
+	}
+
+	bool isLocationContracted(const Id location) const {
+		return (location < rank_.size()) && (rank_[location] != TravelNetworkIndex::nullId);
+	}
+
+	unsigned int edgeCount() const {
+		return edges_.size();
+	}
+
+	unsigned int shortcutCount() const {
+		return shortcutCount_;
+	}
+
+	/* Number of locations left uncontracted (see coreDegreeProductLimit) */
+	unsigned int coreLocationCount() const {
+		return coreLocationCount_;
+	}
+
+	/* Number of locations the last shortestPath() settled, in both directions */
+	U64 settledCount() const {
+		return settledCount_;
+	}
+
+	/* Number of upward edges the last shortestPath() relaxed */
+	U64 relaxedCount() const {
+		return relaxedCount_;
+	}
+
+	/* Length of the shortest path from 'source' to 'destination', with the ids of its segments appended to
+	   'segments' in order. ShortestPathTree::unreachableDistance() if there is no such path. */
+	double shortestPath(const Id source, const Id destination, vector<Id>& segments) const {
+		const auto unreachable = ShortestPathTree::unreachableDistance();
+		settledCount_ = 0;
+		relaxedCount_ = 0;
+		if ( (!isLocationContracted(source)) || (!isLocationContracted(destination)) ) {
+			return unreachable;
+		}
+
+		if (source == destination) {
+			return 0;
+		}
+
+		Heap forwardHeap;
+		Heap backwardHeap;
+
+		forwardSearch_.distIs(source, 0, nullEdge);
+		backwardSearch_.distIs(destination, 0, nullEdge);
+		forwardHeap.push(HeapEntry(0, source));
+		backwardHeap.push(HeapEntry(0, destination));
+
+		auto minPathLength = unreachable;
+		auto meetingLocId = TravelNetworkIndex::nullId;
+
+		while ( (!forwardHeap.empty()) || (!backwardHeap.empty()) ) {
+			const auto topF = forwardHeap.empty() ? unreachable : forwardHeap.top().first;
+			const auto topB = backwardHeap.empty() ? unreachable : backwardHeap.top().first;
+
+			// Neither search can reach an unsettled location on a shorter path. Without a 
+			// hierarchy this is a plain bidirectional Dijkstra, which can stop earlier.
+			if ( (std::min(topF, topB) >= minPathLength) || 
+				 ( (coreLocationCount_ == locationCount_) && (topF + topB >= minPathLength) ) ) {
+				break;
+			}
+
+			const bool isForward = (topF <= topB);
+			auto& heap = isForward ? forwardHeap : backwardHeap;
+			auto& search = isForward ? forwardSearch_ : backwardSearch_;
+			const auto& otherSearch = isForward ? backwardSearch_ : forwardSearch_;
+			const auto& upEdgeOffsets = isForward ? upOutEdgeOffsets_ : upInEdgeOffsets_;
+			const auto& upEdges = isForward ? upOutEdges_ : upInEdges_;
+
+			const auto locDist = heap.top().first;
+			const auto locId = heap.top().second;
+			heap.pop();
+
+			if (locDist > search.dist(locId)) {
+				continue;
+			}
+
+			settledCount_++;
+			relaxedCount_ += upEdgeOffsets[locId + 1] - upEdgeOffsets[locId];
+
+			if (locDist + otherSearch.dist(locId) < minPathLength) {
+				minPathLength = locDist + otherSearch.dist(locId);
+				meetingLocId = locId;
+			}
+
+			for (auto i = upEdgeOffsets[locId]; i < upEdgeOffsets[locId + 1]; i++) {
+				const auto& edge = edges_[upEdges[i]];
+				const auto nextId = isForward ? edge.to : edge.from;
+				const auto tmp = locDist + edge.length;
+				if (tmp < search.dist(nextId)) {
+					search.distIs(nextId, tmp, upEdges[i]);
+					heap.push(HeapEntry(tmp, nextId));
+				}
+			}
+		}
+
+		if (meetingLocId != TravelNetworkIndex::nullId) {
+			vector<U32> pathEdges;
+			for (auto id = meetingLocId; forwardSearch_.predEdge(id) != nullEdge; id = edges_[forwardSearch_.predEdge(id)].from) {
+				pathEdges.push_back(forwardSearch_.predEdge(id));
+			}
+
+			std::reverse(pathEdges.begin(), pathEdges.end());
+
+			for (auto id = meetingLocId; backwardSearch_.predEdge(id) != nullEdge; id = edges_[backwardSearch_.predEdge(id)].to) {
+				pathEdges.push_back(backwardSearch_.predEdge(id));
+			}
+
+			for (auto e : pathEdges) {
+				unpack(e, segments);
+			}
+		}
+
+		forwardSearch_.isClearedIs();
+		backwardSearch_.isClearedIs();
+
+		return minPathLength;
+	}
+
+	ContractionHierarchy(const ContractionHierarchy&) = delete;
+
+	void operator =(const ContractionHierarchy&) = delete;
+	void operator ==(const ContractionHierarchy&) = delete;
+
+protected:
+
+	//=======================================================
+	// IndexTracker class
+	//    Marks the hierarchy as stale on the first change to
+	//    the network.
+	//=======================================================
+
+	class IndexTracker : public TravelNetworkIndex::Notifiee {
+	public:
+
+		static IndexTracker* instanceNew(const Ptr<TravelNetworkIndex>& index, ContractionHierarchy* hierarchy) {
+			const auto tracker = new IndexTracker(hierarchy);
+			tracker->notifierIs(index);
+			return tracker;
+		}
+
+		void onArcNew(const TravelNetworkIndex::ArcChange& arc) {
+			hierarchy_->isStale_ = true;
+		}
+
+		void onArcDel(const TravelNetworkIndex::ArcChange& arc) {
+			hierarchy_->isStale_ = true;
+		}
+
+		void onArcLength(const TravelNetworkIndex::ArcChange& arc) {
+			hierarchy_->isStale_ = true;
+		}
+
+		void onLocationDel(const Id location) {
+			hierarchy_->isStale_ = true;
+		}
+
+	protected:
+
+		explicit IndexTracker(ContractionHierarchy* hierarchy) :
+			hierarchy_(hierarchy)
+		{
+			// Nothing else to do
+		}
+
+	private:
+
+		// Not a Ptr since the hierarchy owns its tracker
+		ContractionHierarchy* hierarchy_;
+	};
+
+	explicit ContractionHierarchy(const Ptr<TravelNetworkIndex>& index) :
+		shortcutCount_(0),
+		locationCount_(0),
+		coreLocationCount_(0),
+		settledCount_(0),
+		relaxedCount_(0),
+		isStale_(false)
+	{
+		if (index->isStale()) {
+			index->isStaleIs(false);
+		}
+
+		contract(index);
+		tracker_ = IndexTracker::instanceNew(index, this);
+	}
+
+	~ContractionHierarchy() {
+		delete tracker_;
+	}
+
+private:
+
+	typedef std::pair<double, Id> HeapEntry;
+	typedef std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > Heap;
+
+	static constexpr U32 nullEdge = std::numeric_limits<U32>::max();
+
+	/* Bounds on the locations settled by one witness search, when estimating a priority and when contracting. 
+	   Missing a witness only costs an extra shortcut. */
+	static constexpr unsigned int simulationWitnessSettleLimit = 30;
+	static constexpr unsigned int witnessSettleLimit = 100;
+
+	/* Contraction stops once the next location has more (in, out) neighbour pairs than this. The locations left 
+	   form the core, whose edges are searched in both directions as in a plain bidirectional Dijkstra. */
+	static constexpr unsigned int coreDegreeProductLimit = 400;
+	static constexpr int corePriority = std::numeric_limits<int>::max();
+
+	/* A segment of the network (segment != nullId) or a shortcut over the edges 'first' and 'second' */
+	struct Edge {
+		Id from;
+		Id to;
+		double length;
+		Id segment;
+		U32 first;
+		U32 second;
+	};
+
+	/* Distances of one search, reset by only visiting the locations it touched */
+	class SearchSpace {
+	public:
+
+		double dist(const Id id) const {
+			return dist_[id];
+		}
+
+		U32 predEdge(const Id id) const {
+			return predEdge_[id];
+		}
+
+		void distIs(const Id id, const double d, const U32 edge) {
+			if (dist_[id] == ShortestPathTree::unreachableDistance()) {
+				touched_.push_back(id);
+			}
+
+			dist_[id] = d;
+			predEdge_[id] = edge;
+		}
+
+		void isClearedIs() {
+			for (auto id : touched_) {
+				dist_[id] = ShortestPathTree::unreachableDistance();
+				predEdge_[id] = nullEdge;
+			}
+
+			touched_.clear();
+		}
+
+		void locationIdCountIs(const Id n) {
+			dist_.assign(n, ShortestPathTree::unreachableDistance());
+			predEdge_.assign(n, nullEdge);
+			touched_.clear();
+		}
+
+	private:
+
+		vector<double> dist_;
+		vector<U32> predEdge_;
+		vector<Id> touched_;
+	};
+
+	/* The cheapest edge between a location and one of its neighbours */
+	struct Neighbour {
+		Id location;
+		double length;
+		U32 edge;
+
+		bool operator <(const Neighbour& n) const {
+			return (location < n.location) || ( (location == n.location) && (length < n.length) );
+		}
+	};
+
+	U32 edgeNew(const Id from, const Id to, const double length, const Id segment, const U32 first, const U32 second) {
+		edges_.push_back(Edge { from, to, length, segment, first, second });
+		outEdges_[from].push_back(edges_.size() - 1);
+		inEdges_[to].push_back(edges_.size() - 1);
+		return edges_.size() - 1;
+	}
+
+	/* Cheapest edge to or from every neighbour of 'v' that is not contracted yet */
+	vector<Neighbour> neighbours(const Id v, const bool isOut) const {
+		vector<Neighbour> result;
+		for (auto e : (isOut ? outEdges_[v] : inEdges_[v])) {
+			const auto other = isOut ? edges_[e].to : edges_[e].from;
+			if ( (other != v) && (rank_[other] == TravelNetworkIndex::nullId) ) {
+				result.push_back(Neighbour { other, edges_[e].length, e });
+			}
+		}
+
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end(),
+								 [](const Neighbour& a, const Neighbour& b) { return a.location == b.location; }),
+					 result.end());
+		return result;
+	}
+
+	/* Dijkstra from 'source' over the locations that are not contracted yet, skipping 'v'. 
+	   Stops once the 'targetCount' locations marked in isWitnessTarget_ are settled. */
+	void witnessSearch(const Id source, const Id v, const double maxDist, unsigned int targetCount, const unsigned int settleLimit) {
+		Heap heap;
+		witnessSearch_.distIs(source, 0, nullEdge);
+		heap.push(HeapEntry(0, source));
+
+		auto settledCount = 0u;
+		while ( (!heap.empty()) && (settledCount < settleLimit) && (targetCount > 0) ) {
+			const auto locDist = heap.top().first;
+			const auto locId = heap.top().second;
+			heap.pop();
+
+			if (locDist > witnessSearch_.dist(locId)) {
+				continue;
+			}
+
+			if (locDist > maxDist) {
+				break;
+			}
+
+			settledCount++;
+			if (isWitnessTarget_[locId]) {
+				targetCount--;
+			}
+
+			for (auto e : outEdges_[locId]) {
+				const auto nextId = edges_[e].to;
+				const auto tmp = locDist + edges_[e].length;
+				if ( (nextId != v) && (rank_[nextId] == TravelNetworkIndex::nullId) && (tmp < witnessSearch_.dist(nextId)) ) {
+					witnessSearch_.distIs(nextId, tmp, e);
+					heap.push(HeapEntry(tmp, nextId));
+				}
+			}
+		}
+	}
+
+	/* Adds the shortcuts that contracting 'v' requires (only counts them if 'isSimulation').
+	   Returns the edge difference of the contraction. */
+	int contraction(const Id v, const bool isSimulation) {
+		const auto ins = neighbours(v, false);
+		const auto outs = neighbours(v, true);
+		int shortcuts = 0;
+
+		if (outs.empty()) {
+			return -((int) ins.size());
+		}
+
+		auto maxOut = 0.0;
+		for (const auto& out : outs) {
+			maxOut = std::max(maxOut, out.length);
+			isWitnessTarget_[out.location] = true;
+		}
+
+		for (const auto& in : ins) {
+			witnessSearch(in.location, v, in.length + maxOut, outs.size(), 
+						  isSimulation ? simulationWitnessSettleLimit : witnessSettleLimit);
+
+			for (const auto& out : outs) {
+				const auto viaLength = in.length + out.length;
+				if ( (out.location != in.location) && (witnessSearch_.dist(out.location) > viaLength) ) {
+					shortcuts++;
+					if (!isSimulation) {
+						edgeNew(in.location, out.location, viaLength, TravelNetworkIndex::nullId, in.edge, out.edge);
+						shortcutCount_++;
+					}
+				}
+			}
+
+			witnessSearch_.isClearedIs();
+		}
+
+		for (const auto& out : outs) {
+			isWitnessTarget_[out.location] = false;
+		}
+
+		return shortcuts - ((int) (ins.size() + outs.size()));
+	}
+
+	void edgesToContractedDel(vector<U32>& edges, const bool isOut) {
+		edges.erase(std::remove_if(edges.begin(), edges.end(), [this, isOut](const U32 e) {
+			return rank_[isOut ? edges_[e].to : edges_[e].from] != TravelNetworkIndex::nullId;
+		}), edges.end());
+	}
+
+	/* Edge difference of contracting 'v' plus its contracted neighbours, or corePriority if 'v' should be left in the core */
+	int priority(const Id v, const int contractedNeighbourCount) {
+		if (neighbours(v, false).size() * neighbours(v, true).size() > coreDegreeProductLimit) {
+			return corePriority;
+		}
+
+		return contraction(v, true) + contractedNeighbourCount;
+	}
+
+	void contract(const Ptr<TravelNetworkIndex>& index) {
+		const auto numLocations = index->locationIdCount();
+
+		rank_.assign(numLocations, TravelNetworkIndex::nullId);
+		outEdges_.assign(numLocations, vector<U32>());
+		inEdges_.assign(numLocations, vector<U32>());
+		witnessSearch_.locationIdCountIs(numLocations);
+		isWitnessTarget_.assign(numLocations, false);
+		forwardSearch_.locationIdCountIs(numLocations);
+		backwardSearch_.locationIdCountIs(numLocations);
+
+		// Parallel segments are merged into the shortest one and loops are dropped
+		vector<U32> edgeTo(numLocations, nullEdge);
+		for (auto id = 0u; id < numLocations; id++) {
+			for (auto arc = index->outArcIter(id); arc != index->outArcIterEnd(id); arc++) {
+				if (arc->location == id) {
+					continue;
+				}
+
+				const auto e = edgeTo[arc->location];
+				if ( (e != nullEdge) && (edges_[e].from == id) ) {
+					if (arc->length < edges_[e].length) {
+						edges_[e].length = arc->length;
+						edges_[e].segment = arc->segment;
+					}
+				} else {
+					edgeTo[arc->location] = edgeNew(id, arc->location, arc->length, arc->segment, nullEdge, nullEdge);
+				}
+			}
+		}
+
+		// Contract with lazy updates: a location is contracted only if its refreshed priority is still the lowest
+		vector<int> contractedNeighbourCount(numLocations, 0);
+		std::priority_queue< std::pair<int, Id>, vector< std::pair<int, Id> >, std::greater< std::pair<int, Id> > > queue;
+		for (auto id = 0u; id < numLocations; id++) {
+			if (index->location(id) != null) {
+				locationCount_++;
+				queue.push(std::make_pair(priority(id, contractedNeighbourCount[id]), id));
+			}
+		}
+
+		Id nextRank = 0;
+		while (!queue.empty()) {
+			const auto v = queue.top().second;
+			queue.pop();
+
+			const auto p = priority(v, contractedNeighbourCount[v]);
+			if ( (!queue.empty()) && (p > queue.top().first) ) {
+				queue.push(std::make_pair(p, v));
+				continue;
+			}
+
+			// Even the cheapest location left is too densely connected: what remains is the core
+			if (p == corePriority) {
+				queue.push(std::make_pair(p, v));
+				break;
+			}
+
+			const auto ins = neighbours(v, false);
+			const auto outs = neighbours(v, true);
+
+			for (const auto& n : ins) {
+				contractedNeighbourCount[n.location]++;
+			}
+
+			for (const auto& n : outs) {
+				contractedNeighbourCount[n.location]++;
+			}
+
+			contraction(v, false);
+			rank_[v] = nextRank++;
+
+			// Edges to and from 'v' would only slow down the witness searches of its neighbours from now on
+			for (const auto& n : ins) {
+				edgesToContractedDel(outEdges_[n.location], true);
+			}
+
+			for (const auto& n : outs) {
+				edgesToContractedDel(inEdges_[n.location], false);
+			}
+		}
+
+		isCore_.assign(numLocations, false);
+		while (!queue.empty()) {
+			const auto v = queue.top().second;
+			queue.pop();
+
+			isCore_[v] = true;
+			rank_[v] = nextRank++;
+			coreLocationCount_++;
+		}
+
+		// Every edge goes up the ranks from one of its ends: the forward search uses it from 'from', the backward one from 'to'. 
+		// Edges inside the core are used by both searches.
+		upOutEdgeOffsets_.assign(numLocations + 1, 0);
+		upInEdgeOffsets_.assign(numLocations + 1, 0);
+		for (const auto& edge : edges_) {
+			if ( (isCore_[edge.from]) && (isCore_[edge.to]) ) {
+				upOutEdgeOffsets_[edge.from + 1]++;
+				upInEdgeOffsets_[edge.to + 1]++;
+			} else if (rank_[edge.from] < rank_[edge.to]) {
+				upOutEdgeOffsets_[edge.from + 1]++;
+			} else {
+				upInEdgeOffsets_[edge.to + 1]++;
+			}
+		}
+
+		for (auto id = 0u; id < numLocations; id++) {
+			upOutEdgeOffsets_[id + 1] += upOutEdgeOffsets_[id];
+			upInEdgeOffsets_[id + 1] += upInEdgeOffsets_[id];
+		}
+
+		upOutEdges_.resize(upOutEdgeOffsets_[numLocations]);
+		upInEdges_.resize(upInEdgeOffsets_[numLocations]);
+		vector<U32> nextOut(upOutEdgeOffsets_.begin(), upOutEdgeOffsets_.end() - 1);
+		vector<U32> nextIn(upInEdgeOffsets_.begin(), upInEdgeOffsets_.end() - 1);
+		for (auto e = 0u; e < edges_.size(); e++) {
+			const auto& edge = edges_[e];
+			if ( (isCore_[edge.from]) && (isCore_[edge.to]) ) {
+				upOutEdges_[nextOut[edge.from]++] = e;
+				upInEdges_[nextIn[edge.to]++] = e;
+			} else if (rank_[edge.from] < rank_[edge.to]) {
+				upOutEdges_[nextOut[edge.from]++] = e;
+			} else {
+				upInEdges_[nextIn[edge.to]++] = e;
+			}
+		}
+
+		// Only needed while contracting
+		outEdges_ = vector< vector<U32> >();
+		inEdges_ = vector< vector<U32> >();
+		witnessSearch_.locationIdCountIs(0);
+		isWitnessTarget_ = vector<bool>();
+	}
+
+	/* Appends the segments that 'e' stands for */
+	void unpack(const U32 e, vector<Id>& segments) const {
+		vector<U32> stack(1, e);
+		while (!stack.empty()) {
+			const auto& edge = edges_[stack.back()];
+			stack.pop_back();
+
+			if (edge.segment != TravelNetworkIndex::nullId) {
+				segments.push_back(edge.segment);
+			} else {
+				stack.push_back(edge.second);
+				stack.push_back(edge.first);
+			}
+		}
+	}
+
+	IndexTracker* tracker_;
+
+	vector<Edge> edges_;
+	vector<Id> rank_;
+	unsigned int shortcutCount_;
+	unsigned int locationCount_;
+	vector<bool> isCore_;
+	unsigned int coreLocationCount_;
+
+	vector< vector<U32> > outEdges_;
+	vector< vector<U32> > inEdges_;
+	SearchSpace witnessSearch_;
+	vector<bool> isWitnessTarget_;
+
+	vector<U32> upOutEdgeOffsets_;
+	vector<U32> upOutEdges_;
+	vector<U32> upInEdgeOffsets_;
+	vector<U32> upInEdges_;
+
+	// Scratch space of the queries
+	mutable SearchSpace forwardSearch_;
+	mutable SearchSpace backwardSearch_;
+	mutable U64 settledCount_;
+	mutable U64 relaxedCount_;
+
+	bool isStale_;
+};
+
+constexpr U32 ContractionHierarchy::nullEdge;
+constexpr unsigned int ContractionHierarchy::simulationWitnessSettleLimit;
+constexpr unsigned int ContractionHierarchy::witnessSettleLimit;
+constexpr unsigned int ContractionHierarchy::coreDegreeProductLimit;
+constexpr int ContractionHierarchy::corePriority;
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef DELTA_STEPPING_H
+#define DELTA_STEPPING_H
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+#include "CommonLib.h"
+#include "ShortestPathTree.h"
+#include "TravelNetworkIndex.h"
+#include "WorkerPool.h"
+
+using std::map;
+using std::vector;
+
+//=======================================================
+// DeltaStepping class
+//
+//   Single-source shortest path search (Meyer & Sanders'
+//   delta-stepping) whose relaxations run on a WorkerPool.
+//
+//   Locations are kept in buckets of width 'delta' by
+//   tentative distance, and the buckets are processed in
+//   order. Arcs no longer than delta ("light") can move a
+//   location into the bucket being processed, so they are
+//   relaxed in rounds until the bucket stays empty; the
+//   other ("heavy") arcs are relaxed once, after the last
+//   round. Every location of a round is relaxed at the
+//   same time rather than one after another, which is
+//   what the workers share: on dense networks, most of
+//   the time of a search goes into scanning arcs.
+//
+//   The workers only read the tree while they scan, and
+//   leave the improvements they find in buffers of their
+//   own. The calling thread then applies them in a fixed
+//   order, so the tree does not depend on the number of
+//   workers.
+//
+//   Wide buckets mean fewer, larger rounds but more
+//   locations relaxed again after their distance drops;
+//   with delta below the shortest arc every location is
+//   relaxed once, as in Dijkstra.
+//=======================================================
+
+class DeltaStepping {
+public:
+
+	typedef TravelNetworkIndex::Id Id;
+
+	/* Bucket width that suits 'index': the mean arc length divided by the mean number of arcs per location,
+	   but no less than the shortest arc */
+	static double bucketWidth(const TravelNetworkIndex* index) {
+		auto numLocations = 0u;
+		auto numArcs = 0u;
+		auto totalLength = 0.0;
+		auto minLength = ShortestPathTree::unreachableDistance();
+		for (auto id = 0u; id < index->locationIdCount(); id++) {
+			if (index->outArcIter(id) != index->outArcIterEnd(id)) {
+				numLocations++;
+			}
+
+			for (auto arc = index->outArcIter(id); arc != index->outArcIterEnd(id); arc++) {
+				numArcs++;
+				totalLength += arc->length;
+				minLength = std::min(minLength, arc->length);
+			}
+		}
+
+		if (numArcs == 0) {
+			return 1;
+		}
+
+		const auto width = (totalLength / numArcs) / (static_cast<double>(numArcs) / numLocations);
+		return std::max(std::max(width, minLength), 1e-9);
+	}
+
+	/* A search over 'index' with buckets of width 'delta'. Runs on 'pool' if not null, on the calling thread otherwise. */
+	DeltaStepping(const TravelNetworkIndex* index, const double delta, WorkerPool* pool) :
+		index_(index),
+		delta_(delta),
+		pool_(pool)
+	{
+		// Nothing else to do
+	}
+
+	/* Grows 'tree' from 'root', replacing its contents. With a 'target', stops once the bucket of
+	   the target is done: every location at least as close as the target is then settled. */
+	void rootIs(const Id root,
+				const ShortestPathTree::Direction direction,
+				ShortestPathTree& tree,
+				const Id target = TravelNetworkIndex::nullId) {
+		const auto numLocations = index_->locationIdCount();
+		tree.minDist.assign(numLocations, ShortestPathTree::unreachableDistance());
+		tree.predLocation.assign(numLocations, TravelNetworkIndex::nullId);
+		tree.predSegment.assign(numLocations, TravelNetworkIndex::nullId);
+		tree.settledCount = 0;
+		tree.relaxedCount = 0;
+
+		direction_ = direction;
+		tree_ = &tree;
+		settledLocations_.clear();
+		vector<bool> settled(numLocations, false);
+		vector<bool> inBucket(numLocations, false);
+		roundOf_.assign(numLocations, 0);
+		round_ = 0;
+		buckets_.clear();
+
+		tree.minDist[root] = 0;
+		buckets_[0].push_back(root);
+
+		vector<Id> frontier;
+		vector<Id> bucketLocations;
+		while (!buckets_.empty()) {
+			const auto b = buckets_.begin()->first;
+
+			// Light arcs, in rounds, until no location moves into this bucket
+			bucketLocations.clear();
+			while (!buckets_[b].empty()) {
+				round_++;
+				frontier.clear();
+				for (auto id : buckets_[b]) {
+					// Locations are pushed again when their distance drops, so earlier pushes are stale
+					if ( (!settled[id]) && (roundOf_[id] != round_) && (bucket(tree.minDist[id]) == b) ) {
+						roundOf_[id] = round_;
+						frontier.push_back(id);
+						if (!inBucket[id]) {
+							inBucket[id] = true;
+							bucketLocations.push_back(id);
+						}
+					}
+				}
+
+				buckets_[b].clear();
+				relax(frontier, true);
+			}
+
+			buckets_.erase(b);
+
+			// Heavy arcs end in later buckets, so once is enough
+			relax(bucketLocations, false);
+
+			for (auto id : bucketLocations) {
+				settled[id] = true;
+				settledLocations_.push_back(id);
+			}
+
+			tree.settledCount += bucketLocations.size();
+
+			if ( (target != TravelNetworkIndex::nullId) && (settled[target]) ) {
+				break;
+			}
+		}
+
+		buckets_.clear();
+		tree_ = nullptr;
+	}
+
+	/* Locations settled by the last search, by bucket, root first */
+	const vector<Id>& settledLocations() const {
+		return settledLocations_;
+	}
+
+private:
+
+	/* One improvement found by a worker: 'location' is 'dist' away through 'segment' from 'pred' */
+	struct Relaxation {
+		Id location;
+		Id pred;
+		Id segment;
+		double dist;
+	};
+
+	/* Number of locations whose arcs one task scans. Fixed so that the order in which relaxations are applied is too. */
+	static const unsigned int chunkSize = 8;
+
+	U64 bucket(const double dist) const {
+		return static_cast<U64>(std::floor(dist / delta_));
+	}
+
+	/* Relaxes the light or the heavy arcs of 'locations' */
+	void relax(const vector<Id>& locations, const bool isLight) {
+		if (locations.empty()) {
+			return;
+		}
+
+		// Every arc of the locations is looked at, light and heavy alike
+		for (auto locId : locations) {
+			tree_->relaxedCount += (direction_ == ShortestPathTree::forward) ? 
+								   index_->outArcIterEnd(locId) - index_->outArcIter(locId) : 
+								   index_->inArcIterEnd(locId) - index_->inArcIter(locId);
+		}
+
+		const unsigned int taskCount = (locations.size() + chunkSize - 1) / chunkSize;
+		if (relaxations_.size() < taskCount) {
+			relaxations_.resize(taskCount);
+		}
+
+		const auto scan = [this, &locations, isLight](unsigned int task) {
+			auto& found = relaxations_[task];
+			found.clear();
+
+			const auto& minDist = tree_->minDist;
+			const auto end = std::min<size_t>(locations.size(), (task + 1) * chunkSize);
+			for (auto i = task * chunkSize; i < end; i++) {
+				const auto locId = locations[i];
+				const auto locDist = minDist[locId];
+				const auto arcBegin = (direction_ == ShortestPathTree::forward) ? index_->outArcIter(locId) : index_->inArcIter(locId);
+				const auto arcEnd = (direction_ == ShortestPathTree::forward) ? index_->outArcIterEnd(locId) : index_->inArcIterEnd(locId);
+				for (auto arc = arcBegin; arc != arcEnd; arc++) {
+					const auto tmp = locDist + arc->length;
+					if ( ( (arc->length <= delta_) == isLight ) && (tmp < minDist[arc->location]) ) {
+						found.push_back(Relaxation{ arc->location, locId, arc->segment, tmp });
+					}
+				}
+			}
+		};
+
+		if ( (pool_ != nullptr) && (taskCount > 1) ) {
+			pool_->run(taskCount, scan);
+		} else {
+			for (auto task = 0u; task < taskCount; task++) {
+				scan(task);
+			}
+		}
+
+		for (auto task = 0u; task < taskCount; task++) {
+			for (const auto& r : relaxations_[task]) {
+				if (r.dist < tree_->minDist[r.location]) {
+					tree_->minDist[r.location] = r.dist;
+					tree_->predLocation[r.location] = r.pred;
+					tree_->predSegment[r.location] = r.segment;
+
+					buckets_[bucket(r.dist)].push_back(r.location);
+				}
+			}
+		}
+	}
+
+	const TravelNetworkIndex* index_;
+	double delta_;
+	WorkerPool* pool_;
+
+	// State of the current search
+	ShortestPathTree::Direction direction_;
+	ShortestPathTree* tree_;
+	// Only the buckets that hold locations, since narrow buckets can number far more than the locations
+	map< U64, vector<Id> > buckets_;
+	vector<U32> roundOf_;
+	U32 round_;
+	vector< vector<Relaxation> > relaxations_;
+	vector<Id> settledLocations_;
+};
+
+#endif
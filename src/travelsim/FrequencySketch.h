@@ -0,0 +1,96 @@
+#ifndef FREQUENCY_SKETCH_H
+#define FREQUENCY_SKETCH_H
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "CommonLib.h"
+
+using std::string;
+using std::vector;
+
+//=======================================================
+// FrequencySketch class
+//
+//   Approximate access counts of a large set of keys in
+//   a fixed amount of memory (count-min sketch), as used
+//   by TinyLFU admission.
+//
+//   Each key maps to one small counter in each of the
+//   rows, and its frequency is the minimum of them, so
+//   collisions can only overestimate it. Counters
+//   saturate at maxFrequency(), and all of them are
+//   halved once the sample size is reached, so the
+//   sketch follows recent popularity rather than the
+//   whole history.
+//=======================================================
+
+class FrequencySketch {
+public:
+
+	static U8 maxFrequency() {
+		return 15;
+	}
+
+	/* 'width' counters per row, rounded up to a power of two */
+	explicit FrequencySketch(const U32 width = 4096) :
+		width_(1),
+		additionCount_(0)
+	{
+		while (width_ < width) {
+			width_ <<= 1;
+		}
+
+		counters_.assign(rowCount * width_, 0);
+		sampleSize_ = 10 * width_;
+	}
+
+	U8 frequency(const string& key) const {
+		const auto hash = std::hash<string>()(key);
+		auto freq = maxFrequency();
+		for (auto row = 0u; row < rowCount; row++) {
+			freq = std::min(freq, counters_[counterIndex(hash, row)]);
+		}
+
+		return freq;
+	}
+
+	void frequencyIsIncByOne(const string& key) {
+		const auto hash = std::hash<string>()(key);
+		for (auto row = 0u; row < rowCount; row++) {
+			auto& counter = counters_[counterIndex(hash, row)];
+			if (counter < maxFrequency()) {
+				counter++;
+			}
+		}
+
+		if (++additionCount_ >= sampleSize_) {
+			for (auto& counter : counters_) {
+				counter >>= 1;
+			}
+
+			additionCount_ /= 2;
+		}
+	}
+
+private:
+
+	static const U32 rowCount = 4;
+
+	/* One multiplicative hash per row over the key's std::hash */
+	U32 counterIndex(const size_t hash, const U32 row) const {
+		static const U64 seeds[rowCount] = { 0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+											 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL };
+		const U64 mixed = (static_cast<U64>(hash) + row) * seeds[row];
+		return row * width_ + static_cast<U32>(mixed >> 32) % width_;
+	}
+
+	U32 width_;
+	U32 sampleSize_;
+	U32 additionCount_;
+	vector<U8> counters_;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <algorithm>
+#include <limits>
+
+#include "CommonLib.h"
+
+//=======================================================
+// Histogram class
+//
+//   Distribution of a series of non-negative integer
+//   samples (latencies in nanoseconds, locations settled
+//   by a search, ...) in a fixed amount of memory.
+//
+//   Samples are counted in power-of-two buckets: bucket 0
+//   holds the zeros and bucket i > 0 the samples in
+//   [2^(i-1), 2^i). Percentiles are therefore within a
+//   factor of two of the exact ones, which is enough to
+//   tell a cache hit from a search, while the count, sum,
+//   minimum and maximum are exact.
+//=======================================================
+
+class Histogram {
+public:
+
+	static const unsigned int bucketCount = 65;
+
+	Histogram() :
+		sampleCount_(0),
+		sum_(0),
+		min_(std::numeric_limits<U64>::max()),
+		max_(0)
+	{
+		std::fill(buckets_, buckets_ + bucketCount, 0);
+	}
+
+	U64 sampleCount() const {
+		return sampleCount_;
+	}
+
+	U64 sum() const {
+		return sum_;
+	}
+
+	/* Smallest sample, 0 if there is none */
+	U64 min() const {
+		return (sampleCount_ > 0) ? min_ : 0;
+	}
+
+	U64 max() const {
+		return max_;
+	}
+
+	double mean() const {
+		return (sampleCount_ > 0) ? static_cast<double>(sum_) / sampleCount_ : 0;
+	}
+
+	/* Number of samples in bucket 'i' */
+	U64 bucket(const unsigned int i) const {
+		return buckets_[i];
+	}
+
+	/* Smallest sample in bucket 'i' */
+	static U64 bucketLowerBound(const unsigned int i) {
+		return (i == 0) ? 0 : U64(1) << (i - 1);
+	}
+
+	/* Upper bound on the sample below which a fraction 'q' (0 to 1) of the samples fall: the upper
+	   end of the bucket that holds it, but no more than the largest sample. 0 if there are no samples. */
+	U64 percentile(const double q) const {
+		if (sampleCount_ == 0) {
+			return 0;
+		}
+
+		const auto rank = std::max<U64>(1, static_cast<U64>(q * sampleCount_ + 0.5));
+		auto seen = U64(0);
+		for (auto i = 0u; i < bucketCount; i++) {
+			seen += buckets_[i];
+			if (seen >= rank) {
+				const auto upperBound = (i == 0) ? 0 : (i == bucketCount - 1) ? max_ : (U64(1) << i) - 1;
+				return std::min(upperBound, max_);
+			}
+		}
+
+		return max_;
+	}
+
+	void sampleIs(const U64 value) {
+		auto i = 0u;
+		for (auto v = value; v > 0; v >>= 1) {
+			i++;
+		}
+
+		buckets_[i]++;
+		sampleCount_++;
+		sum_ += value;
+		min_ = std::min(min_, value);
+		max_ = std::max(max_, value);
+	}
+
+private:
+
+	U64 buckets_[bucketCount];
+	U64 sampleCount_;
+	U64 sum_;
+	U64 min_;
+	U64 max_;
+};
+
+#endif
@@ -0,0 +1,446 @@
+#ifndef HUB_LABELS_H
+#define HUB_LABELS_H
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "CommonLib.h"
+#include "ShortestPathTree.h"
+#include "TravelNetworkIndex.h"
+
+using fwk::Ptr;
+using fwk::PtrInterface;
+
+using std::vector;
+
+//=======================================================
+// HubLabels class
+//
+//   Two-hop hub labeling of a snapshot of the travel
+//   network, for distance queries on networks that no
+//   longer change.
+//
+//   Every location gets an out label, a list of hubs with
+//   its distance to each, and an in label, a list of hubs
+//   with the distance from each. The labels cover every
+//   pair: d(s, t) is the smallest out(s) + in(t) over the
+//   hubs the two labels share, so a query is a merge of
+//   two arrays sorted by hub, with no search at all.
+//
+//   The labels are grown by pruned landmark labeling: the
+//   locations are taken as hubs one at a time, most
+//   connected first, and each grows a forward and a
+//   backward Dijkstra that stops at the locations whose
+//   labels already give a distance as short as its own.
+//
+//   Every label entry keeps the first segment on its way
+//   to (or from) its hub, so the segments of a path are
+//   only looked up when a path is asked for.
+//
+//   The labels are not maintained: any arc change in the
+//   index marks them as stale, and they should then be
+//   dropped.
+//=======================================================
+
+class HubLabels : public PtrInterface {
+public:
+
+	typedef TravelNetworkIndex::Id Id;
+
+	/* Labels the current network of 'index' */
+	static Ptr<HubLabels> instanceNew(const Ptr<TravelNetworkIndex>& index) {
+		return new HubLabels(index);
+	}
+
+	/* True once the network has changed since the labels were built */
+	bool isStale() const {
+		return isStale_;
+	}
+
+	/* Upper bound (exclusive) on the location ids known to the labels */
+	Id locationIdCount() const {
+		return rank_.size();
+	}
+
+	bool isLocationLabeled(const Id location) const {
+		return (location < rank_.size()) && (rank_[location] != TravelNetworkIndex::nullId);
+	}
+
+	unsigned int locationCount() const {
+		return hubLocation_.size();
+	}
+
+	/* Number of entries of the out and in labels of all the locations */
+	U64 labelEntryCount() const {
+		return outLabels_.hubs.size() + inLabels_.hubs.size();
+	}
+
+	/* Average number of entries of a label, out and in labels alike */
+	double averageLabelSize() const {
+		return hubLocation_.empty() ? 0 : static_cast<double>(labelEntryCount()) / (2 * hubLocation_.size());
+	}
+
+	/* Memory taken by the labels */
+	U64 bytes() const {
+		return outLabels_.bytes() + inLabels_.bytes() +
+			   (rank_.capacity() + hubLocation_.capacity()) * sizeof(Id);
+	}
+
+	/* Wall-clock time the labeling took */
+	U64 buildNanoseconds() const {
+		return buildNanoseconds_;
+	}
+
+	/* Number of locations the pruned searches of the labeling settled */
+	U64 buildSettledCount() const {
+		return buildSettledCount_;
+	}
+
+	/* Length of the shortest path from 'source' to 'destination'.
+	   ShortestPathTree::unreachableDistance() if there is no such path. */
+	double distance(const Id source, const Id destination) const {
+		Id hub;
+		return merge(source, destination, hub);
+	}
+
+	/* Length of the shortest path from 'source' to 'destination', with the ids of its segments appended to
+	   'segments' in order. ShortestPathTree::unreachableDistance() if there is no such path. */
+	double shortestPath(const Id source, const Id destination, vector<Id>& segments) const {
+		Id hub;
+		const auto length = merge(source, destination, hub);
+		if (length == ShortestPathTree::unreachableDistance()) {
+			return length;
+		}
+
+		// Source to hub along the out labels, then hub to destination backwards along the in labels
+		for (auto id = source; id != hubLocation_[hub]; ) {
+			const auto& hop = outLabels_.hop(id, hub);
+			segments.push_back(hop.segment);
+			id = hop.location;
+		}
+
+		const auto hubToDestStart = segments.size();
+		for (auto id = destination; id != hubLocation_[hub]; ) {
+			const auto& hop = inLabels_.hop(id, hub);
+			segments.push_back(hop.segment);
+			id = hop.location;
+		}
+
+		std::reverse(segments.begin() + hubToDestStart, segments.end());
+
+		return length;
+	}
+
+	HubLabels(const HubLabels&) = delete;
+
+	void operator =(const HubLabels&) = delete;
+	void operator ==(const HubLabels&) = delete;
+
+protected:
+
+	//=======================================================
+	// IndexTracker class
+	//    Marks the labels as stale on the first change to the
+	//    network.
+	//=======================================================
+
+	class IndexTracker : public TravelNetworkIndex::Notifiee {
+	public:
+
+		static IndexTracker* instanceNew(const Ptr<TravelNetworkIndex>& index, HubLabels* labels) {
+			const auto tracker = new IndexTracker(labels);
+			tracker->notifierIs(index);
+			return tracker;
+		}
+
+		void onArcNew(const TravelNetworkIndex::ArcChange& arc) {
+			labels_->isStale_ = true;
+		}
+
+		void onArcDel(const TravelNetworkIndex::ArcChange& arc) {
+			labels_->isStale_ = true;
+		}
+
+		void onArcLength(const TravelNetworkIndex::ArcChange& arc) {
+			labels_->isStale_ = true;
+		}
+
+		void onLocationDel(const Id location) {
+			labels_->isStale_ = true;
+		}
+
+	protected:
+
+		explicit IndexTracker(HubLabels* labels) :
+			labels_(labels)
+		{
+			// Nothing else to do
+		}
+
+	private:
+
+		// Not a Ptr since the labels own their tracker
+		HubLabels* labels_;
+	};
+
+	explicit HubLabels(const Ptr<TravelNetworkIndex>& index) :
+		buildNanoseconds_(0),
+		buildSettledCount_(0),
+		isStale_(false)
+	{
+		if (index->isStale()) {
+			index->isStaleIs(false);
+		}
+
+		const auto startTime = std::chrono::steady_clock::now();
+		label(index);
+		buildNanoseconds_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - startTime).count();
+
+		tracker_ = IndexTracker::instanceNew(index, this);
+	}
+
+	~HubLabels() {
+		delete tracker_;
+	}
+
+private:
+
+	typedef std::pair<double, Id> HeapEntry;
+	typedef std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > Heap;
+
+	/* Next location and segment on the way to the hub of a label entry (from it, for in labels).
+	   Both are nullId at the hub itself. */
+	struct Hop {
+		Id location;
+		Id segment;
+	};
+
+	/* One entry of a label while the labels are grown */
+	struct Entry {
+		Id hub;
+		double dist;
+		Hop hop;
+	};
+
+	/* The labels of one direction, laid out by location. The hubs of a label are its entries' ranks, in
+	   increasing order. Kept apart from the hops, which a distance query does not touch. */
+	struct Labels {
+		vector<U32> offsets;
+		vector<Id> hubs;
+		vector<double> dists;
+		vector<Hop> hops;
+
+		const Hop& hop(const Id location, const Id hub) const {
+			const auto first = hubs.begin() + offsets[location];
+			const auto last = hubs.begin() + offsets[location + 1];
+			return hops[std::lower_bound(first, last, hub) - hubs.begin()];
+		}
+
+		U64 bytes() const {
+			return offsets.capacity() * sizeof(U32) + hubs.capacity() * sizeof(Id) +
+				   dists.capacity() * sizeof(double) + hops.capacity() * sizeof(Hop);
+		}
+
+		void entriesIs(const vector< vector<Entry> >& entries) {
+			offsets.assign(entries.size() + 1, 0);
+			for (auto id = 0u; id < entries.size(); id++) {
+				offsets[id + 1] = offsets[id] + entries[id].size();
+			}
+
+			hubs.reserve(offsets.back());
+			dists.reserve(offsets.back());
+			hops.reserve(offsets.back());
+			for (const auto& label : entries) {
+				for (const auto& entry : label) {
+					hubs.push_back(entry.hub);
+					dists.push_back(entry.dist);
+					hops.push_back(entry.hop);
+				}
+			}
+		}
+	};
+
+	/* Smallest out(source) + in(destination) over the shared hubs, with the rank of the hub that gives it */
+	double merge(const Id source, const Id destination, Id& hub) const {
+		auto minDist = ShortestPathTree::unreachableDistance();
+		hub = TravelNetworkIndex::nullId;
+		if ( (!isLocationLabeled(source)) || (!isLocationLabeled(destination)) ) {
+			return minDist;
+		}
+
+		auto i = outLabels_.offsets[source];
+		const auto iEnd = outLabels_.offsets[source + 1];
+		auto j = inLabels_.offsets[destination];
+		const auto jEnd = inLabels_.offsets[destination + 1];
+		while ( (i < iEnd) && (j < jEnd) ) {
+			const auto outHub = outLabels_.hubs[i];
+			const auto inHub = inLabels_.hubs[j];
+			if (outHub < inHub) {
+				i++;
+			} else if (inHub < outHub) {
+				j++;
+			} else {
+				const auto tmp = outLabels_.dists[i] + inLabels_.dists[j];
+				if (tmp < minDist) {
+					minDist = tmp;
+					hub = outHub;
+				}
+
+				i++;
+				j++;
+			}
+		}
+
+		return minDist;
+	}
+
+	/* Dijkstra from the hub of rank 'hub', over out arcs if 'isForward' (adding to the in labels) and over in arcs
+	   otherwise (adding to the out labels). A location whose labels already cover its distance to the hub is not
+	   labeled, and not searched past. 'hubDist' holds the hub's own label of the other direction, by hub. */
+	void prunedSearch(const Ptr<TravelNetworkIndex>& index, const Id hub, const bool isForward,
+					  const vector<double>& hubDist, vector< vector<Entry> >& labels) {
+		const auto hubId = hubLocation_[hub];
+		Heap heap;
+
+		dist_[hubId] = 0;
+		touched_.push_back(hubId);
+		heap.push(HeapEntry(0, hubId));
+
+		while (!heap.empty()) {
+			const auto locDist = heap.top().first;
+			const auto locId = heap.top().second;
+			heap.pop();
+
+			if ( (locDist > dist_[locId]) || (isSettled_[locId]) ) {
+				continue;
+			}
+
+			isSettled_[locId] = true;
+			buildSettledCount_++;
+
+			auto coveredDist = ShortestPathTree::unreachableDistance();
+			for (const auto& entry : labels[locId]) {
+				coveredDist = std::min(coveredDist, hubDist[entry.hub] + entry.dist);
+			}
+
+			if (coveredDist <= locDist) {
+				continue;
+			}
+
+			labels[locId].push_back(Entry { hub, locDist, pred_[locId] });
+
+			const auto arcBegin = isForward ? index->outArcIter(locId) : index->inArcIter(locId);
+			const auto arcEnd = isForward ? index->outArcIterEnd(locId) : index->inArcIterEnd(locId);
+			for (auto arc = arcBegin; arc != arcEnd; arc++) {
+				const auto nextId = arc->location;
+				const auto tmp = locDist + arc->length;
+				if (tmp < dist_[nextId]) {
+					if (dist_[nextId] == ShortestPathTree::unreachableDistance()) {
+						touched_.push_back(nextId);
+					}
+
+					dist_[nextId] = tmp;
+					pred_[nextId] = Hop { locId, arc->segment };
+					heap.push(HeapEntry(tmp, nextId));
+				}
+			}
+		}
+
+		for (auto id : touched_) {
+			dist_[id] = ShortestPathTree::unreachableDistance();
+			pred_[id] = Hop { TravelNetworkIndex::nullId, TravelNetworkIndex::nullId };
+			isSettled_[id] = false;
+		}
+
+		touched_.clear();
+	}
+
+	void label(const Ptr<TravelNetworkIndex>& index) {
+		const auto numLocations = index->locationIdCount();
+
+		// Hubs that lie on many shortest paths prune the most searches: the most connected locations go first
+		for (auto id = 0u; id < numLocations; id++) {
+			if (index->location(id) != null) {
+				hubLocation_.push_back(id);
+			}
+		}
+
+		const auto degree = [&index](const Id id) {
+			return (index->outArcIterEnd(id) - index->outArcIter(id)) + (index->inArcIterEnd(id) - index->inArcIter(id));
+		};
+		std::stable_sort(hubLocation_.begin(), hubLocation_.end(), [&degree](const Id a, const Id b) {
+			return degree(a) > degree(b);
+		});
+
+		rank_.assign(numLocations, TravelNetworkIndex::nullId);
+		for (auto r = 0u; r < hubLocation_.size(); r++) {
+			rank_[hubLocation_[r]] = r;
+		}
+
+		dist_.assign(numLocations, ShortestPathTree::unreachableDistance());
+		pred_.assign(numLocations, Hop { TravelNetworkIndex::nullId, TravelNetworkIndex::nullId });
+		isSettled_.assign(numLocations, false);
+
+		vector< vector<Entry> > outEntries(numLocations);
+		vector< vector<Entry> > inEntries(numLocations);
+		vector<double> hubDist(hubLocation_.size(), ShortestPathTree::unreachableDistance());
+
+		for (auto hub = 0u; hub < hubLocation_.size(); hub++) {
+			const auto hubId = hubLocation_[hub];
+
+			// Forward: d(hub, v) is covered by d(hub, w) + d(w, v) over the hubs w of out(hub) and in(v)
+			for (const auto& entry : outEntries[hubId]) {
+				hubDist[entry.hub] = entry.dist;
+			}
+
+			prunedSearch(index, hub, true, hubDist, inEntries);
+
+			for (const auto& entry : outEntries[hubId]) {
+				hubDist[entry.hub] = ShortestPathTree::unreachableDistance();
+			}
+
+			// Backward: d(v, hub) is covered by d(v, w) + d(w, hub) over the hubs w of out(v) and in(hub)
+			for (const auto& entry : inEntries[hubId]) {
+				hubDist[entry.hub] = entry.dist;
+			}
+
+			prunedSearch(index, hub, false, hubDist, outEntries);
+
+			for (const auto& entry : inEntries[hubId]) {
+				hubDist[entry.hub] = ShortestPathTree::unreachableDistance();
+			}
+		}
+
+		outLabels_.entriesIs(outEntries);
+		inLabels_.entriesIs(inEntries);
+
+		// Only needed while labeling
+		dist_ = vector<double>();
+		pred_ = vector<Hop>();
+		isSettled_ = vector<bool>();
+	}
+
+	IndexTracker* tracker_;
+
+	vector<Id> rank_;
+	vector<Id> hubLocation_;
+	Labels outLabels_;
+	Labels inLabels_;
+
+	U64 buildNanoseconds_;
+	U64 buildSettledCount_;
+
+	// Scratch space of the pruned searches
+	vector<double> dist_;
+	vector<Hop> pred_;
+	vector<bool> isSettled_;
+	vector<Id> touched_;
+
+	bool isStale_;
+};
+
+#endif
@@ -0,0 +1,359 @@
+#ifndef LANDMARK_TABLE_H
+#define LANDMARK_TABLE_H
+
+#include <algorithm>
+#include <vector>
+
+#include "CommonLib.h"
+#include "ShortestPathTree.h"
+#include "TravelNetworkIndex.h"
+
+using fwk::Ptr;
+using fwk::PtrInterface;
+
+using std::vector;
+
+//=======================================================
+// LandmarkTable class
+//
+//   Landmark distances for goal-directed (ALT) searches.
+//   For every landmark L the table keeps the complete
+//   shortest path tree from L (distances d(L, v)) and to L
+//   (distances d(v, L)). By the triangle inequality
+//
+//       d(v, t) >= d(L, t) - d(L, v)
+//       d(v, t) >= d(v, L) - d(t, L)
+//
+//   so lowerBound() gives a consistent A* potential.
+//
+//   The table follows the index through its Notifiee and
+//   only regrows the trees that a change can affect:
+//     - a deleted (or lengthened) arc only affects the
+//       trees that use it,
+//     - a new (or shortened) arc only affects the trees
+//       in which it gives a shorter distance,
+//     - deleting a landmark location reselects all the
+//       landmarks.
+//   Affected trees are regrown on the next isStaleIs(false).
+//=======================================================
+
+class LandmarkTable : public PtrInterface {
+public:
+
+	typedef TravelNetworkIndex::Id Id;
+
+	static Ptr<LandmarkTable> instanceNew(const Ptr<TravelNetworkIndex>& index, const unsigned int landmarkCount) {
+		return new LandmarkTable(index, landmarkCount);
+	}
+
+	/* Number of landmarks currently selected. Can be below the requested count on small networks. */
+	unsigned int landmarkCount() const {
+		return landmarks_.size();
+	}
+
+	Id landmark(const unsigned int i) const {
+		return landmarks_[i];
+	}
+
+	/* d(landmark i, location) */
+	double distanceFromLandmark(const unsigned int i, const Id location) const {
+		return distance(fromLandmark_[i], location);
+	}
+
+	/* d(location, landmark i) */
+	double distanceToLandmark(const unsigned int i, const Id location) const {
+		return distance(toLandmark_[i], location);
+	}
+
+	/* Lower bound on d(source, destination). ShortestPathTree::unreachableDistance()
+	   if some landmark proves that destination cannot be reached from source. */
+	double lowerBound(const Id source, const Id destination) const {
+		const auto unreachable = ShortestPathTree::unreachableDistance();
+		auto bound = 0.0;
+
+		for (auto i = 0u; i < landmarks_.size(); i++) {
+			const auto fromSrc = distanceFromLandmark(i, source);
+			const auto fromDst = distanceFromLandmark(i, destination);
+			if (fromDst != unreachable) {
+				if (fromSrc != unreachable) {
+					bound = std::max(bound, fromDst - fromSrc);
+				}
+			} else if (fromSrc != unreachable) {
+				// Reaching destination from source would also reach it from the landmark
+				return unreachable;
+			}
+
+			const auto toSrc = distanceToLandmark(i, source);
+			const auto toDst = distanceToLandmark(i, destination);
+			if (toSrc != unreachable) {
+				if (toDst != unreachable) {
+					bound = std::max(bound, toSrc - toDst);
+				}
+			} else if (toDst != unreachable) {
+				// Source cannot reach the landmark that destination reaches
+				return unreachable;
+			}
+		}
+
+		return bound;
+	}
+
+	/* Number of times the landmarks have been selected and all their trees grown */
+	unsigned int rebuildCount() const {
+		return rebuildCount_;
+	}
+
+	/* Number of single trees regrown after a change to the network */
+	unsigned int repairCount() const {
+		return repairCount_;
+	}
+
+	bool isStale() const {
+		if (landmarksAreStale_) {
+			return true;
+		}
+
+		for (auto i = 0u; i < landmarks_.size(); i++) {
+			if ( (fromLandmarkIsStale_[i]) || (toLandmarkIsStale_[i]) ) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/* Marking the table as not stale regrows the trees affected by the changes seen since the last time */
+	void isStaleIs(bool b) {
+		if (b) {
+			landmarksAreStale_ = true;
+		} else if (isStale()) {
+			if (index_->isStale()) {
+				index_->isStaleIs(false);
+			}
+
+			if (landmarksAreStale_) {
+				rebuild();
+			} else {
+				repair();
+			}
+		}
+	}
+
+	LandmarkTable(const LandmarkTable&) = delete;
+
+	void operator =(const LandmarkTable&) = delete;
+	void operator ==(const LandmarkTable&) = delete;
+
+protected:
+
+	//=======================================================
+	// IndexTracker class
+	//    Marks the trees affected by each arc change of the
+	//    index as stale.
+	//=======================================================
+
+	class IndexTracker : public TravelNetworkIndex::Notifiee {
+	public:
+
+		static IndexTracker* instanceNew(const Ptr<TravelNetworkIndex>& index, LandmarkTable* table) {
+			const auto tracker = new IndexTracker(table);
+			tracker->notifierIs(index);
+			return tracker;
+		}
+
+		void onArcNew(const TravelNetworkIndex::ArcChange& arc) {
+			table_->arcIsShorter(arc);
+		}
+
+		void onArcDel(const TravelNetworkIndex::ArcChange& arc) {
+			table_->arcIsLonger(arc);
+		}
+
+		void onArcLength(const TravelNetworkIndex::ArcChange& arc) {
+			if (arc.length < arc.previousLength) {
+				table_->arcIsShorter(arc);
+			} else {
+				table_->arcIsLonger(arc);
+			}
+		}
+
+		void onLocationDel(const Id location) {
+			table_->locationIsDeleted(location);
+		}
+
+	protected:
+
+		explicit IndexTracker(LandmarkTable* table) :
+			table_(table)
+		{
+			// Nothing else to do
+		}
+
+	private:
+
+		// Not a Ptr since the table owns its tracker
+		LandmarkTable* table_;
+	};
+
+	LandmarkTable(const Ptr<TravelNetworkIndex>& index, const unsigned int landmarkCount) :
+		index_(index),
+		requestedLandmarkCount_(landmarkCount),
+		landmarksAreStale_(true),
+		rebuildCount_(0),
+		repairCount_(0)
+	{
+		tracker_ = IndexTracker::instanceNew(index, this);
+	}
+
+	~LandmarkTable() {
+		delete tracker_;
+	}
+
+private:
+
+	static double distance(const ShortestPathTree& tree, const Id location) {
+		if (location < tree.minDist.size()) {
+			return tree.minDist[location];
+		}
+
+		return ShortestPathTree::unreachableDistance();
+	}
+
+	static Id predSegment(const ShortestPathTree& tree, const Id location) {
+		if (location < tree.predSegment.size()) {
+			return tree.predSegment[location];
+		}
+
+		return TravelNetworkIndex::nullId;
+	}
+
+	/* An arc that appeared or got shorter only matters to the trees in which it now gives a shorter distance */
+	void arcIsShorter(const TravelNetworkIndex::ArcChange& arc) {
+		const auto unreachable = ShortestPathTree::unreachableDistance();
+		for (auto i = 0u; i < landmarks_.size(); i++) {
+			const auto fromSrc = distance(fromLandmark_[i], arc.source);
+			if ( (fromSrc != unreachable) && (fromSrc + arc.length < distance(fromLandmark_[i], arc.destination)) ) {
+				fromLandmarkIsStale_[i] = true;
+			}
+
+			const auto toDst = distance(toLandmark_[i], arc.destination);
+			if ( (toDst != unreachable) && (toDst + arc.length < distance(toLandmark_[i], arc.source)) ) {
+				toLandmarkIsStale_[i] = true;
+			}
+		}
+	}
+
+	/* An arc that disappeared or got longer only matters to the trees that use it */
+	void arcIsLonger(const TravelNetworkIndex::ArcChange& arc) {
+		for (auto i = 0u; i < landmarks_.size(); i++) {
+			if (predSegment(fromLandmark_[i], arc.destination) == arc.segment) {
+				fromLandmarkIsStale_[i] = true;
+			}
+
+			if (predSegment(toLandmark_[i], arc.source) == arc.segment) {
+				toLandmarkIsStale_[i] = true;
+			}
+		}
+	}
+
+	void locationIsDeleted(const Id location) {
+		for (auto i = 0u; i < landmarks_.size(); i++) {
+			if (landmarks_[i] == location) {
+				landmarksAreStale_ = true;
+			}
+		}
+	}
+
+	/* Selects the landmarks farthest-first: each landmark is the location farthest from the ones picked before it */
+	void rebuild() {
+		const auto unreachable = ShortestPathTree::unreachableDistance();
+		const auto numLocations = index_->locationIdCount();
+
+		landmarks_.clear();
+		fromLandmark_.clear();
+		toLandmark_.clear();
+
+		auto start = TravelNetworkIndex::nullId;
+		for (auto id = 0u; id < numLocations; id++) {
+			if (index_->location(id) != null) {
+				start = id;
+				break;
+			}
+		}
+
+		if ( (start != TravelNetworkIndex::nullId) && (requestedLandmarkCount_ > 0) ) {
+			// The first landmark is the location farthest from an arbitrary start
+			ShortestPathTree startTree;
+			startTree.rootIs(index_, start, ShortestPathTree::forward);
+			vector<double> minDistToLandmarks(startTree.minDist);
+
+			while (landmarks_.size() < requestedLandmarkCount_) {
+				auto next = TravelNetworkIndex::nullId;
+				auto nextDist = -1.0;
+				for (auto id = 0u; id < numLocations; id++) {
+					if ( (index_->location(id) != null) && (minDistToLandmarks[id] > nextDist) &&
+						 (std::find(landmarks_.begin(), landmarks_.end(), id) == landmarks_.end()) ) {
+						next = id;
+						nextDist = minDistToLandmarks[id];
+					}
+				}
+
+				if (next == TravelNetworkIndex::nullId) {
+					break;
+				}
+
+				landmarks_.push_back(next);
+				fromLandmark_.push_back(ShortestPathTree());
+				toLandmark_.push_back(ShortestPathTree());
+				fromLandmark_.back().rootIs(index_, next, ShortestPathTree::forward);
+				toLandmark_.back().rootIs(index_, next, ShortestPathTree::backward);
+
+				// Locations that no landmark reaches yet keep an unreachable distance and are picked first
+				if (landmarks_.size() == 1) {
+					minDistToLandmarks.assign(numLocations, unreachable);
+				}
+
+				for (auto id = 0u; id < numLocations; id++) {
+					minDistToLandmarks[id] = std::min(minDistToLandmarks[id], fromLandmark_.back().minDist[id]);
+				}
+			}
+		}
+
+		fromLandmarkIsStale_.assign(landmarks_.size(), false);
+		toLandmarkIsStale_.assign(landmarks_.size(), false);
+		landmarksAreStale_ = false;
+		rebuildCount_++;
+	}
+
+	void repair() {
+		for (auto i = 0u; i < landmarks_.size(); i++) {
+			if (fromLandmarkIsStale_[i]) {
+				fromLandmark_[i].rootIs(index_, landmarks_[i], ShortestPathTree::forward);
+				fromLandmarkIsStale_[i] = false;
+				repairCount_++;
+			}
+
+			if (toLandmarkIsStale_[i]) {
+				toLandmark_[i].rootIs(index_, landmarks_[i], ShortestPathTree::backward);
+				toLandmarkIsStale_[i] = false;
+				repairCount_++;
+			}
+		}
+	}
+
+	Ptr<TravelNetworkIndex> index_;
+	IndexTracker* tracker_;
+	unsigned int requestedLandmarkCount_;
+
+	vector<Id> landmarks_;
+	vector<ShortestPathTree> fromLandmark_;
+	vector<ShortestPathTree> toLandmark_;
+	vector<bool> fromLandmarkIsStale_;
+	vector<bool> toLandmarkIsStale_;
+	bool landmarksAreStale_;
+
+	unsigned int rebuildCount_;
+	unsigned int repairCount_;
+};
+
+#endif
@@ -0,0 +1,323 @@
+#ifndef PATH_ENUMERATION_H
+#define PATH_ENUMERATION_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "CommonLib.h"
+#include "TravelNetworkIndex.h"
+#include "WorkerPool.h"
+
+using std::vector;
+
+//=======================================================
+// PathEnumeration class
+//
+//   Enumerates every path from a location that does not
+//   go through a location twice and is no longer than a
+//   maximum length (the paths of Conn::paths()), on the
+//   workers of a WorkerPool.
+//
+//   The paths form a tree rooted at the start location,
+//   whose subtrees can differ in size by orders of
+//   magnitude, so the work is balanced by work stealing
+//   rather than split up front. Each worker walks a
+//   subtree depth-first and keeps the subtrees it has not
+//   reached yet on its stack. When another worker is
+//   idle and the worker has nothing queued, it gives away
+//   the untried arcs of the shallowest frame of its stack,
+//   the largest piece of work it holds, as a task on its
+//   own deque. Workers run their own tasks newest first
+//   and steal the oldest task of another worker. A worker
+//   that finds no task waits until one is shared or the
+//   last one is done.
+//
+//   Workers only read the index and record the paths they
+//   find as segment ids in buffers of their own, which the
+//   caller merges once run() returns. The set of paths is
+//   the same as that of a sequential enumeration, but not
+//   their order.
+//=======================================================
+
+class PathEnumeration {
+public:
+
+	typedef TravelNetworkIndex::Id Id;
+
+	/* Paths from 'start' no longer than 'maxLength'. Only counts them unless 'isCollecting'. */
+	PathEnumeration(const TravelNetworkIndex* index, const Id start, const double maxLength, const bool isCollecting) :
+		index_(index),
+		start_(start),
+		maxLength_(maxLength),
+		isCollecting_(isCollecting),
+		pendingTaskCount_(0),
+		queuedTaskCount_(0),
+		idleWorkerCount_(0)
+	{
+		// Nothing else to do
+	}
+
+	/* Enumerates the paths on the workers of 'pool', or on the calling thread if it is null */
+	void run(WorkerPool* pool) {
+		const auto workerCount = (pool != nullptr) ? pool->workerCount() : 1;
+		workers_ = vector<Worker>(workerCount);
+
+		Task root;
+		root.locations.push_back(start_);
+		root.length = 0;
+		root.firstArc = index_->outArcIter(start_);
+		root.endArc = index_->outArcIterEnd(start_);
+		pendingTaskCount_ = 1;
+		queuedTaskCount_ = 1;
+		workers_[0].tasks.push_back(root);
+		workers_[0].taskCount = 1;
+
+		if (workerCount > 1) {
+			pool->run(workerCount, [this](unsigned int w) {
+				work(w);
+			});
+		} else {
+			work(0);
+		}
+	}
+
+	unsigned int workerCount() const {
+		return workers_.size();
+	}
+
+	U64 pathCount() const {
+		auto count = U64(0);
+		for (const auto& worker : workers_) {
+			count += worker.pathCount;
+		}
+
+		return count;
+	}
+
+	/* Number of paths worker 'w' recorded. Empty unless collecting. */
+	U64 pathCount(const unsigned int w) const {
+		return workers_[w].pathEnds.size();
+	}
+
+	/* Segments of the i-th path recorded by worker 'w' */
+	vector<Id> path(const unsigned int w, const U64 i) const {
+		const auto& worker = workers_[w];
+		const auto begin = (i == 0) ? 0 : worker.pathEnds[i - 1];
+		return vector<Id>(worker.segments.begin() + begin, worker.segments.begin() + worker.pathEnds[i]);
+	}
+
+private:
+
+	/* The paths that extend the path through 'locations' by one of the arcs in [firstArc, endArc) */
+	struct Task {
+		vector<Id> locations;
+		vector<Id> segments;
+		double length;
+		const TravelNetworkIndex::Arc* firstArc;
+		const TravelNetworkIndex::Arc* endArc;
+	};
+
+	struct Frame {
+		Id location;
+		const TravelNetworkIndex::Arc* nextArc;
+		const TravelNetworkIndex::Arc* endArc;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		// Size of tasks, read without the mutex
+		std::atomic<size_t> taskCount{ 0 };
+
+		// Paths found, back to back, and where each one ends
+		vector<Id> segments;
+		vector<U64> pathEnds;
+		U64 pathCount = 0;
+	};
+
+	void work(const unsigned int w) {
+		auto& worker = workers_[w];
+		vector<bool> isOnPath(index_->locationIdCount(), false);
+		auto isIdle = false;
+		Task task;
+
+		while (true) {
+			if (taskIsPopped(w, task)) {
+				if (isIdle) {
+					isIdle = false;
+					idleWorkerCount_--;
+				}
+
+				taskRun(worker, task, isOnPath);
+				if (--pendingTaskCount_ == 0) {
+					std::lock_guard<std::mutex> lock(idleMutex_);
+					taskIsQueued_.notify_all();
+				}
+			} else if (pendingTaskCount_ == 0) {
+				break;
+			} else {
+				if (!isIdle) {
+					isIdle = true;
+					idleWorkerCount_++;
+				}
+
+				std::unique_lock<std::mutex> lock(idleMutex_);
+				taskIsQueued_.wait(lock, [this] {
+					return (queuedTaskCount_ > 0) || (pendingTaskCount_ == 0);
+				});
+			}
+		}
+
+		if (isIdle) {
+			idleWorkerCount_--;
+		}
+	}
+
+	/* The newest task of worker 'w', or else the oldest task of another worker. Empty deques are skipped 
+	   without locking them. */
+	bool taskIsPopped(const unsigned int w, Task& task) {
+		auto& worker = workers_[w];
+		if (worker.taskCount > 0) {
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			if (!worker.tasks.empty()) {
+				task = std::move(worker.tasks.back());
+				worker.tasks.pop_back();
+				worker.taskCount--;
+				queuedTaskCount_--;
+				return true;
+			}
+		}
+
+		for (auto i = 1u; i < workers_.size(); i++) {
+			auto& victim = workers_[(w + i) % workers_.size()];
+			if (victim.taskCount == 0) {
+				continue;
+			}
+
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty()) {
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				victim.taskCount--;
+				queuedTaskCount_--;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/* Depth-first walk of the paths of 'task' */
+	void taskRun(Worker& worker, Task& task, vector<bool>& isOnPath) {
+		auto& segments = task.segments;
+		const auto prefixSize = segments.size();
+		for (auto id : task.locations) {
+			isOnPath[id] = true;
+		}
+
+		vector<Frame> stack;
+		vector<double> lengths;
+		stack.push_back(Frame{ task.locations.back(), task.firstArc, task.endArc });
+		lengths.push_back(task.length);
+
+		while (!stack.empty()) {
+			if ( (idleWorkerCount_ > 0) && (workers_.size() > 1) ) {
+				taskIsShared(worker, task, stack, lengths, prefixSize);
+			}
+
+			auto& frame = stack.back();
+			if (frame.nextArc == frame.endArc) {
+				if (stack.size() > 1) {
+					isOnPath[frame.location] = false;
+					segments.pop_back();
+				}
+
+				stack.pop_back();
+				lengths.pop_back();
+				continue;
+			}
+
+			const auto arc = frame.nextArc++;
+			const auto length = lengths.back() + arc->length;
+			if ( (length <= maxLength_) && (!isOnPath[arc->location]) ) {
+				segments.push_back(arc->segment);
+				worker.pathCount++;
+				if (isCollecting_) {
+					worker.segments.insert(worker.segments.end(), segments.begin(), segments.end());
+					worker.pathEnds.push_back(worker.segments.size());
+				}
+
+				isOnPath[arc->location] = true;
+				stack.push_back(Frame{ arc->location, index_->outArcIter(arc->location), index_->outArcIterEnd(arc->location) });
+				lengths.push_back(length);
+			}
+		}
+
+		for (auto id : task.locations) {
+			isOnPath[id] = false;
+		}
+	}
+
+	/* Moves the untried arcs of the shallowest frame that has some to a new task, unless 'worker' has tasks queued */
+	void taskIsShared(Worker& worker,
+					  const Task& task,
+					  vector<Frame>& stack,
+					  const vector<double>& lengths,
+					  const size_t prefixSize) {
+		if (worker.taskCount > 0) {
+			return;
+		}
+
+		for (auto f = 0u; f < stack.size(); f++) {
+			auto& frame = stack[f];
+			if (frame.nextArc != frame.endArc) {
+				Task shared;
+				shared.locations = task.locations;
+				for (auto i = 1u; i <= f; i++) {
+					shared.locations.push_back(stack[i].location);
+				}
+
+				shared.segments.assign(task.segments.begin(), task.segments.begin() + prefixSize + f);
+				shared.length = lengths[f];
+				shared.firstArc = frame.nextArc;
+				shared.endArc = frame.endArc;
+				frame.nextArc = frame.endArc;
+
+				// Counted before it is queued, so that the thief that pops it never takes the count below 0, 
+				// and under the idle mutex, so that a worker about to wait sees it or is woken up
+				pendingTaskCount_++;
+				{
+					std::lock_guard<std::mutex> lock(idleMutex_);
+					queuedTaskCount_++;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(worker.mutex);
+					worker.tasks.push_back(std::move(shared));
+					worker.taskCount++;
+				}
+
+				taskIsQueued_.notify_one();
+				return;
+			}
+		}
+	}
+
+	const TravelNetworkIndex* index_;
+	Id start_;
+	double maxLength_;
+	bool isCollecting_;
+	vector<Worker> workers_;
+	std::atomic<unsigned int> pendingTaskCount_;
+	// Tasks in the deques of all workers
+	std::atomic<unsigned int> queuedTaskCount_;
+	std::atomic<unsigned int> idleWorkerCount_;
+	// Idle workers wait on taskIsQueued_ for a task to be shared or the last one to be done
+	std::mutex idleMutex_;
+	std::condition_variable taskIsQueued_;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef ROUTING_POLICIES_H
+#define ROUTING_POLICIES_H
+
+#include <functional>
+
+#include "CommonLib.h"
+#include "TravelNetworkIndex.h"
+#include "ValueTypes.h"
+
+//=======================================================
+// Routing policies
+//
+//   What a shortest path minimizes (weight policies) and
+//   which segments it may take (filter policies), passed
+//   as template arguments to the searches of
+//   ShortestPathTree and Conn. Every combination compiles
+//   to its own search loop, with the weight and the filter
+//   inlined: no virtual call and no dynamic_cast per arc.
+//
+//   A weight policy has
+//     double weight(const TravelNetworkIndex&,
+//                   const TravelNetworkIndex::Arc&) const
+//   returning a non-negative weight, and a filter policy
+//     bool isAllowed(const TravelNetworkIndex&,
+//                    const TravelNetworkIndex::Arc&) const.
+//   Both have a cacheKey(): a weight's gives its type and
+//   parameters, a filter's its type. Together they tell
+//   apart the shortest paths cached for different policies.
+//=======================================================
+
+//=======================================================
+// PolicyKey struct
+//    Cache key of a weight and filter combination, cheap
+//    to build and hash on every query.
+//=======================================================
+
+struct PolicyKey {
+	enum Weight : U8 {
+		lengthWeight,
+		timeWeight,
+		costWeight
+	};
+
+	enum Filter : U8 {
+		anySegment,
+		roadSegments,
+		flightSegments
+	};
+
+	PolicyKey(const Weight weight, const double roadFactor, const double flightFactor) :
+		weight(weight),
+		filter(anySegment),
+		roadFactor(roadFactor),
+		flightFactor(flightFactor)
+	{
+		// Nothing else to do
+	}
+
+	bool operator==(const PolicyKey& other) const {
+		return (weight == other.weight) && (filter == other.filter) && 
+			   (roadFactor == other.roadFactor) && (flightFactor == other.flightFactor);
+	}
+
+	Weight weight;
+	Filter filter;
+	double roadFactor;
+	double flightFactor;
+};
+
+struct PolicyKeyHash {
+	size_t operator()(const PolicyKey& key) const {
+		const std::hash<double> hashDouble;
+		size_t hash = (static_cast<size_t>(key.weight) << 8) | key.filter;
+		hash = hash * 31 + hashDouble(key.roadFactor);
+		return hash * 31 + hashDouble(key.flightFactor);
+	}
+};
+
+//=======================================================
+// LengthWeight class
+//    Miles: the weight of the default searches.
+//=======================================================
+
+class LengthWeight {
+public:
+
+	double weight(const TravelNetworkIndex& index, const TravelNetworkIndex::Arc& arc) const {
+		return arc.length;
+	}
+
+	PolicyKey cacheKey() const {
+		return PolicyKey(PolicyKey::lengthWeight, 1, 1);
+	}
+};
+
+//=======================================================
+// TimeWeight class
+//    Hours, at one speed on roads and another on flights
+//    (a car's and an airplane's, say). A speed of 0 rules
+//    out the segments it applies to.
+//=======================================================
+
+class TimeWeight {
+public:
+
+	explicit TimeWeight(const MilesPerHour& speed) :
+		TimeWeight(speed, speed)
+	{
+		// Nothing else to do
+	}
+
+	TimeWeight(const MilesPerHour& roadSpeed, const MilesPerHour& flightSpeed) :
+		roadSpeed_(roadSpeed.value()),
+		flightSpeed_(flightSpeed.value())
+	{
+		// Nothing else to do
+	}
+
+	double weight(const TravelNetworkIndex& index, const TravelNetworkIndex::Arc& arc) const {
+		return arc.length / ( (index.segmentMode(arc.segment) == TravelNetworkIndex::flight) ? flightSpeed_ : roadSpeed_ );
+	}
+
+	PolicyKey cacheKey() const {
+		return PolicyKey(PolicyKey::timeWeight, roadSpeed_, flightSpeed_);
+	}
+
+private:
+
+	double roadSpeed_;
+	double flightSpeed_;
+};
+
+//=======================================================
+// CostWeight class
+//    Dollars, at one cost per mile on roads and another
+//    on flights.
+//=======================================================
+
+class CostWeight {
+public:
+
+	explicit CostWeight(const DollarsPerMile& cost) :
+		CostWeight(cost, cost)
+	{
+		// Nothing else to do
+	}
+
+	CostWeight(const DollarsPerMile& roadCost, const DollarsPerMile& flightCost) :
+		roadCost_(roadCost.value()),
+		flightCost_(flightCost.value())
+	{
+		// Nothing else to do
+	}
+
+	double weight(const TravelNetworkIndex& index, const TravelNetworkIndex::Arc& arc) const {
+		return arc.length * ( (index.segmentMode(arc.segment) == TravelNetworkIndex::flight) ? flightCost_ : roadCost_ );
+	}
+
+	PolicyKey cacheKey() const {
+		return PolicyKey(PolicyKey::costWeight, roadCost_, flightCost_);
+	}
+
+private:
+
+	double roadCost_;
+	double flightCost_;
+};
+
+//=======================================================
+// Multimodal class
+//    Any segment: the filter of the default searches.
+//=======================================================
+
+class Multimodal {
+public:
+
+	bool isAllowed(const TravelNetworkIndex& index, const TravelNetworkIndex::Arc& arc) const {
+		return true;
+	}
+
+	PolicyKey::Filter cacheKey() const {
+		return PolicyKey::anySegment;
+	}
+};
+
+//=======================================================
+// RoadsOnly class
+//=======================================================
+
+class RoadsOnly {
+public:
+
+	bool isAllowed(const TravelNetworkIndex& index, const TravelNetworkIndex::Arc& arc) const {
+		return index.segmentMode(arc.segment) == TravelNetworkIndex::road;
+	}
+
+	PolicyKey::Filter cacheKey() const {
+		return PolicyKey::roadSegments;
+	}
+};
+
+//=======================================================
+// FlightsOnly class
+//=======================================================
+
+class FlightsOnly {
+public:
+
+	bool isAllowed(const TravelNetworkIndex& index, const TravelNetworkIndex::Arc& arc) const {
+		return index.segmentMode(arc.segment) == TravelNetworkIndex::flight;
+	}
+
+	PolicyKey::Filter cacheKey() const {
+		return PolicyKey::flightSegments;
+	}
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef SHORTEST_PATH_TREE_H
+#define SHORTEST_PATH_TREE_H
+
+#include <functional>
+#include <limits>
+#include <queue>
+#include <vector>
+
+#include "RoutingPolicies.h"
+#include "TravelNetworkIndex.h"
+
+using std::vector;
+
+//=======================================================
+// ShortestPathTree class
+//
+//   Shortest path tree of a search over a TravelNetworkIndex,
+//   kept as arrays indexed by location id. Paths are only
+//   materialized from predLocation/predSegment once a search
+//   is done.
+//
+//   A forward tree is grown over source segments from its
+//   root, so predLocation points back towards the root. A
+//   backward tree is grown over destination segments, so
+//   minDist is the distance *to* the root and predLocation
+//   is the next location on the way to it.
+//=======================================================
+
+class ShortestPathTree {
+public:
+
+	typedef TravelNetworkIndex::Id Id;
+
+	enum Direction {
+		forward,
+		backward
+	};
+
+	static double unreachableDistance() {
+		return std::numeric_limits<double>::max();
+	}
+
+	explicit ShortestPathTree(const Id numLocations = 0) :
+		minDist(numLocations, unreachableDistance()),
+		predLocation(numLocations, TravelNetworkIndex::nullId),
+		predSegment(numLocations, TravelNetworkIndex::nullId),
+		settledCount(0),
+		relaxedCount(0)
+	{
+		// Nothing else to do
+	}
+
+	/* Grows the complete tree from 'root' with a binary-heap Dijkstra, replacing the current contents */
+	void rootIs(const Ptr<TravelNetworkIndex>& index, const Id root, const Direction direction) {
+		rootIs(index, root, direction, LengthWeight(), Multimodal());
+	}
+
+	/* Grows the tree from 'root' over the arcs that 'filter' allows, minimizing 'weight' (see RoutingPolicies.h), 
+	   replacing the current contents. minDist is then in the unit of the weight. Stops once 'target' is settled, 
+	   or grows the complete tree if it is nullId. */
+	template <class Weight, class Filter>
+	void rootIs(const Ptr<TravelNetworkIndex>& index, 
+				const Id root, 
+				const Direction direction, 
+				const Weight& weight, 
+				const Filter& filter, 
+				const Id target = TravelNetworkIndex::nullId) {
+		typedef std::pair<double, Id> HeapEntry;
+		std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > heap;
+
+		const auto& networkIndex = *index.ptr();
+		const auto numLocations = index->locationIdCount();
+		minDist.assign(numLocations, unreachableDistance());
+		predLocation.assign(numLocations, TravelNetworkIndex::nullId);
+		predSegment.assign(numLocations, TravelNetworkIndex::nullId);
+		vector<bool> visited(numLocations, false);
+		settledCount = 0;
+		relaxedCount = 0;
+
+		minDist[root] = 0;
+		heap.push(HeapEntry(0, root));
+
+		while (!heap.empty()) {
+			const auto locDist = heap.top().first;
+			const auto locId = heap.top().second;
+			heap.pop();
+
+			if (visited[locId]) {
+				continue;
+			}
+
+			visited[locId] = true;
+			settledCount++;
+
+			if (locId == target) {
+				break;
+			}
+
+			const auto arcBegin = (direction == forward) ? index->outArcIter(locId) : index->inArcIter(locId);
+			const auto arcEnd = (direction == forward) ? index->outArcIterEnd(locId) : index->inArcIterEnd(locId);
+			relaxedCount += arcEnd - arcBegin;
+			for (auto arc = arcBegin; arc != arcEnd; arc++) {
+				if (!filter.isAllowed(networkIndex, *arc)) {
+					continue;
+				}
+
+				const auto tmp = locDist + weight.weight(networkIndex, *arc);
+				if ( (!visited[arc->location]) && (tmp < minDist[arc->location]) ) {
+					minDist[arc->location] = tmp;
+					predLocation[arc->location] = locId;
+					predSegment[arc->location] = arc->segment;
+					heap.push(HeapEntry(tmp, arc->location));
+				}
+			}
+		}
+	}
+
+	vector<double> minDist;
+	vector<Id> predLocation;
+	vector<Id> predSegment;
+
+	// Work of the search that grew the tree: locations settled and arcs relaxed
+	U64 settledCount;
+	U64 relaxedCount;
+};
+
+#endif
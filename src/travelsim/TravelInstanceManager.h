@@ -305,11 +305,11 @@ protected:
             }
 
             auto location = travelManager_->location(locName);
-            auto paths = conn_->paths(location, Miles(maxLength));
             string allPathsStr = "";
-            for (auto p : paths) {
-                allPathsStr += toString(p) + "\n";
-            }
+            conn_->pathsVisit(location, Miles(maxLength), [&](const vector<TravelNetworkIndex::Id>& segments, const Miles&) {
+                allPathsStr += toString(conn_->pathNew(segments)) + "\n";
+                return true;
+            });
 
             return allPathsStr;
         }
@@ -341,9 +341,8 @@ protected:
 
         string toString(const Ptr<Conn::Path>& p) const {
             string str = "";
-            auto segments = p->segments();
-            for (auto it = segments.cbegin(); it != segments.cend(); it++) {
-                auto seg = *it;
+            for (auto it = p->segmentIter(); it != p->segmentIterEnd(); it++) {
+                const auto& seg = *it;
                 str += seg->source()->name() + "(" + seg->name() + ":" + to_string(seg->length().value()) + ") ";
             }
 
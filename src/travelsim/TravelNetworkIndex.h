@@ -0,0 +1,437 @@
+#ifndef TRAVEL_NETWORK_INDEX_H
+#define TRAVEL_NETWORK_INDEX_H
+
+#include <limits>
+#include <vector>
+
+#include "CommonLib.h"
+#include "Location.h"
+#include "Segment.h"
+
+using fwk::Ptr;
+using fwk::PtrInterface;
+
+using std::vector;
+
+//=======================================================
+// TravelNetworkIndex class
+//
+//   Compact, integer-indexed view of the travel network
+//   that the search engines of Conn run on.
+//
+//   Every location and segment added to the network gets
+//   a dense id. Ids of deleted entities are reused by the
+//   next additions, so ids stay below the peak number of
+//   live entities. The adjacency of the network is kept
+//   in compressed sparse row (CSR) form, once over source
+//   segments (out arcs) and once over destination segments
+//   (in arcs).
+//
+//   The CSR arrays are rebuilt lazily: any change to the
+//   network marks the index as stale and the next call to
+//   isStaleIs(false) rebuilds them.
+//
+//   Structures derived from the index (landmark tables,
+//   cached trees, ...) can follow its changes arc by arc
+//   through TravelNetworkIndex::Notifiee.
+//=======================================================
+
+class TravelNetworkIndex : public PtrInterface {
+public:
+
+	typedef U32 Id;
+
+	/* Id of locations and segments that are not part of the index */
+	static constexpr Id nullId = std::numeric_limits<U32>::max();
+
+	/* Kind of a segment, recorded when it is added so that searches can tell roads from flights without a dynamic_cast */
+	enum SegmentMode : U8 {
+		road,
+		flight
+	};
+
+	/* One adjacency entry: the location at the other end of 'segment' and its length */
+	struct Arc {
+		Id location;
+		Id segment;
+		double length;
+	};
+
+	/* A segment seen as an arc between two indexed locations. 
+	   'source' and 'destination' are nullId while the segment does not connect two locations. */
+	struct ArcChange {
+		Id segment;
+		Id source;
+		Id destination;
+		double length;
+		double previousLength;
+	};
+
+	class Notifiee : public BaseNotifiee<TravelNetworkIndex> {
+	public:
+
+		void notifierIs(const Ptr<TravelNetworkIndex>& index) {
+			connect(index, this);
+		}
+
+		/* Notification that a segment now connects two locations of the network */
+		virtual void onArcNew(const ArcChange& arc) { }
+
+		/* Notification that a segment no longer connects the two locations given in 'arc' 
+		   (it was deleted, or one of its ends was unset or changed) */
+		virtual void onArcDel(const ArcChange& arc) { }
+
+		/* Notification that the length of a connected segment changed from arc.previousLength to arc.length */
+		virtual void onArcLength(const ArcChange& arc) { }
+
+		/* Notification that the location with the given id has left the index. 
+		   Its segments have been unlinked (and their onArcDel posted) before this. */
+		virtual void onLocationDel(const Id location) { }
+	};
+
+	static Ptr<TravelNetworkIndex> instanceNew() {
+		return new TravelNetworkIndex();
+	}
+
+protected:
+
+	typedef std::list<Notifiee*> NotifieeList;
+
+public:
+
+	Id locationId(const Ptr<Location>& location) const {
+		const auto it = locationToId_.find(location.ptr());
+		if (it != locationToId_.end()) {
+			return it->second;
+		}
+
+		return nullId;
+	}
+
+	Id segmentId(const Ptr<Segment>& segment) const {
+		const auto it = segmentToId_.find(segment.ptr());
+		if (it != segmentToId_.end()) {
+			return it->second;
+		}
+
+		return nullId;
+	}
+
+	Ptr<Location> location(const Id id) const {
+		if (id < locations_.size()) {
+			return locations_[id];
+		}
+
+		return null;
+	}
+
+	Ptr<Segment> segment(const Id id) const {
+		if (id < segments_.size()) {
+			return segments_[id];
+		}
+
+		return null;
+	}
+
+	SegmentMode segmentMode(const Id id) const {
+		return segmentModes_[id];
+	}
+
+	/* Upper bound (exclusive) on location ids. Arrays indexed by location id should have this size. */
+	Id locationIdCount() const {
+		return locations_.size();
+	}
+
+	/* Upper bound (exclusive) on segment ids. Arrays indexed by segment id should have this size. */
+	Id segmentIdCount() const {
+		return segments_.size();
+	}
+
+	const Arc* outArcIter(const Id id) const {
+		return outArcs_.data() + outArcOffsets_[id];
+	}
+
+	const Arc* outArcIterEnd(const Id id) const {
+		return outArcs_.data() + outArcOffsets_[id + 1];
+	}
+
+	const Arc* inArcIter(const Id id) const {
+		return inArcs_.data() + inArcOffsets_[id];
+	}
+
+	const Arc* inArcIterEnd(const Id id) const {
+		return inArcs_.data() + inArcOffsets_[id + 1];
+	}
+
+	unsigned int arcCount() const {
+		return outArcs_.size();
+	}
+
+	/* Number of times the CSR arrays have been rebuilt */
+	U64 version() const {
+		return version_;
+	}
+
+	bool isStale() const {
+		return isStale_;
+	}
+
+	/* Marking the index as not stale rebuilds the CSR arrays from the current network */
+	void isStaleIs(bool b) {
+		if (isStale_ != b) {
+			if (!b) {
+				rebuild();
+			}
+
+			isStale_ = b;
+		}
+	}
+
+	void locationNew(const Ptr<Location>& location) {
+		if (locationId(location) == nullId) {
+			locationToId_[location.ptr()] = newId(locations_, freeLocationIds_, location);
+			isStaleIs(true);
+		}
+	}
+
+	void locationDel(const Ptr<Location>& location) {
+		const auto it = locationToId_.find(location.ptr());
+		if (it != locationToId_.end()) {
+			const auto id = it->second;
+			locations_[id] = null;
+			freeLocationIds_.push_back(id);
+			locationToId_.erase(it);
+			isStaleIs(true);
+			post(this, &Notifiee::onLocationDel, id);
+		}
+	}
+
+	void segmentNew(const Ptr<Segment>& segment, const SegmentMode mode) {
+		if (segmentId(segment) == nullId) {
+			const auto id = newId(segments_, freeSegmentIds_, segment);
+			segmentToId_[segment.ptr()] = id;
+			segmentToTracker_[segment.ptr()] = SegmentTracker::instanceNew(segment, this);
+
+			if (segmentArcs_.size() < segments_.size()) {
+				segmentArcs_.resize(segments_.size());
+				segmentModes_.resize(segments_.size());
+			}
+
+			segmentModes_[id] = mode;
+			segmentArcs_[id] = ArcChange { id, nullId, nullId, segment->length().value(), segment->length().value() };
+			arcIs(segment);
+			isStaleIs(true);
+		}
+	}
+
+	void segmentDel(const Ptr<Segment>& segment) {
+		const auto it = segmentToId_.find(segment.ptr());
+		if (it != segmentToId_.end()) {
+			const auto arc = segmentArcs_[it->second];
+			segmentArcs_[it->second].source = nullId;
+			segmentArcs_[it->second].destination = nullId;
+			if ( (arc.source != nullId) && (arc.destination != nullId) ) {
+				post(this, &Notifiee::onArcDel, arc);
+			}
+
+			segments_[it->second] = null;
+			freeSegmentIds_.push_back(it->second);
+			segmentToId_.erase(it);
+
+			const auto trackerIt = segmentToTracker_.find(segment.ptr());
+			delete trackerIt->second;
+			segmentToTracker_.erase(trackerIt);
+
+			isStaleIs(true);
+		}
+	}
+
+	/* The arc that the segment with the given id currently forms, as last reported to notifiees */
+	ArcChange arc(const Id segmentId) const {
+		return segmentArcs_[segmentId];
+	}
+
+	NotifieeList& notifiees() {
+		return notifiees_;
+	}
+
+	TravelNetworkIndex(const TravelNetworkIndex&) = delete;
+
+	void operator =(const TravelNetworkIndex&) = delete;
+	void operator ==(const TravelNetworkIndex&) = delete;
+
+protected:
+
+	NotifieeList notifiees_;
+
+	//=======================================================
+	// SegmentTracker class
+	//    Updates the arc of an indexed segment whenever the
+	//    segment is rewired or its length changes.
+	//=======================================================
+
+	class SegmentTracker : public Segment::Notifiee {
+	public:
+
+		static SegmentTracker* instanceNew(const Ptr<Segment>& segment, TravelNetworkIndex* index) {
+			const auto tracker = new SegmentTracker(index);
+			tracker->notifierIs(segment);
+			return tracker;
+		}
+
+		void onSource() {
+			index_->arcIs(notifier());
+		}
+
+		void onDestination() {
+			index_->arcIs(notifier());
+		}
+
+		void onLength() {
+			index_->arcIs(notifier());
+		}
+
+	protected:
+
+		explicit SegmentTracker(TravelNetworkIndex* index) :
+			index_(index)
+		{
+			// Nothing else to do
+		}
+
+	private:
+
+		// Not a Ptr since the index owns its trackers
+		TravelNetworkIndex* index_;
+	};
+
+	TravelNetworkIndex() :
+		outArcOffsets_(1, 0),
+		inArcOffsets_(1, 0),
+		version_(0),
+		isStale_(false)
+	{
+		// Nothing else to do
+	}
+
+	~TravelNetworkIndex() {
+		for (auto it = segmentToTracker_.begin(); it != segmentToTracker_.end(); it++) {
+			delete it->second;
+		}
+	}
+
+private:
+
+	template<class T>
+	static Id newId(vector< Ptr<T> >& entities, vector<Id>& freeIds, const Ptr<T>& entity) {
+		if (freeIds.size() > 0) {
+			const auto id = freeIds.back();
+			freeIds.pop_back();
+			entities[id] = entity;
+			return id;
+		}
+
+		entities.push_back(entity);
+		return entities.size() - 1;
+	}
+
+	/* Brings the recorded arc of 'segment' in line with its current ends and length, notifying the changes */
+	void arcIs(const Ptr<Segment>& segment) {
+		const auto id = segmentId(segment);
+		if (id == nullId) {
+			return;
+		}
+
+		const auto prev = segmentArcs_[id];
+		const auto curr = ArcChange { id, locationId(segment->source()), locationId(segment->destination()), 
+									  segment->length().value(), prev.length };
+		const bool wasLinked = (prev.source != nullId) && (prev.destination != nullId);
+		const bool isLinked = (curr.source != nullId) && (curr.destination != nullId);
+
+		segmentArcs_[id] = curr;
+
+		if ( (wasLinked) && (isLinked) && (prev.source == curr.source) && (prev.destination == curr.destination) ) {
+			if (prev.length != curr.length) {
+				isStaleIs(true);
+				post(this, &Notifiee::onArcLength, curr);
+			}
+
+			return;
+		}
+
+		if ( (wasLinked) || (isLinked) ) {
+			isStaleIs(true);
+		}
+
+		if (wasLinked) {
+			post(this, &Notifiee::onArcDel, prev);
+		}
+
+		if (isLinked) {
+			post(this, &Notifiee::onArcNew, curr);
+		}
+	}
+
+	void rebuild() {
+		const auto numLocations = locationIdCount();
+
+		outArcOffsets_.assign(numLocations + 1, 0);
+		inArcOffsets_.assign(numLocations + 1, 0);
+		outArcs_.clear();
+
+		// Out arcs are laid out location by location, in the order of Location::sourceSegments
+		for (auto id = 0u; id < numLocations; id++) {
+			const auto loc = locations_[id];
+			if (loc != null) {
+				for (auto it = loc->sourceSegmentIter(); it != loc->sourceSegmentIterEnd(); it++) {
+					const auto seg = (*it).ptr();
+					const auto segIt = segmentToId_.find(seg);
+					const auto dstIt = locationToId_.find(seg->destination().ptr());
+					if ( (segIt != segmentToId_.end()) && (dstIt != locationToId_.end()) ) {
+						outArcs_.push_back(Arc { dstIt->second, segIt->second, seg->length().value() });
+						inArcOffsets_[dstIt->second + 1]++;
+					}
+				}
+			}
+
+			outArcOffsets_[id + 1] = outArcs_.size();
+		}
+
+		// In arcs are bucketed by destination with a counting sort over the out arcs
+		for (auto id = 0u; id < numLocations; id++) {
+			inArcOffsets_[id + 1] += inArcOffsets_[id];
+		}
+
+		inArcs_.resize(outArcs_.size());
+		vector<U32> nextInArc(inArcOffsets_.begin(), inArcOffsets_.end() - 1);
+		for (auto id = 0u; id < numLocations; id++) {
+			for (auto arc = outArcIter(id); arc != outArcIterEnd(id); arc++) {
+				inArcs_[nextInArc[arc->location]++] = Arc { id, arc->segment, arc->length };
+			}
+		}
+
+		version_++;
+	}
+
+	vector< Ptr<Location> > locations_;
+	vector< Ptr<Segment> > segments_;
+	vector<Id> freeLocationIds_;
+	vector<Id> freeSegmentIds_;
+	unordered_map<const Location*, Id> locationToId_;
+	unordered_map<const Segment*, Id> segmentToId_;
+	unordered_map<const Segment*, SegmentTracker*> segmentToTracker_;
+	vector<ArcChange> segmentArcs_;
+	vector<SegmentMode> segmentModes_;
+
+	vector<U32> outArcOffsets_;
+	vector<Arc> outArcs_;
+	vector<U32> inArcOffsets_;
+	vector<Arc> inArcs_;
+
+	U64 version_;
+	bool isStale_;
+};
+
+constexpr TravelNetworkIndex::Id TravelNetworkIndex::nullId;
+
+#endif
@@ -8,6 +8,7 @@
 #include "Location.h"
 #include "SegmentImpl.h"
 #include "Flight.h"
+#include "TravelNetworkIndex.h"
 #include "Vehicle.h"
 #include "Trip.h"
 
@@ -48,6 +49,7 @@ bool isCar(const Ptr<Vehicle>& vehicle) {
 //=======================================================
 
 class TravelNetworkTracker;
+class TravelNetworkIndexTracker;
 
 class TravelNetworkManager : public NamedInterface {
 public:
@@ -170,6 +172,16 @@ public:
 		return stats_;
 	}
 
+	/* Compact index of the network that the search engines of Conn run on. 
+	   It is rebuilt here if the network has changed since it was last built. */
+	Ptr<TravelNetworkIndex> index() {
+		if (index_->isStale()) {
+			index_->isStaleIs(false);
+		}
+
+		return index_;
+	}
+
 	locationConstIter locationIter() {
 		return locationMap_.cbegin();
 	}
@@ -208,8 +220,6 @@ public:
 		const auto airport = Airport::instanceNew(name);
 		locationMap_.insert(LocationMap::value_type(name, airport));
 
-		conn_->pathCacheIsEmpty();
-
 		post(this, &Notifiee::onAirportNew, airport);
 
 		return airport;
@@ -221,8 +231,6 @@ public:
 		const auto residence = Residence::instanceNew(name);
 		locationMap_.insert(LocationMap::value_type(name, residence));
 
-		conn_->pathCacheIsEmpty();
-
 		post(this, &Notifiee::onResidenceNew, residence);
 
 		return residence;
@@ -234,8 +242,6 @@ public:
 		const auto flight = Flight::instanceNew(name);
 		segmentMap_.insert(SegmentMap::value_type(name, flight));
 
-		conn_->pathCacheIsEmpty();
-
 		post(this, &Notifiee::onFlightNew, flight);
 
 		return flight;
@@ -247,8 +253,6 @@ public:
 		const auto road = Road::instanceNew(name);
 		segmentMap_.insert(SegmentMap::value_type(name, road));
 
-		conn_->pathCacheIsEmpty();
-
 		post(this, &Notifiee::onRoadNew, road);
 
 		return road;
@@ -463,6 +467,8 @@ private:
 	TripMap tripMap_;
 	Ptr<Conn> conn_;
 	Ptr<TravelNetworkTracker> stats_;
+	Ptr<TravelNetworkIndex> index_;
+	Ptr<TravelNetworkIndexTracker> indexTracker_;
 };
 
 //=======================================================
@@ -698,6 +704,56 @@ private:
 	string name_;
 };
 
+//=======================================================
+// TravelNetworkIndexTracker class
+//    Merely trampolines additions and deletions of locations
+//    and segments in the travel network to its index.
+//=======================================================
+
+class TravelNetworkIndexTracker : public TravelNetworkManager::Notifiee {
+public:
+
+	static Ptr<TravelNetworkIndexTracker> instanceNew(const Ptr<TravelNetworkIndex>& index) {
+		return new TravelNetworkIndexTracker(index);
+	}
+
+	void onResidenceNew(const Ptr<Residence>& residence) {
+		index_->locationNew(residence);
+	}
+
+	void onAirportNew(const Ptr<Airport>& airport) {
+		index_->locationNew(airport);
+	}
+
+	void onFlightNew(const Ptr<Flight>& flight) {
+		index_->segmentNew(flight, TravelNetworkIndex::flight);
+	}
+
+	void onRoadNew(const Ptr<Road>& road) {
+		index_->segmentNew(road, TravelNetworkIndex::road);
+	}
+
+	void onLocationDel(const Ptr<Location>& location) {
+		index_->locationDel(location);
+	}
+
+	void onSegmentDel(const Ptr<Segment>& segment) {
+		index_->segmentDel(segment);
+	}
+
+protected:
+
+	explicit TravelNetworkIndexTracker(const Ptr<TravelNetworkIndex>& index) :
+		index_(index)
+	{
+		// Nothing else to do
+	}
+
+private:
+
+	Ptr<TravelNetworkIndex> index_;
+};
+
 TravelNetworkManager::TravelNetworkManager(const string& name) :
 	NamedInterface(name)
 {
@@ -705,6 +761,10 @@ TravelNetworkManager::TravelNetworkManager(const string& name) :
 	conn_ = Conn::instanceNew("", this);
 	stats_ = TravelNetworkTracker::instanceNew("");
 	stats_->notifierIs(this);
+	index_ = TravelNetworkIndex::instanceNew();
+	indexTracker_ = TravelNetworkIndexTracker::instanceNew(index_);
+	indexTracker_->notifierIs(this);
+	conn_->indexIs(index_);
 }
 
 //=======================================================
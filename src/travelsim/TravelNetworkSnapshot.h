@@ -0,0 +1,250 @@
+#ifndef TRAVEL_NETWORK_SNAPSHOT_H
+#define TRAVEL_NETWORK_SNAPSHOT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include "CommonLib.h"
+#include "ShortestPathTree.h"
+#include "TravelNetworkIndex.h"
+
+using fwk::Ptr;
+
+using std::vector;
+
+//=======================================================
+// TravelNetworkSnapshot class
+//
+//   Immutable copy of the travel network, as of one
+//   version of the TravelNetworkIndex, for threads other
+//   than the one that changes the network.
+//
+//   The writer publishes snapshots through
+//   Conn::snapshotNew() and readers pick up the latest
+//   one with Conn::snapshot(), in the style of RCU: a
+//   published snapshot is never changed, and it is freed
+//   once the last reader lets go of it. Readers therefore
+//   neither block on nor race with changes to the
+//   network; they see them with their next snapshot.
+//
+//   Snapshots hold names and ids rather than fwk::Ptrs,
+//   whose reference counts are not thread-safe, and are
+//   shared with std::shared_ptr for the same reason.
+//
+//   Each snapshot caches the reverse shortest path trees
+//   grown by its queries, so that later queries to the
+//   same destination only walk the tree. The cache is
+//   split in shards by destination, each behind its own
+//   mutex, and never needs invalidation since the
+//   network it describes never changes.
+//=======================================================
+
+class TravelNetworkSnapshot {
+public:
+
+	typedef TravelNetworkIndex::Id Id;
+
+	/* A path found on a snapshot. 'locations' has one more entry than 'segments' (the destination). */
+	struct Path {
+		vector<string> locations;
+		vector<string> segments;
+		double length;
+	};
+
+	/* Snapshot of the current state of 'index', keeping up to 'treeCapacity' reverse trees */
+	static std::shared_ptr<const TravelNetworkSnapshot> instanceNew(const Ptr<TravelNetworkIndex>& index,
+																	 const unsigned int treeCapacity) {
+		return std::shared_ptr<const TravelNetworkSnapshot>(new TravelNetworkSnapshot(index, treeCapacity));
+	}
+
+	/* Version of the index the snapshot was taken from (TravelNetworkIndex::version()) */
+	U64 version() const {
+		return version_;
+	}
+
+	/* Upper bound (exclusive) on location ids, as in TravelNetworkIndex */
+	Id locationIdCount() const {
+		return locationNames_.size();
+	}
+
+	/* Name of the location with the given id, empty if the id was free in the index */
+	const string& locationName(const Id id) const {
+		return locationNames_[id];
+	}
+
+	Id locationId(const string& name) const {
+		const auto it = locationIds_.find(name);
+		if (it != locationIds_.end()) {
+			return it->second;
+		}
+
+		return TravelNetworkIndex::nullId;
+	}
+
+	/* Shortest path between two locations of the snapshot. Null if either is not part of it, or if there
+	   is no path. The path is empty if they are the same. Safe to call from any number of threads. */
+	std::shared_ptr<const Path> shortestPath(const string& source, const string& destination) const {
+		const auto sourceId = locationId(source);
+		const auto destId = locationId(destination);
+		if ( (sourceId == TravelNetworkIndex::nullId) || (destId == TravelNetworkIndex::nullId) ) {
+			return nullptr;
+		}
+
+		const auto tree = reverseTree(destId);
+		if ( (sourceId != destId) && (tree->predSegment[sourceId] == TravelNetworkIndex::nullId) ) {
+			return nullptr;
+		}
+
+		const auto p = std::make_shared<Path>();
+		p->length = tree->minDist[sourceId];
+		for (auto id = sourceId; id != destId; id = tree->predLocation[id]) {
+			p->locations.push_back(locationNames_[id]);
+			p->segments.push_back(segmentNames_[tree->predSegment[id]]);
+		}
+
+		p->locations.push_back(locationNames_[destId]);
+
+		return p;
+	}
+
+	/* Number of queries answered by a tree already in the cache */
+	unsigned int hitCount() const {
+		return hitCount_;
+	}
+
+	/* Number of queries that grew a tree */
+	unsigned int missCount() const {
+		return missCount_;
+	}
+
+	/* Complete reverse tree of 'destId', grown now and not cached. Binary-heap Dijkstra over destination segments, 
+	   so predLocation is the next location towards 'destId'. Safe to call from any number of threads. */
+	std::shared_ptr<const ShortestPathTree> reverseTreeNew(const Id destId) const {
+		typedef std::pair<double, Id> HeapEntry;
+		std::priority_queue< HeapEntry, vector<HeapEntry>, std::greater<HeapEntry> > heap;
+
+		const auto tree = std::make_shared<ShortestPathTree>(locationIdCount());
+		vector<bool> visited(locationIdCount(), false);
+
+		tree->minDist[destId] = 0;
+		heap.push(HeapEntry(0, destId));
+
+		while (!heap.empty()) {
+			const auto locDist = heap.top().first;
+			const auto locId = heap.top().second;
+			heap.pop();
+
+			if (visited[locId]) {
+				continue;
+			}
+
+			visited[locId] = true;
+
+			for (auto i = inArcOffsets_[locId]; i < inArcOffsets_[locId + 1]; i++) {
+				const auto& arc = inArcs_[i];
+				const auto tmp = locDist + arc.length;
+				if ( (!visited[arc.location]) && (tmp < tree->minDist[arc.location]) ) {
+					tree->minDist[arc.location] = tmp;
+					tree->predLocation[arc.location] = locId;
+					tree->predSegment[arc.location] = arc.segment;
+					heap.push(HeapEntry(tmp, arc.location));
+				}
+			}
+		}
+
+		return tree;
+	}
+
+	TravelNetworkSnapshot(const TravelNetworkSnapshot&) = delete;
+
+	void operator =(const TravelNetworkSnapshot&) = delete;
+	void operator ==(const TravelNetworkSnapshot&) = delete;
+
+protected:
+
+	static const unsigned int shardCount = 16;
+
+	struct TreeShard {
+		std::mutex mutex;
+		unordered_map< Id, std::shared_ptr<const ShortestPathTree> > trees;
+	};
+
+	/* Copies the arcs and names of 'index' as they are now. Runs on the writer thread. */
+	TravelNetworkSnapshot(const Ptr<TravelNetworkIndex>& index, const unsigned int treeCapacity) :
+		shardCapacity_((treeCapacity + shardCount - 1) / shardCount),
+		hitCount_(0),
+		missCount_(0)
+	{
+		if (index->isStale()) {
+			index->isStaleIs(false);
+		}
+
+		version_ = index->version();
+
+		const auto numLocations = index->locationIdCount();
+		locationNames_.resize(numLocations);
+		inArcOffsets_.assign(1, 0);
+		for (auto id = 0u; id < numLocations; id++) {
+			const auto loc = index->location(id);
+			if (loc != null) {
+				locationNames_[id] = loc->name();
+				locationIds_[loc->name()] = id;
+			}
+
+			inArcs_.insert(inArcs_.end(), index->inArcIter(id), index->inArcIterEnd(id));
+			inArcOffsets_.push_back(inArcs_.size());
+		}
+
+		segmentNames_.resize(index->segmentIdCount());
+		for (auto id = 0u; id < index->segmentIdCount(); id++) {
+			const auto seg = index->segment(id);
+			if (seg != null) {
+				segmentNames_[id] = seg->name();
+			}
+		}
+	}
+
+private:
+
+	/* Complete reverse tree of 'destId', from the cache or grown now. Two readers missing the same
+	   destination at once both grow it, and the first one to finish caches it. */
+	std::shared_ptr<const ShortestPathTree> reverseTree(const Id destId) const {
+		auto& shard = shards_[destId % shardCount];
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			const auto it = shard.trees.find(destId);
+			if (it != shard.trees.end()) {
+				hitCount_++;
+				return it->second;
+			}
+		}
+
+		missCount_++;
+		const auto tree = reverseTreeNew(destId);
+
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		if (shard.trees.size() < shardCapacity_) {
+			return shard.trees.insert(std::make_pair(destId, tree)).first->second;
+		}
+
+		return tree;
+	}
+
+	U64 version_;
+	vector<string> locationNames_;
+	vector<string> segmentNames_;
+	unordered_map<string, Id> locationIds_;
+	vector<U32> inArcOffsets_;
+	vector<TravelNetworkIndex::Arc> inArcs_;
+
+	// The only state that changes after publication
+	unsigned int shardCapacity_;
+	mutable TreeShard shards_[shardCount];
+	mutable std::atomic<unsigned int> hitCount_;
+	mutable std::atomic<unsigned int> missCount_;
+};
+
+#endif
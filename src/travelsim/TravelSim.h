@@ -324,30 +324,42 @@ public:
 	Ptr<TripSim> tripNew(const string& name, 
 					     const Ptr<Location>& startLocation, 
 					     const Ptr<Location>& destination) {
+		Ptr<Conn::Path> shortestPath;
+		if (startLocation != destination) {
+			shortestPath = travelNetworkManager_->conn()->shortestPath(startLocation, destination);
+		}
+
+		return tripNew(name, startLocation, destination, shortestPath);
+	}
+
+	/* Same as above, with the shortest path from 'startLocation' to 'destination' already found (null if there is none) */
+	Ptr<TripSim> tripNew(const string& name, 
+					     const Ptr<Location>& startLocation, 
+					     const Ptr<Location>& destination, 
+					     const Ptr<Conn::Path>& shortestPath) {
 		if (startLocation != destination) {
 			const Ptr<Trip> trip = travelNetworkManager_->tripNew(name);
 			trip->startLocationIs(startLocation);
 			trip->destinationIs(destination);
 
-			const auto conn = travelNetworkManager_->conn();
-			const auto shortestPath = conn->shortestPath(startLocation, destination);
 			if (shortestPath == null) {
 				logEntryNew(notifier()->manager()->now(), "[" + name + "] Aborting trip from '" + 
 							startLocation->name() + "' to '" + destination->name() + "' since no path exists.");
 				return null;
 			}
 
-			trip->pathIs(conn->shortestPath(startLocation, destination));
+			trip->pathIs(shortestPath);
 			trip->timeOfRequestIs(activityManager_->now());
 			
-			const auto nearestVehicle = vehicleManager_->nearestVehicle(startLocation);
+			const auto dispatch = vehicleManager_->nearestVehicleDispatch(startLocation);
+			const auto nearestVehicle = dispatch.first;
 			if (nearestVehicle == null) {
 				pendingTripRequests_.push_back(trip);
 				return null;
 			}
 
 			trip->vehicleIs(nearestVehicle);
-			trip->distanceOfVehicleDispatchIs(conn->shortestPath(nearestVehicle->location(), startLocation)->length());
+			trip->distanceOfVehicleDispatchIs(dispatch.second);
 			nearestVehicle->statusIs(Vehicle::assignedForTrip);
 
 			return createTripSim(name, trip);
@@ -401,12 +413,12 @@ protected:
 			const auto it = pendingTripRequests_.begin();
 			auto trip = *it;
 
-			const auto nearestVehicle = vehicleManager_->nearestVehicle(trip->startLocation());
+			const auto dispatch = vehicleManager_->nearestVehicleDispatch(trip->startLocation());
+			const auto nearestVehicle = dispatch.first;
 			trip->vehicleIs(nearestVehicle);
 			nearestVehicle->statusIs(Vehicle::assignedForTrip);
 
-			const auto conn = travelNetworkManager_->conn();
-			trip->distanceOfVehicleDispatchIs(conn->shortestPath(nearestVehicle->location(), trip->startLocation())->length());
+			trip->distanceOfVehicleDispatchIs(dispatch.second);
 			
 			pendingTripRequests_.erase(it);
 
@@ -494,15 +506,22 @@ void TripGenerator::onStatus() {
 
 			logEntryNew(a->manager()->now(), "Generating " + std::to_string(numTrips) + " trips");
 
+			vector<Conn::LocationPair> trips;
 			for (auto i = 0u; i < numTrips; i++) {
-				const auto tripName = "TripSim-" + std::to_string(nextTripId_);
 				const auto source = locAndSegMgr->locationRandom();
 				const auto destination = locAndSegMgr->locationRandom();
+				trips.push_back(Conn::LocationPair(source, destination));
+			}
+
+			// All the trips of a tick are routed in one batch. Each request is still logged right before its trip.
+			const auto shortestPaths = travelNetworkMgr->conn()->shortestPaths(trips);
 
+			for (auto i = 0u; i < numTrips; i++) {
+				const auto tripName = "TripSim-" + std::to_string(nextTripId_);
 				logEntryNew(a->manager()->now(), "[" + tripName + "] Requesting for a trip from '" + 
-							source->name() + "' to '" + destination->name() + "'");
+							trips[i].first->name() + "' to '" + trips[i].second->name() + "'");
 
-				travelSim_->tripNew(tripName, source, destination);
+				travelSim_->tripNew(tripName, trips[i].first, trips[i].second, shortestPaths[i]);
 
 				a->nextTimeIsOffset(nextTimeOffset());
 				nextTripId_++;
@@ -557,6 +576,13 @@ void NetworkModifier::onStatus() {
 	if (a->status() == Activity::running) {
 		this->residenceDel();
 		this->segmentDel();
+
+		// Readers of snapshots see the changes once a new one is published
+		const auto conn = travelSim_->travelNetworkManager()->conn();
+		if ( (conn->snapshot() != nullptr) && (conn->isSnapshotStale()) ) {
+			conn->snapshotNew();
+		}
+
 		a->nextTimeIsOffset(nextTimeOffset());
 	}
 }
@@ -53,31 +53,40 @@ public:
 	static Ptr<VehicleManager> instanceNew(const string& name, const Ptr<TravelSim>& travelSim);
 
 	Ptr<Vehicle> nearestVehicle(const Ptr<Location>& loc) {
-		if (vehiclesAvailForTrip_.size() == 0) {
-			return null;
+		return nearestVehicleDispatch(loc).first;
+	}
+
+	/* Nearest available vehicle to 'loc' along with the length of its shortest path to 'loc'. 
+	   Vehicles at the same distance are picked by name. */
+	std::pair< Ptr<Vehicle>, Miles > nearestVehicleDispatch(const Ptr<Location>& loc) {
+		const auto noVehicle = std::make_pair(Ptr<Vehicle>(null), Miles(0));
+		if ( (vehiclesAvailForTrip_.size() == 0) || (loc == null) ) {
+			return noVehicle;
 		}
 
 		const auto travelNetworkManager = notifier();
 		const auto conn = travelNetworkManager->conn();
-		Ptr<Conn::Path> pathFromNearestVehicleToLoc = null;
-		Ptr<Vehicle> nearestVehicle = null;
 
+		// The first vehicle seen at a location is the one with the smallest name, since the set is ordered
+		vector< Ptr<Location> > vehicleLocations;
+		unordered_map< const Location*, Ptr<Vehicle> > vehicleAtLocation;
 		for (auto it = vehiclesAvailForTrip_.begin(); it != vehiclesAvailForTrip_.end(); it++) {
-			const auto vehicleName = *it;
-			const auto vehicle = travelNetworkManager->vehicle(vehicleName);
-			const auto p = conn->shortestPath(vehicle->location(), loc);
-			if ( (p != null) && (vehicle->speed().value() > 0) ) {
-				if (pathFromNearestVehicleToLoc == null) {
-					pathFromNearestVehicleToLoc = p;
-					nearestVehicle = vehicle;
-				} else if (pathFromNearestVehicleToLoc->length() > p->length()) {
-					pathFromNearestVehicleToLoc = p;
-					nearestVehicle = vehicle;
-				}
+			const auto vehicle = travelNetworkManager->vehicle(*it);
+			const auto location = vehicle->location();
+			if ( (location != null) && (vehicle->speed().value() > 0) && 
+				 (vehicleAtLocation.find(location.ptr()) == vehicleAtLocation.end()) ) {
+				vehicleAtLocation[location.ptr()] = vehicle;
+				vehicleLocations.push_back(location);
 			}
 		}
 
-		return nearestVehicle;
+		// Only the distance is needed, so the path itself is never built
+		const auto nearest = conn->distanceFromNearest(vehicleLocations, loc);
+		if (nearest.first == null) {
+			return noVehicle;
+		}
+
+		return std::make_pair(vehicleAtLocation[nearest.first.ptr()], nearest.second);
 	}
 
 	unsigned int availableVehicleCount() const {
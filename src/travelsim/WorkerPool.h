@@ -0,0 +1,170 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CommonLib.h"
+
+using fwk::Ptr;
+using fwk::PtrInterface;
+
+using std::vector;
+
+//=======================================================
+// WorkerPool class
+//
+//   Fixed set of threads that run the tasks of a batch
+//   together with the calling thread. run() hands out the
+//   task indexes one at a time, so that long and short
+//   tasks even out across the workers, and only returns
+//   once every task of the batch is done.
+//
+//   fwk::Ptr reference counts are not thread-safe: tasks
+//   must not copy or release Ptrs to objects that other
+//   tasks or the calling thread can reach. They should
+//   read shared state through plain pointers and leave
+//   their results in slots of their own.
+//=======================================================
+
+class WorkerPool : public PtrInterface {
+public:
+
+	typedef std::function<void (unsigned int)> Task;
+
+	/* A pool of 'workerCount' workers, the thread calling run() being one of them */
+	static Ptr<WorkerPool> instanceNew(const unsigned int workerCount) {
+		return new WorkerPool(workerCount);
+	}
+
+	unsigned int workerCount() const {
+		return threads_.size() + 1;
+	}
+
+	/* Runs task(0), ..., task(taskCount - 1) on the workers */
+	void run(const unsigned int taskCount, const Task& task) {
+		if (taskCount == 0) {
+			return;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			task_ = &task;
+			taskCount_ = taskCount;
+			nextTask_ = 0;
+			doneTaskCount_ = 0;
+			isBatchOpen_ = true;
+			batch_++;
+		}
+
+		batchIsOpen_.notify_all();
+		tasksRun(task, taskCount);
+
+		// Workers still in the batch hold a pointer to 'task', so they all have to leave it first
+		std::unique_lock<std::mutex> lock(mutex_);
+		batchIsDone_.wait(lock, [this] { return (doneTaskCount_ == taskCount_) && (activeWorkerCount_ == 0); });
+		isBatchOpen_ = false;
+		task_ = nullptr;
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+
+	void operator =(const WorkerPool&) = delete;
+	void operator ==(const WorkerPool&) = delete;
+
+protected:
+
+	explicit WorkerPool(const unsigned int workerCount) :
+		task_(nullptr),
+		taskCount_(0),
+		nextTask_(0),
+		doneTaskCount_(0),
+		activeWorkerCount_(0),
+		batch_(0),
+		isBatchOpen_(false),
+		isStopping_(false)
+	{
+		for (auto i = 1u; i < workerCount; i++) {
+			threads_.push_back(std::thread(&WorkerPool::work, this));
+		}
+	}
+
+	~WorkerPool() {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			isStopping_ = true;
+		}
+
+		batchIsOpen_.notify_all();
+		for (auto& thread : threads_) {
+			thread.join();
+		}
+	}
+
+private:
+
+	void work() {
+		U64 lastBatch = 0;
+		while (true) {
+			const Task* task;
+			unsigned int taskCount;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				batchIsOpen_.wait(lock, [&] { return (isStopping_) || ( (isBatchOpen_) && (batch_ != lastBatch) ); });
+				if (isStopping_) {
+					return;
+				}
+
+				lastBatch = batch_;
+				task = task_;
+				taskCount = taskCount_;
+				activeWorkerCount_++;
+			}
+
+			tasksRun(*task, taskCount);
+
+			std::unique_lock<std::mutex> lock(mutex_);
+			activeWorkerCount_--;
+			if (activeWorkerCount_ == 0) {
+				batchIsDone_.notify_all();
+			}
+		}
+	}
+
+	void tasksRun(const Task& task, const unsigned int taskCount) {
+		auto doneTaskCount = 0u;
+		for (auto i = nextTask_++; i < taskCount; i = nextTask_++) {
+			task(i);
+			doneTaskCount++;
+		}
+
+		if (doneTaskCount > 0) {
+			std::unique_lock<std::mutex> lock(mutex_);
+			doneTaskCount_ += doneTaskCount;
+			if (doneTaskCount_ == taskCount_) {
+				batchIsDone_.notify_all();
+			}
+		}
+	}
+
+	vector<std::thread> threads_;
+	std::mutex mutex_;
+	std::condition_variable batchIsOpen_;
+	std::condition_variable batchIsDone_;
+
+	// The batch being run. Written under mutex_, except nextTask_ which the workers draw from.
+	const Task* task_;
+	unsigned int taskCount_;
+	std::atomic<unsigned int> nextTask_;
+	unsigned int doneTaskCount_;
+	unsigned int activeWorkerCount_;
+	U64 batch_;
+	bool isBatchOpen_;
+	bool isStopping_;
+};
+
+#endif
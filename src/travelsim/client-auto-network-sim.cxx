@@ -6,6 +6,7 @@
 
 #include <ostream>
 #include <iostream>
+#include <sstream>
 
 using std::cout;
 using std::cerr;
@@ -73,10 +74,16 @@ void populateNetwork(unsigned int seed,
 void runSimulation(int numResidences, int numRoads,
 				   int numCars, int enableNetworkModification,
 				   int seed, unsigned int totalTimeInMins,
-				   int enableShortestPathCaching) {
+				   int enableShortestPathCaching, int staticNetworkEngine,
+				   unsigned int shortestPathCacheBudgetInKB, int shortestPathCacheEviction, 
+				   const string& shortestPathCacheDir) {
 
 	cout << "enableNetworkModification: " << enableNetworkModification << endl;
 	cout << "enableShortestPathCaching: " << enableShortestPathCaching << endl;
+	cout << "staticNetworkEngine: " << staticNetworkEngine << endl;
+	cout << "shortestPathCacheBudgetInKB: " << shortestPathCacheBudgetInKB << endl;
+	cout << "shortestPathCacheEviction: " << shortestPathCacheEviction << endl;
+	cout << "shortestPathCacheDir: " << shortestPathCacheDir << endl;
 	cout << "numCars: " << numCars << endl;
 	cout << "numResidences: " << numResidences << endl;
 	cout << "numRoads: " << numRoads << endl;
@@ -89,6 +96,8 @@ void runSimulation(int numResidences, int numRoads,
     const auto tripGenerator = sim->tripGenerator();
 
     conn->shortestPathCacheIsEnabledIs(enableShortestPathCaching);
+    conn->shortestPathCacheBudgetIs(static_cast<U64>(shortestPathCacheBudgetInKB) * 1024);
+    conn->shortestPathCacheEvictionIs(static_cast<Conn::CacheEviction>(shortestPathCacheEviction));
 
     tripGenerator->tripCountGeneratorIs(UniformDistributionRandom::instanceNew(seed, 5,10));
     tripGenerator->tripIntervalGeneratorIs(NormalDistributionRandom::instanceNew(seed, 
@@ -110,8 +119,47 @@ void runSimulation(int numResidences, int numRoads,
 
     populateNetwork(seed, travelNetworkManager, numResidences, numRoads, numCars);
 
+    // Built once on the initial network. The first network modification (if any) drops it.
+    if (staticNetworkEngine == 1) {
+        conn->shortestPathHierarchyIs(ContractionHierarchy::instanceNew(travelNetworkManager->index()));
+        conn->shortestPathEngineIs(Conn::contractionHierarchy);
+    } else if (staticNetworkEngine == 2) {
+        const auto labels = HubLabels::instanceNew(travelNetworkManager->index());
+        conn->shortestPathHubLabelsIs(labels);
+        conn->shortestPathEngineIs(Conn::hubLabels);
+        cout << "Hub labels: " << labels->labelEntryCount() << " label entries (" << labels->averageLabelSize() 
+             << " per label, " << labels->bytes() / 1024 << " KB), built in " << labels->buildNanoseconds() / 1e6 << " ms" << endl;
+    }
+
+    // Runs on the same network share their cache through a file named after its topology hash
+    const auto initialTopologyHash = conn->topologyHash();
+    string cacheFileName;
+    if ( (enableShortestPathCaching != 0) && (!shortestPathCacheDir.empty()) ) {
+        std::ostringstream name;
+        name << shortestPathCacheDir << "/conn-" << std::hex << initialTopologyHash << ".cache";
+        cacheFileName = name.str();
+
+        if (conn->shortestPathCacheLoad(cacheFileName)) {
+            auto numEntries = 0u;
+            for (auto& dest : conn->shortestPathCache()) {
+                numEntries += dest.second.size();
+            }
+
+            cout << "Warm start: " << numEntries << " cache entries loaded from " << cacheFileName << endl;
+        }
+    }
+
     sim->simulationEndTimeIsOffset(totalTimeInMins * 60);
 
+    // Only a cache of the network the run started with is of use to the next run
+    if (!cacheFileName.empty()) {
+        if (conn->topologyHash() != initialTopologyHash) {
+            cout << "Shortest path cache not saved: the network changed during the run" << endl;
+        } else if (!conn->shortestPathCacheSave(cacheFileName)) {
+            cerr << "Could not save the shortest path cache to " << cacheFileName << endl;
+        }
+    }
+
      // Print trip stats
     const auto stats = travelNetworkManager->stats();
     cout << endl;
@@ -133,6 +181,24 @@ void runSimulation(int numResidences, int numRoads,
     cout << "Cache request count: " << pathCacheStats->requestCount() << endl;
     cout << "Cache hit count: " << pathCacheStats->hitCount() << endl;
     cout << "Cache miss count: " << pathCacheStats->missCount() << endl;
+    cout << "Cache invalidation count: " << pathCacheStats->invalidationCount() << endl;
+    cout << "Cache entries visited by invalidations: " << pathCacheStats->invalidationVisitCount() << endl;
+    cout << "Cache entries invalidated: " << pathCacheStats->invalidatedEntryCount() << endl;
+    cout << "Cache entries repaired: " << pathCacheStats->repairedEntryCount() << endl;
+    cout << "Cache deletions patched: " << pathCacheStats->patchedDeletionCount() << endl;
+    cout << "Cache alternate hits: " << pathCacheStats->alternateHitCount() << endl;
+    cout << "Cache alternate misses: " << pathCacheStats->alternateMissCount() << endl;
+    cout << "Cache evictions: " << pathCacheStats->evictionCount() << endl;
+    cout << "Cache entries evicted: " << pathCacheStats->evictedEntryCount() << endl;
+    cout << "Cache admissions rejected: " << pathCacheStats->admissionRejectCount() << endl;
+    cout << "Cache resident bytes: " << pathCacheStats->residentBytes() << endl;
+
+    // The same counters with the latency and work distributions, for scripts
+    cout << endl;
+    cout << "=================================================" << endl;
+    cout << "Query stats (JSON)" << endl;
+    cout << "=================================================" << endl;
+    cout << conn->statsJson() << endl;
 
     // Print location and segment stats
     cout << endl;
@@ -153,6 +219,20 @@ int main(int argv, char** argc) {
 	int seed = std::stoi(argc[5]);
 	int totalTimeInMins = std::stoi(argc[6]);
 	int enableShortestPathCaching = std::stoi(argc[7]);
+	int staticNetworkEngine = (argv > 8) ? std::stoi(argc[8]) : 0;
+	unsigned int shortestPathCacheBudgetInKB = (argv > 9) ? std::stoi(argc[9]) : 0;
+	int shortestPathCacheEviction = (argv > 10) ? std::stoi(argc[10]) : 0;
+	string shortestPathCacheDir = (argv > 11) ? argc[11] : "";
+
+	if ( (staticNetworkEngine < 0) || (staticNetworkEngine > 2) || 
+		 (shortestPathCacheEviction < Conn::leastRecentlyUsed) || (shortestPathCacheEviction > Conn::frequencyAdmission) ) {
+		cerr << "Usage: " << argc[0] << " numResidences numRoads numCars enableNetworkModification seed totalTimeInMins " 
+			 << "enableShortestPathCaching [staticNetworkEngine (0, 1 or 2)] [shortestPathCacheBudgetInKB] " 
+			 << "[shortestPathCacheEviction (0, 1 or 2)] [shortestPathCacheDir]" << endl;
+		return 1;
+	}
 
-	runSimulation(numResidences, numRoads, numCars, enableNetworkModification, seed, totalTimeInMins, enableShortestPathCaching);
+	runSimulation(numResidences, numRoads, numCars, enableNetworkModification, seed, totalTimeInMins, 
+				  enableShortestPathCaching, staticNetworkEngine, 
+				  shortestPathCacheBudgetInKB, shortestPathCacheEviction, shortestPathCacheDir);
 }
\ No newline at end of file
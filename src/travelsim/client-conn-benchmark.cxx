@@ -0,0 +1,232 @@
+#include "TravelNetworkManager.h"
+#include "ConnImpl.h"
+#include "RandomNumberGenerators.h"
+
+#include <chrono>
+#include <ostream>
+#include <iostream>
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+unsigned int MIN_ROAD_LENGTH_IN_MILES = 40;
+unsigned int MAX_ROAD_LENGTH_IN_MILES = 800;
+
+// Builds the same network that client-auto-network-sim builds for a given seed (minus the cars)
+void populateNetwork(unsigned int seed,
+                     const Ptr<TravelNetworkManager>& mgr,
+                     unsigned int numResidences,
+                     unsigned int numRoads) {
+    string roadNamePrefix = "seg";
+    string locNamePrefix = "loc";
+
+    for(auto i = 0u; i < numResidences; i++) {
+        mgr->residenceNew(locNamePrefix + std::to_string(i));
+    }
+
+    const auto maxNumResidences = numResidences * numResidences;
+    if (numRoads > maxNumResidences) {
+        numRoads = maxNumResidences;
+    }
+
+    const auto residenceRng = UniformDistributionRandom::instanceNew(seed, 0, numResidences);
+    const auto lengthRng = UniformDistributionRandom::instanceNew(seed, MIN_ROAD_LENGTH_IN_MILES, MAX_ROAD_LENGTH_IN_MILES);
+
+    for (auto i = 0u; i < numRoads; i++) {
+        const auto source = mgr->location(locNamePrefix + std::to_string((int)(residenceRng->value())));
+        const auto destination = mgr->location(locNamePrefix + std::to_string((int)(residenceRng->value())));
+        const auto length = Miles(lengthRng->value());
+        const auto road = mgr->roadNew(roadNamePrefix + std::to_string(i));
+
+        road->sourceIs(source);
+        road->destinationIs(destination);
+        road->lengthIs(length);
+    }
+}
+
+struct EngineRun {
+    string name;
+    Conn::Engine engine;
+};
+
+void runBenchmark(int numResidences, int numRoads, int seed, int numQueries) {
+    cout << "numResidences: " << numResidences << endl;
+    cout << "numRoads: " << numRoads << endl;
+    cout << "seed: " << seed << endl;
+    cout << "numQueries: " << numQueries << endl << endl;
+
+    const auto travelNetworkManager = TravelNetworkManager::instanceNew("mgr");
+    const auto conn = travelNetworkManager->conn();
+
+    populateNetwork(seed, travelNetworkManager, numResidences, numRoads);
+
+    // The cache would hide the cost of the search engines, so every query is computed from scratch
+    conn->shortestPathCacheIsEnabledIs(false);
+
+    vector< std::pair< Ptr<Location>, Ptr<Location> > > queries;
+    const auto queryRng = UniformDistributionRandom::instanceNew(seed, 0, numResidences);
+    for (auto i = 0; i < numQueries; i++) {
+        const auto source = travelNetworkManager->location("loc" + std::to_string((int)(queryRng->value())));
+        const auto destination = travelNetworkManager->location("loc" + std::to_string((int)(queryRng->value())));
+        queries.push_back(std::make_pair(source, destination));
+    }
+
+    const vector<EngineRun> engineRuns = {
+        { "linearScan", Conn::linearScan },
+        { "binaryHeap", Conn::binaryHeap },
+        { "bidirectional", Conn::bidirectional },
+        { "alt", Conn::alt },
+        { "contractionHierarchy", Conn::contractionHierarchy },
+        { "deltaStepping", Conn::deltaStepping },
+        { "allPairs", Conn::allPairs },
+        { "hubLabels", Conn::hubLabels }
+    };
+
+    vector<double> referenceLengths;
+
+    cout << "=================================================" << endl;
+    cout << "Conn::shortestPath engine benchmark" << endl;
+    cout << "=================================================" << endl;
+
+    for (const auto& run : engineRuns) {
+        conn->shortestPathEngineIs(run.engine);
+
+        if (run.engine == Conn::alt) {
+            const auto preprocessingStartTime = std::chrono::steady_clock::now();
+            conn->landmarkTable();
+            const auto preprocessingEndTime = std::chrono::steady_clock::now();
+            cout << "alt preprocessing (" << conn->landmarkCount() << " landmarks): "
+                 << std::chrono::duration<double, std::milli>(preprocessingEndTime - preprocessingStartTime).count() << " ms" << endl;
+        }
+
+        if (run.engine == Conn::contractionHierarchy) {
+            const auto preprocessingStartTime = std::chrono::steady_clock::now();
+            const auto ch = ContractionHierarchy::instanceNew(travelNetworkManager->index());
+            conn->shortestPathHierarchyIs(ch);
+            const auto preprocessingEndTime = std::chrono::steady_clock::now();
+            cout << "contractionHierarchy preprocessing (" << ch->shortcutCount() << " shortcuts): "
+                 << std::chrono::duration<double, std::milli>(preprocessingEndTime - preprocessingStartTime).count() << " ms" << endl;
+        }
+
+        if (run.engine == Conn::allPairs) {
+            const auto preprocessingStartTime = std::chrono::steady_clock::now();
+            const auto table = conn->allPairsTable();
+            const auto preprocessingEndTime = std::chrono::steady_clock::now();
+            cout << "allPairs preprocessing (" << table->bytes() / 1024 << " KB): "
+                 << std::chrono::duration<double, std::milli>(preprocessingEndTime - preprocessingStartTime).count() << " ms" << endl;
+        }
+
+        if (run.engine == Conn::hubLabels) {
+            const auto labels = HubLabels::instanceNew(travelNetworkManager->index());
+            conn->shortestPathHubLabelsIs(labels);
+            cout << "hubLabels preprocessing (" << labels->labelEntryCount() << " label entries, "
+                 << labels->averageLabelSize() << " per label, " << labels->bytes() / 1024 << " KB): "
+                 << labels->buildNanoseconds() / 1e6 << " ms" << endl;
+        }
+
+        vector<double> lengths;
+        unsigned int pathsFound = 0;
+        const auto queryStats = conn->queryStats();
+        const auto settledBefore = queryStats->settledCount().sum();
+        const auto relaxedBefore = queryStats->relaxedCount().sum();
+        const auto startTime = std::chrono::steady_clock::now();
+
+        for (const auto& q : queries) {
+            const auto p = conn->shortestPath(q.first, q.second);
+            if (p != null) {
+                pathsFound++;
+                lengths.push_back(p->length().value());
+            } else {
+                lengths.push_back(-1);
+            }
+        }
+
+        const auto endTime = std::chrono::steady_clock::now();
+        const double totalMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+        const auto settledCount = queryStats->settledCount().sum() - settledBefore;
+        const auto relaxedCount = queryStats->relaxedCount().sum() - relaxedBefore;
+
+        // The same queries without building the paths
+        const auto distanceStartTime = std::chrono::steady_clock::now();
+        for (const auto& q : queries) {
+            conn->distance(q.first, q.second);
+        }
+
+        const auto distanceEndTime = std::chrono::steady_clock::now();
+        const double distanceMs = std::chrono::duration<double, std::milli>(distanceEndTime - distanceStartTime).count();
+
+        unsigned int mismatchCount = 0;
+        if (referenceLengths.empty()) {
+            referenceLengths = lengths;
+        } else {
+            for (auto i = 0u; i < lengths.size(); i++) {
+                if ( (lengths[i] < referenceLengths[i] - Miles::tolerance) ||
+                     (lengths[i] > referenceLengths[i] + Miles::tolerance) ) {
+                    mismatchCount++;
+                }
+            }
+        }
+
+        cout << run.name << ": total " << totalMs << " ms, "
+             << (numQueries > 0 ? totalMs / numQueries : 0) << " ms/query, "
+             << (numQueries > 0 ? distanceMs / numQueries : 0) << " ms/distance query, "
+             << pathsFound << " paths found, "
+             << mismatchCount << " length mismatches, "
+             << (numQueries > 0 ? double(settledCount) / numQueries : 0) << " settled/query, "
+             << (numQueries > 0 ? double(relaxedCount) / numQueries : 0) << " relaxed/query" << endl;
+    }
+
+    // Queries grouped by destination, one backward search per group, spread over the workers
+    cout << endl;
+    cout << "=================================================" << endl;
+    cout << "Conn::shortestPaths batch benchmark" << endl;
+    cout << "=================================================" << endl;
+
+    vector<unsigned int> workerCounts = { 1 };
+    if (std::thread::hardware_concurrency() > 1) {
+        workerCounts.push_back(std::thread::hardware_concurrency());
+    }
+
+    for (const auto workerCount : workerCounts) {
+        conn->shortestPathWorkerCountIs(workerCount);
+
+        const auto startTime = std::chrono::steady_clock::now();
+        const auto paths = conn->shortestPaths(queries);
+        const auto endTime = std::chrono::steady_clock::now();
+        const double totalMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+
+        unsigned int pathsFound = 0;
+        unsigned int mismatchCount = 0;
+        for (auto i = 0u; i < paths.size(); i++) {
+            const auto length = (paths[i] != null) ? paths[i]->length().value() : -1;
+            if (paths[i] != null) {
+                pathsFound++;
+            }
+
+            if ( (length < referenceLengths[i] - Miles::tolerance) ||
+                 (length > referenceLengths[i] + Miles::tolerance) ) {
+                mismatchCount++;
+            }
+        }
+
+        cout << "shortestPaths (" << workerCount << " workers): total " << totalMs << " ms, "
+             << (numQueries > 0 ? totalMs / numQueries : 0) << " ms/query, "
+             << pathsFound << " paths found, "
+             << mismatchCount << " length mismatches" << endl;
+    }
+}
+
+int main(int argv, char** argc) {
+    if (argv < 5) {
+        cerr << "Usage: " << argc[0] << " numResidences numRoads seed numQueries" << endl;
+        return 1;
+    }
+
+    int numResidences = std::stoi(argc[1]);
+    int numRoads = std::stoi(argc[2]);
+    int seed = std::stoi(argc[3]);
+    int numQueries = std::stoi(argc[4]);
+
+    runBenchmark(numResidences, numRoads, seed, numQueries);
+}
@@ -152,6 +152,24 @@ void runSimulation(int seed, int totalTimeInMins,
     cout << "Cache request count: " << pathCacheStats->requestCount() << endl;
     cout << "Cache hit count: " << pathCacheStats->hitCount() << endl;
     cout << "Cache miss count: " << pathCacheStats->missCount() << endl;
+    cout << "Cache invalidation count: " << pathCacheStats->invalidationCount() << endl;
+    cout << "Cache entries visited by invalidations: " << pathCacheStats->invalidationVisitCount() << endl;
+    cout << "Cache entries invalidated: " << pathCacheStats->invalidatedEntryCount() << endl;
+    cout << "Cache entries repaired: " << pathCacheStats->repairedEntryCount() << endl;
+    cout << "Cache deletions patched: " << pathCacheStats->patchedDeletionCount() << endl;
+    cout << "Cache alternate hits: " << pathCacheStats->alternateHitCount() << endl;
+    cout << "Cache alternate misses: " << pathCacheStats->alternateMissCount() << endl;
+    cout << "Cache evictions: " << pathCacheStats->evictionCount() << endl;
+    cout << "Cache entries evicted: " << pathCacheStats->evictedEntryCount() << endl;
+    cout << "Cache admissions rejected: " << pathCacheStats->admissionRejectCount() << endl;
+    cout << "Cache resident bytes: " << pathCacheStats->residentBytes() << endl;
+
+    // The same counters with the latency and work distributions, for scripts
+    cout << endl;
+    cout << "=================================================" << endl;
+    cout << "Query stats (JSON)" << endl;
+    cout << "=================================================" << endl;
+    cout << conn->statsJson() << endl;
 
     // Print location and segment stats
     cout << endl;
@@ -0,0 +1,10 @@
+# Compares the Conn::shortestPath engines on the networks used by run_caching_experiments.sh
+
+# Very dense network
+time ./client-conn-benchmark 400 80000 23901846 200 > bench_very_dense.txt
+
+# Dense network
+time ./client-conn-benchmark 200 15000 21478797 500 > bench_dense.txt
+
+# Sparse network
+time ./client-conn-benchmark 200 700 10295624 500 > bench_sparse.txt
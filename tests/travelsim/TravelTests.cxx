@@ -60,6 +60,35 @@ void testPath(const Ptr<Conn::Path>& path, const string& expPathStr, const Miles
 	}
 }
 
+/* The 6-location network of the shortestPath tests, with its locations and segments created in the given order */
+Ptr<TravelNetworkManager> sixLocationNetworkNew(const bool isReversed = false) {
+	const auto manager = TravelNetworkManager::instanceNew("manager-1");
+	vector<string> locNames = { "loc1", "loc2", "loc3", "loc4", "loc5", "loc6" };
+	if (isReversed) {
+		std::reverse(locNames.begin(), locNames.end());
+	}
+
+	for (auto& name : locNames) {
+		manager->residenceNew(name);
+	}
+
+	const vector< std::tuple<string, string, string, double> > roads = {
+		std::make_tuple("road-1", "loc1", "loc2", 15), std::make_tuple("road-2", "loc1", "loc3", 5), 
+		std::make_tuple("road-3", "loc1", "loc4", 20), std::make_tuple("road-4", "loc1", "loc5", 100), 
+		std::make_tuple("road-5", "loc2", "loc4", 30), std::make_tuple("road-6", "loc3", "loc1", 2), 
+		std::make_tuple("road-7", "loc3", "loc4", 10), std::make_tuple("road-8", "loc3", "loc5", 60), 
+		std::make_tuple("road-9", "loc3", "loc6", 25), std::make_tuple("road-10", "loc4", "loc1", 35), 
+		std::make_tuple("road-11", "loc4", "loc5", 120), std::make_tuple("road-12", "loc4", "loc6", 3), 
+		std::make_tuple("road-13", "loc6", "loc5", 10) };
+	for (auto i = 0u; i < roads.size(); i++) {
+		const auto& road = roads[isReversed ? roads.size() - 1 - i : i];
+		createRoadSegment(manager, std::get<0>(road), manager->location(std::get<1>(road)), 
+						  manager->location(std::get<2>(road)), std::get<3>(road));
+	}
+
+	return manager;
+}
+
 void testshortestPathCache(const Ptr<Conn> conn, 
 					 const Ptr<Location>& source, 
 					 const Ptr<Location>& destination, 
@@ -161,7 +190,7 @@ TEST(Conn, shortestPath_2) {
 	const auto loc6 = manager->residenceNew("loc6");
 
 	const auto seg12 = createRoadSegment(manager, "road-1", loc1, loc2, 15);
-	const auto seg13 = createRoadSegment(manager, "road-2", loc1, loc3, 5); 
+	const auto seg13 = createRoadSegment(manager, "road-2", loc1, loc3, 5);
 	const auto seg14 = createRoadSegment(manager, "road-3", loc1, loc4, 20);
 	const auto seg15 = createRoadSegment(manager, "road-4", loc1, loc5, 100);
 
@@ -260,7 +289,7 @@ TEST(Conn, shortestPath_segmentDel) {
 	const auto loc6 = manager->residenceNew("loc6");
 
 	const auto seg12 = createRoadSegment(manager, "road-1", loc1, loc2, 15);
-	const auto seg13 = createRoadSegment(manager, "road-2", loc1, loc3, 5); 
+	const auto seg13 = createRoadSegment(manager, "road-2", loc1, loc3, 5);
 	const auto seg14 = createRoadSegment(manager, "road-3", loc1, loc4, 20);
 	const auto seg15 = createRoadSegment(manager, "road-4", loc1, loc5, 100);
 
@@ -303,6 +332,45 @@ TEST(Conn, shortestPath_segmentDel) {
 	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc5 ", 65);
 }
 
+TEST(Conn, shortestPath_invalidationIndex) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc3 = manager->location("loc3");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+	const auto seg12 = manager->segment("road-1");
+	const auto seg13 = manager->segment("road-2");
+	const auto seg46 = manager->segment("road-12");
+
+	const auto conn = manager->conn();
+	const auto stats = conn->shortestPathCacheStats();
+
+	// Settles every location, caching 11 entries
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+
+	// Only the entries to loc4, loc6 and loc5 from loc3 use road-7, and those from loc1 go through loc3
+	manager->segmentDel("road-7");
+	ASSERT_EQ(1, stats->invalidationCount());
+	ASSERT_EQ(6, stats->invalidationVisitCount());
+	ASSERT_EQ(6, stats->invalidatedEntryCount());
+	ASSERT_EQ(2, conn->shortestPathCache()["loc5"].size());
+	testshortestPathCache(conn, loc4, loc5, seg46);
+
+	// The entry left to loc6, the one from it and the one through it
+	manager->locationDel("loc6");
+	ASSERT_EQ(2, stats->invalidationCount());
+	ASSERT_EQ(9, stats->invalidationVisitCount());
+	ASSERT_EQ(9, stats->invalidatedEntryCount());
+	ASSERT_EQ(4, conn->shortestPathCache().size());
+	testshortestPathCache(conn, loc1, loc2, seg12);
+	testshortestPathCache(conn, loc1, loc3, seg13);
+	ASSERT_EQ(0, conn->shortestPathCache()["loc5"].size());
+
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc5 ", 65);
+}
+
 TEST(Conn, shortestPath_addLocAndSeg) {
 	const auto manager = TravelNetworkManager::instanceNew("manager-1");
 	const auto loc1 = manager->residenceNew("loc1");
@@ -313,7 +381,7 @@ TEST(Conn, shortestPath_addLocAndSeg) {
 	const auto loc6 = manager->residenceNew("loc6");
 
 	const auto seg12 = createRoadSegment(manager, "road-1", loc1, loc2, 15);
-	const auto seg13 = createRoadSegment(manager, "road-2", loc1, loc3, 5); 
+	const auto seg13 = createRoadSegment(manager, "road-2", loc1, loc3, 5);
 	const auto seg14 = createRoadSegment(manager, "road-3", loc1, loc4, 20);
 	const auto seg15 = createRoadSegment(manager, "road-4", loc1, loc5, 100);
 
@@ -341,16 +409,1194 @@ TEST(Conn, shortestPath_addLocAndSeg) {
 
 	ASSERT_EQ(5, conn->shortestPathCache().size());
 
+	// A new location cannot shorten any path
+	const auto stats = conn->shortestPathCacheStats();
+	const auto hitCount = stats->hitCount();
 	manager->residenceNew("loc7");
-	ASSERT_EQ(0, conn->shortestPathCache().size());
+	ASSERT_EQ(5, conn->shortestPathCache().size());
 
 	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	ASSERT_EQ(hitCount + 1, stats->hitCount());
+
+	// Nor does a segment that does not connect two locations, or one that no cached path can use
+	const auto seg57 = manager->roadNew("road-14");
+	const auto seg64 = createRoadSegment(manager, "road-15", loc6, loc4, 1);
+	ASSERT_EQ(5, conn->shortestPathCache().size());
+	ASSERT_EQ(4, conn->shortestPathCache()["loc5"].size());
+	ASSERT_EQ(0, stats->invalidatedEntryCount());
+
+	// Only the entries from loc1 and loc3 to loc4, loc6 and loc5 get shorter
+	const auto seg16 = createRoadSegment(manager, "road-16", loc1, loc6, 1);
 	ASSERT_EQ(5, conn->shortestPathCache().size());
+	ASSERT_EQ(0, conn->shortestPathCache()["loc4"].size());
+	ASSERT_EQ(1, conn->shortestPathCache()["loc6"].size());
+	ASSERT_EQ(2, conn->shortestPathCache()["loc5"].size());
+	ASSERT_EQ(2, stats->invalidationCount());
+	ASSERT_EQ(6, stats->invalidatedEntryCount());
+	testshortestPathCache(conn, loc1, loc2, seg12);
+	testshortestPathCache(conn, loc4, loc6, seg46);
+	testshortestPathCache(conn, loc6, loc5, seg65);
+
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc6 loc5 ", 11);
+	testPath(conn->shortestPath(loc3, loc6), "loc3 loc1 loc6 ", 3);
+	testPath(conn->shortestPath(loc3, loc4), "loc3 loc1 loc6 loc4 ", 4);
+	testPath(conn->shortestPath(loc4, loc5), "loc4 loc6 loc5 ", 13);
+}
+
+TEST(Conn, shortestPath_segmentLengthAndRewire) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc3 = manager->location("loc3");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+	const auto seg15 = manager->segment("road-4");
+	const auto seg46 = manager->segment("road-12");
+	const auto seg65 = manager->segment("road-13");
+
+	const auto conn = manager->conn();
+	const auto stats = conn->shortestPathCacheStats();
+
+	// A longer segment drops the cached paths through it, and only those
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	seg46->lengthIs(30);
+	ASSERT_EQ(0, conn->shortestPathCache()["loc6"].size());
+	ASSERT_EQ(1, conn->shortestPathCache()["loc5"].size());
+	ASSERT_EQ(2, conn->shortestPathCache()["loc4"].size());
+	testshortestPathCache(conn, loc6, loc5, seg65);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc6 loc5 ", 40);
+
+	// A shorter one drops the cached paths it beats
+	seg46->lengthIs(1);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 26);
+	testPath(conn->shortestPath(loc3, loc5), "loc3 loc4 loc6 loc5 ", 21);
+
+	// Complete trees are repaired in place and stay complete
+	conn->pathCacheIsEmpty();
+	conn->shortestPathCacheFillIs(Conn::reverseTrees);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 26);
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+
+	// Only loc3 changes its next hop
+	const auto missCount = stats->missCount();
+	seg46->lengthIs(30);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc6 loc5 ", 40);
+	testPath(conn->shortestPath(loc4, loc5), "loc4 loc6 loc5 ", 40);
+	testPath(conn->shortestPath(loc2, loc5), "loc2 loc4 loc6 loc5 ", 70);
+	ASSERT_EQ(1, stats->repairedEntryCount());
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+
+	// Rewiring road-4 to start at loc2 brings loc2, loc1 and loc3 closer to loc5
+	seg15->sourceIs(loc2);
+	seg15->lengthIs(5);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc2 loc5 ", 20);
+	testPath(conn->shortestPath(loc3, loc5), "loc3 loc1 loc2 loc5 ", 22);
+	testPath(conn->shortestPath(loc4, loc5), "loc4 loc6 loc5 ", 40);
+	ASSERT_EQ(4, stats->repairedEntryCount());
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+	ASSERT_EQ(missCount, stats->missCount());
+}
+
+TEST(Conn, shortestPath_cacheAlternates) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc3 = manager->location("loc3");
+	const auto loc5 = manager->location("loc5");
+
+	const auto conn = manager->conn();
+	const auto stats = conn->shortestPathCacheStats();
+	conn->shortestPathCacheFillIs(Conn::reverseTrees);
+	conn->shortestPathCacheAlternatesIs(true);
+	ASSERT_TRUE(conn->shortestPathCacheAlternates());
+
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+	const auto missCount = stats->missCount();
+	const auto bytes = stats->residentBytes();
+
+	// The tree is patched rather than dropped: loc1 falls back on its alternate (road-3), 
+	// while loc3's alternate goes through loc1 and has to be looked for again
+	manager->segmentDel("road-7");
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc4 loc6 loc5 ", 33);
+	testPath(conn->shortestPath(loc2, loc5), "loc2 loc4 loc6 loc5 ", 43);
+	ASSERT_EQ(35, conn->shortestPath(loc3, loc5)->length().value());
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+	ASSERT_EQ(missCount, stats->missCount());
+	ASSERT_EQ(1, stats->patchedDeletionCount());
+	ASSERT_EQ(1, stats->alternateHitCount());
+	ASSERT_EQ(1, stats->alternateMissCount());
+
+	// A shorter segment drops every alternate, along with the bytes they held
+	createRoadSegment(manager, "road-14", loc2, loc5, 50);
+	ASSERT_LT(stats->residentBytes(), bytes);
+	testPath(conn->shortestPath(loc2, loc5), "loc2 loc4 loc6 loc5 ", 43);
+
+	// Without alternates, a deleted segment drops the cached paths through it
+	conn->shortestPathCacheAlternatesIs(false);
+	manager->segmentDel("road-12");
+	ASSERT_FALSE(conn->isShortestPathTreeCached(loc5));
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc6 loc5 ", 40);
+	ASSERT_EQ(1, stats->patchedDeletionCount());
+}
+
+TEST(Conn, shortestPath_engines) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+
+	const auto conn = manager->conn();
+	conn->shortestPathCacheIsEnabledIs(false);
+	ASSERT_EQ(Conn::binaryHeap, conn->shortestPathEngine());
+
+	conn->shortestPathHierarchyIs(ContractionHierarchy::instanceNew(manager->index()));
+
+	const vector<Conn::Engine> engines = { Conn::linearScan, Conn::binaryHeap, Conn::bidirectional, Conn::alt, Conn::contractionHierarchy, 
+										   Conn::deltaStepping, Conn::allPairs };
+	for (auto engine : engines) {
+		conn->shortestPathEngineIs(engine);
+
+		testPath(conn->shortestPath(loc1, loc1), "", 0);
+		testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+		testPath(conn->shortestPath(loc4, loc2), "loc4 loc1 loc2 ", 50);
+		testPath(conn->shortestPath(loc6, loc5), "loc6 loc5 ", 10);
+		ASSERT_EQ(conn->shortestPath(loc5, loc1), null);
+	}
 
-	const auto seg64 = createRoadSegment(manager, "road-14", loc6, loc4, 1);
 	ASSERT_EQ(0, conn->shortestPathCache().size());
 }
 
+TEST(Conn, shortestPath_deltaStepping) {
+	const auto manager = TravelNetworkManager::instanceNew("manager-1");
+	const auto numLocations = 40u;
+	for (auto i = 0u; i < numLocations; i++) {
+		manager->residenceNew("loc" + to_string(i));
+	}
+
+	// A dense network with lengths from 1 to 100, so that every bucket width below gives both light and heavy arcs
+	U32 state = 12345;
+	const auto next = [&state]() {
+		state = state * 1103515245 + 12345;
+		return (state >> 16) & 0x7FFF;
+	};
+
+	for (auto i = 0u; i < 600; i++) {
+		createRoadSegment(manager, "road-" + to_string(i), manager->location("loc" + to_string(next() % numLocations)), 
+						  manager->location("loc" + to_string(next() % numLocations)), 1 + next() % 100);
+	}
+
+	const auto index = manager->index();
+	ASSERT_GE(DeltaStepping::bucketWidth(index.ptr()), 1);
+
+	const auto pool = WorkerPool::instanceNew(3);
+	for (auto direction : { ShortestPathTree::forward, ShortestPathTree::backward }) {
+		for (auto root = 0u; root < numLocations; root += 7) {
+			ShortestPathTree expected;
+			expected.rootIs(index, root, direction);
+
+			for (auto width : { 0.5, 10.0, 35.0, 1000.0 }) {
+				ShortestPathTree tree;
+				DeltaStepping search(index.ptr(), width, pool.ptr());
+				search.rootIs(root, direction, tree);
+				ASSERT_EQ(expected.minDist, tree.minDist);
+
+				// The same tree, tie for tie, without the workers
+				ShortestPathTree serialTree;
+				DeltaStepping(index.ptr(), width, nullptr).rootIs(root, direction, serialTree);
+				ASSERT_EQ(tree.predSegment, serialTree.predSegment);
+
+				// Stopping at a target settles every location up to its bucket
+				const auto target = (root + 13) % numLocations;
+				search.rootIs(root, direction, tree, target);
+				ASSERT_EQ(expected.minDist[target], tree.minDist[target]);
+				for (auto id : search.settledLocations()) {
+					ASSERT_EQ(expected.minDist[id], tree.minDist[id]);
+				}
+			}
+		}
+	}
+
+	// As an engine, and for the trees of reverseTrees fills
+	const auto conn = manager->conn();
+	conn->shortestPathWorkerCountIs(3);
+	conn->shortestPathEngineIs(Conn::deltaStepping);
+	for (auto fill : { Conn::settledPrefixes, Conn::reverseTrees }) {
+		conn->pathCacheIsEmpty();
+		conn->shortestPathCacheFillIs(fill);
+		for (auto i = 0u; i < numLocations; i += 3) {
+			const auto source = manager->location("loc" + to_string(i));
+			const auto destination = manager->location("loc" + to_string((i * 7 + 5) % numLocations));
+
+			ShortestPathTree expected;
+			expected.rootIs(index, index->locationId(source), ShortestPathTree::forward);
+
+			const auto p = conn->shortestPath(source, destination);
+			ASSERT_NE(p, null);
+			ASSERT_EQ(expected.minDist[index->locationId(destination)], p->length().value());
+		}
+	}
+}
+
+TEST(Conn, shortestPath_allPairs) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc3 = manager->location("loc3");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+
+	const auto conn = manager->conn();
+	conn->shortestPathCacheIsEnabledIs(false);
+	conn->shortestPathEngineIs(Conn::allPairs);
+	conn->allPairsRebuildIsBackgroundIs(false);
+
+	// The first query builds the table, and the next ones only walk it
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	testPath(conn->shortestPath(loc4, loc2), "loc4 loc1 loc2 ", 50);
+	ASSERT_EQ(1, conn->allPairsBuildCount());
+
+	const auto index = manager->index();
+	const auto table = conn->allPairsTable();
+	ASSERT_EQ(28, table->distance(index->locationId(loc1), index->locationId(loc5)));
+	ASSERT_EQ(ShortestPathTree::unreachableDistance(), table->distance(index->locationId(loc5), index->locationId(loc1)));
+	ASSERT_EQ(index->locationId(loc3), table->nextLocation(index->locationId(loc1), index->locationId(loc5)));
+	ASSERT_EQ(36 * 16, table->bytes());
+	ASSERT_EQ(1, conn->allPairsBuildCount());
+
+	manager->segmentDel("road-7");
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc4 loc6 loc5 ", 33);
+	ASSERT_EQ(2, conn->allPairsBuildCount());
+
+	// In the background, queries are answered by binaryHeap until the rebuilt table is in
+	conn->allPairsRebuildIsBackgroundIs(true);
+	manager->segmentDel("road-12");
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc6 loc5 ", 40);
+	ASSERT_EQ(3, conn->allPairsBuildCount());
+
+	auto rebuilt = conn->allPairsTable();
+	while (rebuilt == nullptr) {
+		std::this_thread::yield();
+		rebuilt = conn->allPairsTable();
+	}
+
+	ASSERT_EQ(index->version(), rebuilt->version());
+	ASSERT_EQ(40, rebuilt->distance(index->locationId(loc1), index->locationId(loc5)));
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc6 loc5 ", 40);
+	ASSERT_EQ(3, conn->allPairsBuildCount());
+
+	// The table kept by a reader stays as it was
+	ASSERT_EQ(28, table->distance(index->locationId(loc1), index->locationId(loc5)));
+}
+
+TEST(Conn, shortestPath_bidirectional) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+	const auto seg46 = manager->segment("road-12");
+	const auto seg65 = manager->segment("road-13");
+
+	const auto conn = manager->conn();
+	conn->shortestPathEngineIs(Conn::bidirectional);
+
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+
+	// Locations settled by the backward search are cached with their next hop towards the destination
+	testshortestPathCache(conn, loc6, loc5, seg65);
+	testshortestPathCache(conn, loc4, loc5, seg46);
+	testPath(conn->shortestPathCached(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+
+	manager->segmentDel("road-12");
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc6 loc5 ", 40);
+	testPath(conn->shortestPath(loc4, loc6), "loc4 loc1 loc3 loc6 ", 65);
+}
+
+TEST(Conn, shortestPath_alt) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+	const auto seg65 = manager->segment("road-13");
+
+	// Every location is a landmark, so every shortest path lies on some landmark tree
+	const auto conn = manager->conn();
+	conn->shortestPathCacheIsEnabledIs(false);
+	conn->shortestPathEngineIs(Conn::alt);
+	conn->landmarkCountIs(6);
+
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	ASSERT_EQ(conn->shortestPath(loc5, loc1), null);
+
+	const auto landmarks = conn->landmarkTable();
+	const auto index = manager->index();
+	ASSERT_EQ(6, landmarks->landmarkCount());
+	ASSERT_EQ(1, landmarks->rebuildCount());
+	ASSERT_EQ(0, landmarks->repairCount());
+	ASSERT_EQ(28, landmarks->lowerBound(index->locationId(loc1), index->locationId(loc5)));
+
+	// Deleting a segment only regrows the trees that use it
+	manager->segmentDel("road-12");
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc6 loc5 ", 40);
+	testPath(conn->shortestPath(loc4, loc6), "loc4 loc1 loc3 loc6 ", 65);
+	ASSERT_EQ(1, landmarks->rebuildCount());
+	ASSERT_GT(landmarks->repairCount(), 0);
+	ASSERT_LT(landmarks->repairCount(), 12);
+
+	// So does a segment getting longer
+	const auto repairCount = landmarks->repairCount();
+	seg65->lengthIs(50);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc5 ", 65);
+	ASSERT_EQ(1, landmarks->rebuildCount());
+	ASSERT_GT(landmarks->repairCount(), repairCount);
+
+	// Deleting a landmark location selects the landmarks again
+	manager->locationDel("loc3");
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc5 ", 100);
+	ASSERT_EQ(2, landmarks->rebuildCount());
+	ASSERT_EQ(5, landmarks->landmarkCount());
+}
+
+TEST(Conn, shortestPath_contractionHierarchy) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+	const auto seg65 = manager->segment("road-13");
+
+	const auto conn = manager->conn();
+	conn->shortestPathCacheIsEnabledIs(false);
+	conn->shortestPathEngineIs(Conn::contractionHierarchy);
+
+	// Without a hierarchy the engine falls back to a plain search
+	ASSERT_EQ(conn->shortestPathHierarchy(), null);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+
+	const auto ch = ContractionHierarchy::instanceNew(manager->index());
+	conn->shortestPathHierarchyIs(ch);
+	ASSERT_FALSE(ch->isStale());
+	ASSERT_EQ(6, ch->locationIdCount());
+
+	const auto index = manager->index();
+	vector<TravelNetworkIndex::Id> segmentIds;
+	ASSERT_EQ(28, ch->shortestPath(index->locationId(loc1), index->locationId(loc5), segmentIds));
+	ASSERT_EQ(4, segmentIds.size());
+	ASSERT_EQ(seg65.ptr(), index->segment(segmentIds[3]).ptr());
+
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	testPath(conn->shortestPath(loc4, loc2), "loc4 loc1 loc2 ", 50);
+	testPath(conn->shortestPath(loc2, loc6), "loc2 loc4 loc6 ", 33);
+	ASSERT_EQ(conn->shortestPath(loc5, loc1), null);
+
+	// The first change to the network drops the hierarchy
+	seg65->lengthIs(50);
+	ASSERT_TRUE(ch->isStale());
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc5 ", 65);
+	ASSERT_EQ(conn->shortestPathHierarchy(), null);
+
+	conn->shortestPathHierarchyIs(ContractionHierarchy::instanceNew(manager->index()));
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc5 ", 65);
+
+	manager->segmentDel("road-12");
+	testPath(conn->shortestPath(loc4, loc6), "loc4 loc1 loc3 loc6 ", 65);
+	ASSERT_EQ(conn->shortestPathHierarchy(), null);
+}
+
+TEST(Conn, shortestPathFromNearest) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+	const auto seg46 = manager->segment("road-12");
+	const auto seg65 = manager->segment("road-13");
+
+	const auto conn = manager->conn();
+
+	testPath(conn->shortestPathFromNearest({ loc1, loc2 }, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	testPath(conn->shortestPathFromNearest({ loc1, loc2, loc4 }, loc5), "loc4 loc6 loc5 ", 13);
+	testPath(conn->shortestPathFromNearest({ loc4, loc5 }, loc5), "", 0);
+	testPath(conn->shortestPathFromNearest({ loc2, loc1 }, loc4), "loc1 loc3 loc4 ", 15);
+	ASSERT_EQ(conn->shortestPathFromNearest({ loc5 }, loc1), null);
+	ASSERT_EQ(conn->shortestPathFromNearest({}, loc1), null);
+
+	// Locations settled by the search are cached with their next hop towards the destination
+	testshortestPathCache(conn, loc4, loc5, seg46);
+	testshortestPathCache(conn, loc6, loc5, seg65);
+	testPath(conn->shortestPathCached(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+}
+
+TEST(Conn, shortestPath_reverseTreeCacheFill) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc3 = manager->location("loc3");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+	const auto seg24 = manager->segment("road-5");
+	const auto seg46 = manager->segment("road-12");
+	const auto seg65 = manager->segment("road-13");
+
+	const auto conn = manager->conn();
+	const auto stats = conn->shortestPathCacheStats();
+	ASSERT_EQ(Conn::settledPrefixes, conn->shortestPathCacheFill());
+	conn->shortestPathCacheFillIs(Conn::reverseTrees);
+
+	// One miss caches the next hop of every location that can reach loc5
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+	ASSERT_EQ(5, conn->shortestPathCache()["loc5"].size());
+	testshortestPathCache(conn, loc2, loc5, seg24);
+	testshortestPathCache(conn, loc4, loc5, seg46);
+	testshortestPathCache(conn, loc6, loc5, seg65);
+
+	testPath(conn->shortestPath(loc2, loc5), "loc2 loc4 loc6 loc5 ", 43);
+	testPath(conn->shortestPath(loc3, loc5), "loc3 loc4 loc6 loc5 ", 23);
+	ASSERT_EQ(2, stats->hitCount());
+	ASSERT_EQ(1, stats->missCount());
+
+	// Nothing reaches loc1 from loc5, which the complete tree of loc1 tells without a search
+	ASSERT_EQ(conn->shortestPath(loc5, loc1), null);
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc1));
+	ASSERT_EQ(conn->shortestPath(loc5, loc1), null);
+	ASSERT_EQ(3, stats->missCount());
+
+	// Deleting a segment of a cached tree leaves it incomplete
+	manager->segmentDel("road-12");
+	ASSERT_FALSE(conn->isShortestPathTreeCached(loc5));
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc1));
+	testPath(conn->shortestPath(loc4, loc5), "loc4 loc1 loc3 loc6 loc5 ", 75);
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+}
+
+TEST(Conn, shortestPaths_batch) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc3 = manager->location("loc3");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+
+	const auto conn = manager->conn();
+	const auto stats = conn->shortestPathCacheStats();
+	ASSERT_GE(conn->shortestPathWorkerCount(), 1);
+
+	const vector<Conn::LocationPair> pairs = {
+		Conn::LocationPair(loc1, loc5),
+		Conn::LocationPair(loc2, loc5),
+		Conn::LocationPair(loc5, loc1),
+		Conn::LocationPair(loc3, loc3),
+		Conn::LocationPair(null, loc1),
+		Conn::LocationPair(loc2, loc6),
+		Conn::LocationPair(loc1, loc5),
+		Conn::LocationPair(loc6, loc4)
+	};
+
+	// Same paths, in input order, whatever the number of workers
+	conn->shortestPathCacheIsEnabledIs(false);
+	for (auto n : { 1u, 4u }) {
+		conn->shortestPathWorkerCountIs(n);
+		const auto paths = conn->shortestPaths(pairs);
+		ASSERT_EQ(pairs.size(), paths.size());
+		testPath(paths[0], "loc1 loc3 loc4 loc6 loc5 ", 28);
+		testPath(paths[1], "loc2 loc4 loc6 loc5 ", 43);
+		ASSERT_EQ(paths[2], null);
+		testPath(paths[3], "", 0);
+		ASSERT_EQ(paths[4], null);
+		testPath(paths[5], "loc2 loc4 loc6 ", 33);
+		testPath(paths[6], "loc1 loc3 loc4 loc6 loc5 ", 28);
+		ASSERT_EQ(paths[7], null);
+	}
+
+	ASSERT_EQ(0, stats->requestCount());
+
+	// With the cache, one search per destination fills it for every source it settled
+	conn->shortestPathCacheIsEnabledIs(true);
+	conn->shortestPaths(pairs);
+	ASSERT_EQ(6, stats->requestCount());
+	ASSERT_EQ(0, stats->hitCount());
+	testshortestPathCache(conn, loc3, loc5, manager->segment("road-7"));
+	ASSERT_FALSE(conn->isShortestPathTreeCached(loc5));
+
+	const auto paths = conn->shortestPaths({ Conn::LocationPair(loc2, loc5), Conn::LocationPair(loc3, loc5) });
+	testPath(paths[0], "loc2 loc4 loc6 loc5 ", 43);
+	testPath(paths[1], "loc3 loc4 loc6 loc5 ", 23);
+	ASSERT_EQ(2, stats->hitCount());
+
+	// Complete trees are grown when the cache is filled with them
+	conn->pathCacheIsEmpty();
+	conn->shortestPathCacheFillIs(Conn::reverseTrees);
+	conn->shortestPaths(pairs);
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc1));
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc4));
+	ASSERT_EQ(5, conn->shortestPathCache()["loc5"].size());
+}
+
+TEST(Conn, snapshot_concurrentReaders) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc5 = manager->location("loc5");
+	const auto seg34 = manager->segment("road-7");
+
+	const auto conn = manager->conn();
+	ASSERT_EQ(conn->snapshot(), nullptr);
+	ASSERT_TRUE(conn->isSnapshotStale());
+
+	const auto snapshot = conn->snapshotNew();
+	ASSERT_EQ(conn->snapshot(), snapshot);
+	ASSERT_FALSE(conn->isSnapshotStale());
+
+	const auto p = snapshot->shortestPath("loc1", "loc5");
+	ASSERT_NE(p, nullptr);
+	ASSERT_EQ(vector<string>({ "loc1", "loc3", "loc4", "loc6", "loc5" }), p->locations);
+	ASSERT_EQ(vector<string>({ "road-2", "road-7", "road-12", "road-13" }), p->segments);
+	ASSERT_EQ(28, p->length);
+	ASSERT_EQ(0, snapshot->shortestPath("loc4", "loc4")->segments.size());
+	ASSERT_EQ(snapshot->shortestPath("loc5", "loc1"), nullptr);
+	ASSERT_EQ(snapshot->shortestPath("loc1", "loc7"), nullptr);
+
+	// One tree per destination
+	ASSERT_EQ(43, snapshot->shortestPath("loc2", "loc5")->length);
+	ASSERT_EQ(3, snapshot->missCount());
+	ASSERT_EQ(1, snapshot->hitCount());
+
+	// A published snapshot does not see later changes
+	manager->segmentDel("road-12");
+	ASSERT_TRUE(conn->isSnapshotStale());
+	ASSERT_EQ(28, snapshot->shortestPath("loc1", "loc5")->length);
+	ASSERT_EQ(75, conn->snapshotNew()->shortestPath("loc4", "loc5")->length);
+	ASSERT_EQ(13, snapshot->shortestPath("loc4", "loc5")->length);
+
+	// Readers keep querying the latest snapshot while this thread changes the network and publishes
+	const vector<string> names = { "loc1", "loc2", "loc3", "loc4", "loc5", "loc6" };
+	std::atomic<bool> isDone(false);
+	std::atomic<unsigned int> inconsistentCount(0);
+	vector<std::thread> readers;
+	for (auto r = 0u; r < 4; r++) {
+		readers.push_back(std::thread([&, r] {
+			U64 lastVersion = 0;
+			auto i = r;
+			while (!isDone) {
+				const auto s = conn->snapshot();
+				if (s->version() < lastVersion) {
+					inconsistentCount++;
+				}
+
+				lastVersion = s->version();
+				const auto path = s->shortestPath(names[i % names.size()], names[(i / names.size()) % names.size()]);
+				if ( (path != nullptr) && (path->locations.size() != path->segments.size() + 1) ) {
+					inconsistentCount++;
+				}
+
+				i++;
+			}
+		}));
+	}
+
+	for (auto i = 0u; i < 200; i++) {
+		seg34->lengthIs(10 + (i % 7));
+		conn->shortestPath(loc1, loc5);
+		conn->snapshotNew();
+	}
+
+	isDone = true;
+	for (auto& reader : readers) {
+		reader.join();
+	}
+
+	ASSERT_EQ(0, inconsistentCount);
+	ASSERT_EQ(conn->shortestPath(loc1, loc5)->length().value(), conn->snapshot()->shortestPath("loc1", "loc5")->length);
+}
+
+TEST(Conn, paths_visit) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc3 = manager->location("loc3");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+
+	const auto conn = manager->conn();
+
+	const auto paths = conn->paths(loc4, Miles(15));
+	ASSERT_EQ(2, paths.size());
+	testPath(paths[0], "loc4 loc6 ", 3);
+	testPath(paths[1], "loc4 loc6 loc5 ", 13);
+
+	// Depth-first, a path before the paths that extend it
+	vector<string> visited;
+	ASSERT_EQ(3, conn->pathsVisit(loc3, Miles(13), [&](const vector<TravelNetworkIndex::Id>& segments, const Miles& length) {
+		const auto p = conn->pathNew(segments);
+		EXPECT_EQ(p->length().value(), length.value());
+		visited.push_back(getPathSegmentsArrStr(p));
+		return true;
+	}));
+	ASSERT_EQ(vector<string>({ "loc3 loc1 ", "loc3 loc4 ", "loc3 loc4 loc6 " }), visited);
+
+	// Counting and stopping early
+	const auto numPaths = conn->pathCount(loc1, Miles(1000));
+	ASSERT_EQ(conn->paths(loc1, Miles(1000)).size(), numPaths);
+	ASSERT_LT(3, numPaths);
+
+	auto numSeen = 0u;
+	ASSERT_EQ(3, conn->pathsVisit(loc1, Miles(1000), [&](const vector<TravelNetworkIndex::Id>&, const Miles&) {
+		return ++numSeen < 3;
+	}));
+	ASSERT_EQ(3, numSeen);
+
+	ASSERT_EQ(0, conn->pathCount(loc5, Miles(1000)));
+	ASSERT_EQ(0, conn->pathCount(null, Miles(1000)));
+}
+
+TEST(Conn, paths_parallel) {
+	const auto manager = TravelNetworkManager::instanceNew("manager-1");
+	const auto numLocations = 9u;
+	for (auto i = 0u; i < numLocations; i++) {
+		manager->residenceNew("loc" + to_string(i));
+	}
+
+	U32 state = 777;
+	const auto next = [&state]() {
+		state = state * 1103515245 + 12345;
+		return (state >> 16) & 0x7FFF;
+	};
+
+	for (auto i = 0u; i < 40; i++) {
+		createRoadSegment(manager, "road-" + to_string(i), manager->location("loc" + to_string(next() % numLocations)), 
+						  manager->location("loc" + to_string(next() % numLocations)), 1 + next() % 10);
+	}
+
+	const auto conn = manager->conn();
+	const auto start = manager->location("loc0");
+	const auto toStrings = [](const Conn::PathVector& paths) {
+		vector<string> strs;
+		for (const auto& p : paths) {
+			strs.push_back(getPathSegmentsArrStr(p) + to_string(p->length().value()));
+		}
+
+		std::sort(strs.begin(), strs.end());
+		return strs;
+	};
+
+	for (auto maxLength : { 0.0, 8.0, 25.0, 1000.0 }) {
+		const auto expected = toStrings(conn->paths(start, Miles(maxLength)));
+		for (auto workerCount : { 1u, 4u }) {
+			conn->shortestPathWorkerCountIs(workerCount);
+			ASSERT_EQ(expected, toStrings(conn->pathsInParallel(start, Miles(maxLength))));
+			ASSERT_EQ(expected.size(), conn->pathCountInParallel(start, Miles(maxLength)));
+		}
+	}
+
+	ASSERT_LT(100, conn->pathCount(start, Miles(1000)));
+	ASSERT_EQ(0, conn->pathsInParallel(null, Miles(1000)).size());
+}
+
+TEST(Conn, path_sharedSegments) {
+	const auto manager = TravelNetworkManager::instanceNew("manager-1");
+	const auto loc1 = manager->residenceNew("loc1");
+	const auto loc2 = manager->residenceNew("loc2");
+	const auto loc3 = manager->residenceNew("loc3");
+	const auto loc4 = manager->residenceNew("loc4");
+
+	const auto seg12 = createRoadSegment(manager, "road-12", loc1, loc2, 10);
+	const auto seg23 = createRoadSegment(manager, "road-23", loc2, loc3, 20);
+	const auto seg34 = createRoadSegment(manager, "road-34", loc3, loc4, 30);
+	const auto seg24 = createRoadSegment(manager, "road-24", loc2, loc4, 100);
+
+	// Copies and suffixes share the segments, and appending to one leaves the others as they were
+	const auto p = Conn::Path::instanceNew();
+	p->segmentIs(seg12);
+	p->segmentIs(seg23);
+	const auto copy = Conn::Path::instanceNew(p);
+	copy->segmentIs(seg34);
+	p->segmentIs(seg24);
+	testPath(p, "loc1 loc2 loc2 loc4 ", 130);
+	testPath(copy, "loc1 loc2 loc3 loc4 ", 60);
+
+	const auto suffix = Conn::Path::instanceNew(copy, 1);
+	testPath(suffix, "loc2 loc3 loc4 ", 50);
+	ASSERT_EQ("loc2", suffix->source()->name());
+	ASSERT_EQ("road-34", suffix->segment(1)->name());
+	ASSERT_EQ(suffix->segment(2), null);
+	ASSERT_EQ(0, Conn::Path::instanceNew(copy, 3)->segmentCount());
+
+	auto numSegments = 0u;
+	for (auto it = suffix->segmentIter(); it != suffix->segmentIterEnd(); it++) {
+		ASSERT_EQ(copy->segment(numSegments + 1)->name(), (*it)->name());
+		numSegments++;
+	}
+
+	ASSERT_EQ(2, numSegments);
+
+	// Hits from any location along a path built by an earlier hit
+	const auto conn = manager->conn();
+	const auto stats = conn->shortestPathCacheStats();
+	testPath(conn->shortestPath(loc1, loc4), "loc1 loc2 loc3 loc4 ", 60);
+	testPath(conn->shortestPath(loc1, loc4), "loc1 loc2 loc3 loc4 ", 60);
+	testPath(conn->shortestPath(loc2, loc4), "loc2 loc3 loc4 ", 50);
+	testPath(conn->shortestPath(loc3, loc4), "loc3 loc4 ", 30);
+	ASSERT_EQ(3, stats->hitCount());
+
+	// Appending to a hit leaves the next hits alone
+	const auto hit = conn->shortestPath(loc2, loc4);
+	hit->segmentIs(seg34);
+	testPath(conn->shortestPath(loc2, loc4), "loc2 loc3 loc4 ", 50);
+
+	// The paths built by hits hold the lengths of their segments, so they are rebuilt once a length changes, 
+	// even when the cached next hops stay the same
+	seg23->lengthIs(15);
+	testPath(conn->shortestPath(loc1, loc4), "loc1 loc2 loc3 loc4 ", 55);
+	testPath(conn->shortestPath(loc2, loc4), "loc2 loc3 loc4 ", 45);
+	ASSERT_EQ(7, stats->hitCount());
+}
+
+TEST(Conn, shortestPath_cacheBudget) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+
+	const auto conn = manager->conn();
+	const auto stats = conn->shortestPathCacheStats();
+	conn->shortestPathCacheFillIs(Conn::reverseTrees);
+	ASSERT_EQ(0, conn->shortestPathCacheBudget());
+	ASSERT_EQ(Conn::leastRecentlyUsed, conn->shortestPathCacheEviction());
+	ASSERT_EQ(0, stats->residentBytes());
+
+	// Reverse trees of 5, 3 and 4 entries, queried in the order loc5, loc4, loc6, loc5
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	const auto loc5Bytes = stats->residentBytes();
+	ASSERT_GT(loc5Bytes, 0);
+	testPath(conn->shortestPath(loc1, loc4), "loc1 loc3 loc4 ", 15);
+	testPath(conn->shortestPath(loc1, loc6), "loc1 loc3 loc4 loc6 ", 18);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	ASSERT_GT(stats->residentBytes(), loc5Bytes);
+	ASSERT_EQ(0, stats->evictionCount());
+
+	// A budget just below the cache size evicts the destination queried least recently
+	conn->shortestPathCacheBudgetIs(stats->residentBytes() - 1);
+	ASSERT_EQ(1, stats->evictionCount());
+	ASSERT_EQ(3, stats->evictedEntryCount());
+	ASSERT_LE(stats->residentBytes(), conn->shortestPathCacheBudget());
+	ASSERT_FALSE(conn->isShortestPathTreeCached(loc4));
+	ASSERT_EQ(0, conn->shortestPathCache().count("loc4"));
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc6));
+
+	// Caching loc4 again makes room by evicting loc6
+	testPath(conn->shortestPath(loc1, loc4), "loc1 loc3 loc4 ", 15);
+	ASSERT_EQ(2, stats->evictionCount());
+	ASSERT_EQ(7, stats->evictedEntryCount());
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc4));
+	ASSERT_FALSE(conn->isShortestPathTreeCached(loc6));
+	ASSERT_LE(stats->residentBytes(), conn->shortestPathCacheBudget());
+
+	conn->pathCacheIsEmpty();
+	ASSERT_EQ(0, stats->residentBytes());
+
+	// The clock hand gives loc5, queried since it was cached, a second chance
+	conn->shortestPathCacheBudgetIs(0);
+	conn->shortestPathCacheEvictionIs(Conn::clockSweep);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	testPath(conn->shortestPath(loc1, loc4), "loc1 loc3 loc4 ", 15);
+	testPath(conn->shortestPath(loc1, loc6), "loc1 loc3 loc4 loc6 ", 18);
+	testPath(conn->shortestPath(loc2, loc5), "loc2 loc4 loc6 loc5 ", 43);
+	conn->shortestPathCacheBudgetIs(stats->residentBytes() - 1);
+	ASSERT_EQ(3, stats->evictionCount());
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+	ASSERT_FALSE(conn->isShortestPathTreeCached(loc4));
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc6));
+
+	// Deleting an evicted destination leaves the accounting alone
+	manager->locationDel("loc4");
+	ASSERT_LE(stats->residentBytes(), conn->shortestPathCacheBudget());
+	conn->pathCacheIsEmpty();
+	ASSERT_EQ(0, stats->residentBytes());
+}
+
+TEST(Conn, shortestPath_cacheAdmission) {
+	const auto manager = sixLocationNetworkNew();
+	const auto loc1 = manager->location("loc1");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+
+	const auto conn = manager->conn();
+	const auto stats = conn->shortestPathCacheStats();
+	conn->shortestPathCacheFillIs(Conn::reverseTrees);
+	conn->shortestPathCacheEvictionIs(Conn::frequencyAdmission);
+
+	for (auto i = 0; i < 3; i++) {
+		testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	}
+
+	for (auto i = 0; i < 2; i++) {
+		testPath(conn->shortestPath(loc1, loc4), "loc1 loc3 loc4 ", 15);
+	}
+
+	conn->shortestPathCacheBudgetIs(stats->residentBytes());
+	ASSERT_EQ(0, stats->evictionCount());
+
+	// loc6 is turned away until it has been queried more often than loc5, the least recently used
+	for (auto i = 0; i < 3; i++) {
+		testPath(conn->shortestPath(loc1, loc6), "loc1 loc3 loc4 loc6 ", 18);
+		ASSERT_FALSE(conn->isShortestPathTreeCached(loc6));
+		ASSERT_TRUE(conn->isShortestPathTreeCached(loc5));
+	}
+
+	ASSERT_EQ(3, stats->admissionRejectCount());
+	ASSERT_EQ(3, stats->evictionCount());
+	ASSERT_EQ(12, stats->evictedEntryCount());
+
+	testPath(conn->shortestPath(loc1, loc6), "loc1 loc3 loc4 loc6 ", 18);
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc6));
+	ASSERT_FALSE(conn->isShortestPathTreeCached(loc5));
+	ASSERT_TRUE(conn->isShortestPathTreeCached(loc4));
+	ASSERT_EQ(3, stats->admissionRejectCount());
+	ASSERT_EQ(4, stats->evictionCount());
+	ASSERT_LE(stats->residentBytes(), conn->shortestPathCacheBudget());
+}
+
+TEST(Conn, shortestPath_cachePersistence) {
+	const auto fileName = ::testing::TempDir() + "travelsim-conn.cache";
+
+	const auto manager = sixLocationNetworkNew();
+	const auto conn = manager->conn();
+	conn->shortestPathCacheFillIs(Conn::reverseTrees);
+	testPath(conn->shortestPath(manager->location("loc1"), manager->location("loc5")), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	testPath(conn->shortestPath(manager->location("loc2"), manager->location("loc1")), "loc2 loc4 loc1 ", 65);
+	ASSERT_TRUE(conn->shortestPathCacheSave(fileName));
+
+	// The same network built in another order loads the cache, and starts warm
+	const auto sameManager = sixLocationNetworkNew(true);
+	const auto sameConn = sameManager->conn();
+	ASSERT_EQ(conn->topologyHash(), sameConn->topologyHash());
+	ASSERT_TRUE(sameConn->shortestPathCacheLoad(fileName));
+	ASSERT_EQ(conn->shortestPathCache(), sameConn->shortestPathCache());
+	ASSERT_EQ(conn->shortestPathCacheStats()->residentBytes(), sameConn->shortestPathCacheStats()->residentBytes());
+	ASSERT_TRUE(sameConn->isShortestPathTreeCached(sameManager->location("loc5")));
+
+	const auto stats = sameConn->shortestPathCacheStats();
+	testPath(sameConn->shortestPath(sameManager->location("loc3"), sameManager->location("loc5")), "loc3 loc4 loc6 loc5 ", 23);
+	testPath(sameConn->shortestPath(sameManager->location("loc4"), sameManager->location("loc1")), "loc4 loc1 ", 35);
+	ASSERT_EQ(2, stats->hitCount());
+	ASSERT_EQ(0, stats->missCount());
+
+	// Loaded entries follow later changes like any other
+	sameManager->segmentDel("road-12");
+	testPath(sameConn->shortestPath(sameManager->location("loc1"), sameManager->location("loc5")), "loc1 loc3 loc6 loc5 ", 40);
+
+	// Another network, even by one length, does not
+	const auto otherManager = sixLocationNetworkNew();
+	otherManager->segment("road-13")->lengthIs(11);
+	const auto otherConn = otherManager->conn();
+	ASSERT_NE(conn->topologyHash(), otherConn->topologyHash());
+	ASSERT_FALSE(otherConn->shortestPathCacheLoad(fileName));
+	ASSERT_EQ(0, otherConn->shortestPathCache().size());
+
+	// Nor does a damaged file, or no file at all
+	{
+		std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+		file << "TSPC";
+	}
+
+	ASSERT_FALSE(sameConn->shortestPathCacheLoad(fileName));
+	ASSERT_TRUE(sameConn->isShortestPathTreeCached(sameManager->location("loc1")));
+
+	std::remove(fileName.c_str());
+	ASSERT_FALSE(sameConn->shortestPathCacheLoad(fileName));
+}
+
+TEST(Histogram, percentiles) {
+	Histogram h;
+	ASSERT_EQ(0, h.percentile(0.5));
+
+	for (auto value : { 0, 1, 2, 3, 100 }) {
+		h.sampleIs(value);
+	}
+
+	ASSERT_EQ(5, h.sampleCount());
+	ASSERT_EQ(106, h.sum());
+	ASSERT_EQ(0, h.min());
+	ASSERT_EQ(100, h.max());
+	ASSERT_DOUBLE_EQ(21.2, h.mean());
+	ASSERT_EQ(2, h.bucket(2));
+	ASSERT_EQ(3, h.percentile(0.5));
+	ASSERT_EQ(100, h.percentile(1));
+}
+
+TEST(Conn, queryStats) {
+	const auto manager = sixLocationNetworkNew();
+	const auto conn = manager->conn();
+	const auto queryStats = conn->queryStats();
+
+	// The search to loc5 settles every location, loc3 on the way, so the second query hits the cache
+	testPath(conn->shortestPath(manager->location("loc1"), manager->location("loc5")), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	testPath(conn->shortestPath(manager->location("loc1"), manager->location("loc3")), "loc1 loc3 ", 5);
+	ASSERT_EQ(1, queryStats->uncachedLatency().sampleCount());
+	ASSERT_EQ(1, queryStats->cachedLatency().sampleCount());
+	ASSERT_EQ(1, queryStats->settledCount().sampleCount());
+	ASSERT_EQ(6, queryStats->settledCount().max());
+	ASSERT_GE(queryStats->relaxedCount().max(), 4);
+
+	ASSERT_EQ(1, queryStats->destinationCounts("loc5").requestCount);
+	ASSERT_EQ(0, queryStats->destinationCounts("loc5").hitCount);
+	ASSERT_DOUBLE_EQ(1, queryStats->destinationHitRate("loc3"));
+	ASSERT_DOUBLE_EQ(0, queryStats->destinationHitRate("loc6"));
+
+	manager->segmentDel("road-12");
+	ASSERT_EQ(1, queryStats->invalidationLatency().sampleCount());
+
+	const auto json = conn->statsJson();
+	const auto cacheStats = conn->shortestPathCacheStats();
+	ASSERT_GT(cacheStats->invalidationVisitCount(), 0);
+	ASSERT_NE(string::npos, json.find("\"invalidationVisits\":" + std::to_string(cacheStats->invalidationVisitCount()) + ","));
+	ASSERT_NE(string::npos, json.find("\"patchedDeletions\":0,\"alternateHits\":0,\"alternateMisses\":0,"));
+	ASSERT_NE(string::npos, json.find("\"admissionRejects\":0}"));
+	ASSERT_NE(string::npos, json.find("\"settledLocations\":{\"count\":1,\"sum\":6,\"min\":6,\"max\":6,"));
+	ASSERT_NE(string::npos, json.find("\"destinations\":[{\"name\":\"loc3\",\"requests\":1,\"hits\":1},"
+									  "{\"name\":\"loc5\",\"requests\":1,\"hits\":0}]}"));
+}
+
+TEST(Conn, distance) {
+	const auto manager = sixLocationNetworkNew();
+	const auto conn = manager->conn();
+	const auto stats = conn->shortestPathCacheStats();
+	const auto loc1 = manager->location("loc1");
+	const auto loc3 = manager->location("loc3");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+
+	ASSERT_DOUBLE_EQ(28, conn->distance(loc1, loc5).value());
+	const auto hitCount = stats->hitCount();
+	ASSERT_DOUBLE_EQ(28, conn->distance(loc1, loc5).value());
+	ASSERT_DOUBLE_EQ(23, conn->distance(loc3, loc5).value());
+	ASSERT_EQ(hitCount + 2, stats->hitCount());
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+
+	ASSERT_DOUBLE_EQ(0, conn->distance(loc4, loc4).value());
+	ASSERT_DOUBLE_EQ(Conn::unreachable().value(), conn->distance(loc5, loc1).value());
+	ASSERT_DOUBLE_EQ(Conn::unreachable().value(), conn->distance(loc1, null).value());
+
+	const auto nearest = conn->distanceFromNearest({ loc1, loc4 }, loc5);
+	ASSERT_EQ(loc4, nearest.first);
+	ASSERT_DOUBLE_EQ(13, nearest.second.value());
+	ASSERT_EQ(conn->distanceFromNearest({ loc5 }, loc1).first, null);
+	ASSERT_DOUBLE_EQ(Conn::unreachable().value(), conn->distanceFromNearest({}, loc1).second.value());
+
+	// Every engine answers without the cache
+	conn->shortestPathCacheIsEnabledIs(false);
+	for (auto engine : { Conn::linearScan, Conn::binaryHeap, Conn::bidirectional, Conn::alt, Conn::deltaStepping, Conn::allPairs }) {
+		conn->shortestPathEngineIs(engine);
+		ASSERT_DOUBLE_EQ(28, conn->distance(loc1, loc5).value());
+		ASSERT_DOUBLE_EQ(Conn::unreachable().value(), conn->distance(loc5, loc1).value());
+	}
+
+	conn->shortestPathEngineIs(Conn::binaryHeap);
+	conn->shortestPathCacheIsEnabledIs(true);
+	ASSERT_DOUBLE_EQ(28, conn->distance(loc1, loc5).value());
+	manager->segmentDel("road-12");
+	ASSERT_DOUBLE_EQ(40, conn->distance(loc1, loc5).value());
+}
+
+TEST(Conn, shortestPath_hubLabels) {
+	const auto manager = sixLocationNetworkNew();
+	const auto conn = manager->conn();
+	const auto index = manager->index();
+	const auto loc1 = manager->location("loc1");
+	const auto loc2 = manager->location("loc2");
+	const auto loc4 = manager->location("loc4");
+	const auto loc5 = manager->location("loc5");
+	const auto loc6 = manager->location("loc6");
+	conn->shortestPathCacheIsEnabledIs(false);
+	conn->shortestPathEngineIs(Conn::hubLabels);
+
+	// Without labels the engine falls back to a plain search
+	ASSERT_EQ(conn->shortestPathHubLabels(), null);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+
+	const auto labels = HubLabels::instanceNew(index);
+	conn->shortestPathHubLabelsIs(labels);
+	ASSERT_FALSE(labels->isStale());
+	ASSERT_EQ(6, labels->locationCount());
+	ASSERT_GE(labels->labelEntryCount(), 12);
+	ASSERT_GT(labels->bytes(), 0);
+
+	// The labels cover every pair
+	vector<double> labelDistances;
+	for (auto src = 0u; src < index->locationIdCount(); src++) {
+		for (auto dest = 0u; dest < index->locationIdCount(); dest++) {
+			labelDistances.push_back(labels->distance(src, dest));
+		}
+	}
+
+	conn->shortestPathEngineIs(Conn::binaryHeap);
+	for (auto src = 0u; src < index->locationIdCount(); src++) {
+		for (auto dest = 0u; dest < index->locationIdCount(); dest++) {
+			const auto d = (src == dest) ? 0 : conn->distance(index->location(src), index->location(dest)).value();
+			ASSERT_DOUBLE_EQ(d, labelDistances[src * index->locationIdCount() + dest]);
+		}
+	}
+
+	conn->shortestPathEngineIs(Conn::hubLabels);
+	testPath(conn->shortestPath(loc1, loc5), "loc1 loc3 loc4 loc6 loc5 ", 28);
+	testPath(conn->shortestPath(loc4, loc2), "loc4 loc1 loc2 ", 50);
+	testPath(conn->shortestPath(loc2, loc6), "loc2 loc4 loc6 ", 33);
+	ASSERT_EQ(conn->shortestPath(loc5, loc1), null);
+	ASSERT_DOUBLE_EQ(33, conn->distance(loc2, loc6).value());
+
+	// The nearest source is picked by label merges, the first given of equally near ones
+	testPath(conn->shortestPathFromNearest({ loc1, loc2, loc4 }, loc5), "loc4 loc6 loc5 ", 13);
+	const auto nearest = conn->distanceFromNearest({ loc2, loc1 }, loc4);
+	ASSERT_EQ(loc1, nearest.first);
+	ASSERT_DOUBLE_EQ(15, nearest.second.value());
+	ASSERT_EQ(conn->distanceFromNearest({ loc5 }, loc1).first, null);
+
+	// The first change to the network drops the labels
+	manager->segmentDel("road-12");
+	ASSERT_TRUE(labels->isStale());
+	testPath(conn->shortestPath(loc4, loc6), "loc4 loc1 loc3 loc6 ", 65);
+	ASSERT_EQ(conn->shortestPathHubLabels(), null);
+}
+
+TEST(Conn, shortestPath_policies) {
+	const auto manager = TravelNetworkManager::instanceNew("manager-1");
+	const auto res1 = manager->residenceNew("res1");
+	const auto air1 = manager->airportNew("air1");
+	const auto air2 = manager->airportNew("air2");
+	const auto res2 = manager->residenceNew("res2");
+
+	createRoadSegment(manager, "road-1", res1, air1, 20);
+	createRoadSegment(manager, "road-2", air1, air2, 900);
+	createRoadSegment(manager, "road-3", air2, res2, 20);
+	createRoadSegment(manager, "road-4", res1, res2, 600);
+	createFlightSegment(manager, "flight-1", air1, air2, 500);
+
+	const auto conn = manager->conn();
+	const auto index = manager->index();
+	ASSERT_EQ(TravelNetworkIndex::flight, index->segmentMode(index->segmentId(manager->segment("flight-1"))));
+	ASSERT_EQ(TravelNetworkIndex::road, index->segmentMode(index->segmentId(manager->segment("road-2"))));
+
+	for (auto isCacheEnabled : { false, true }) {
+		conn->shortestPathCacheIsEnabledIs(isCacheEnabled);
+
+		testPath(conn->shortestPath(res1, res2, LengthWeight(), Multimodal()), "res1 air1 air2 res2 ", 540);
+		testPath(conn->shortestPath(res1, res2, LengthWeight(), RoadsOnly()), "res1 res2 ", 600);
+		testPath(conn->shortestPath(air1, air2, LengthWeight(), FlightsOnly()), "air1 air2 ", 500);
+		ASSERT_EQ(conn->shortestPath(res1, res2, LengthWeight(), FlightsOnly()), null);
+		testPath(conn->shortestPath(res1, res1, LengthWeight(), RoadsOnly()), "", 0);
+
+		// Flying pays off in time but not in money
+		const auto carAndPlane = TimeWeight(MilesPerHour(60), MilesPerHour(500));
+		testPath(conn->shortestPath(res1, res2, carAndPlane, Multimodal()), "res1 air1 air2 res2 ", 540);
+		ASSERT_NEAR(40.0 / 60 + 1, conn->shortestPathWeight(res1, res2, carAndPlane, Multimodal()), 1e-9);
+		ASSERT_DOUBLE_EQ(9, conn->shortestPathWeight(res1, res2, TimeWeight(MilesPerHour(60)), Multimodal()));
+
+		const auto fares = CostWeight(DollarsPerMile(1), DollarsPerMile(3));
+		testPath(conn->shortestPath(res1, res2, fares, Multimodal()), "res1 res2 ", 600);
+		ASSERT_DOUBLE_EQ(600, conn->shortestPathWeight(res1, res2, fares, Multimodal()));
+		ASSERT_DOUBLE_EQ(ShortestPathTree::unreachableDistance(), conn->shortestPathWeight(res2, res1, fares, Multimodal()));
+	}
+
+	// Each pair of policies has its cache namespace, apart from the default one
+	const auto stats = conn->shortestPathCacheStats();
+	const auto hitCount = stats->hitCount();
+	ASSERT_DOUBLE_EQ(540, conn->shortestPathWeight(res1, res2, LengthWeight(), Multimodal()));
+	ASSERT_DOUBLE_EQ(600, conn->shortestPathWeight(res1, res2, LengthWeight(), RoadsOnly()));
+	ASSERT_EQ(hitCount + 2, stats->hitCount());
+	testPath(conn->shortestPath(res1, res2), "res1 air1 air2 res2 ", 540);
+
+	// Any change to the network drops the trees of every namespace
+	manager->segmentDel("flight-1");
+	testPath(conn->shortestPath(res1, res2, TimeWeight(MilesPerHour(60), MilesPerHour(500)), Multimodal()), "res1 res2 ", 600);
+	testPath(conn->shortestPath(res1, res2, LengthWeight(), Multimodal()), "res1 res2 ", 600);
+
+	// Policy trees count towards the budget, least recently queried evicted first
+	conn->pathCacheIsEmpty();
+	ASSERT_DOUBLE_EQ(600, conn->shortestPathWeight(res1, res2, LengthWeight(), RoadsOnly()));
+	const auto treeBytes = stats->residentBytes();
+	ASSERT_GT(treeBytes, 0);
+
+	conn->shortestPathCacheBudgetIs(treeBytes);
+	const auto evictionCount = stats->evictionCount();
+	for (auto speed : { 50, 60, 75 }) {
+		ASSERT_DOUBLE_EQ(600.0 / speed, conn->shortestPathWeight(res1, res2, TimeWeight(MilesPerHour(speed)), Multimodal()));
+	}
+	ASSERT_EQ(evictionCount + 3, stats->evictionCount());
+	ASSERT_EQ(treeBytes, stats->residentBytes());
+	ASSERT_DOUBLE_EQ(8, conn->shortestPathWeight(res1, res2, TimeWeight(MilesPerHour(75)), Multimodal()));
+	ASSERT_EQ(evictionCount + 3, stats->evictionCount());
+
+	// Trees the budget cannot hold are not cached at all
+	conn->shortestPathCacheBudgetIs(treeBytes - 1);
+	ASSERT_EQ(0, stats->residentBytes());
+	ASSERT_DOUBLE_EQ(600, conn->shortestPathWeight(res1, res2, LengthWeight(), RoadsOnly()));
+	ASSERT_EQ(0, stats->residentBytes());
+	conn->shortestPathCacheBudgetIs(0);
+}
+
+TEST(TravelNetworkIndex, idsAndArcs) {
+	const auto manager = TravelNetworkManager::instanceNew("manager-1");
+	const auto loc1 = manager->residenceNew("loc1");
+	const auto loc2 = manager->residenceNew("loc2");
+	const auto loc3 = manager->airportNew("loc3");
+
+	const auto seg12 = createRoadSegment(manager, "road-12", loc1, loc2, 15);
+	const auto seg13 = createRoadSegment(manager, "road-13", loc1, loc3, 5);
+	const auto seg32 = createRoadSegment(manager, "road-32", loc3, loc2, 7);
+
+	auto index = manager->index();
+	ASSERT_FALSE(index->isStale());
+	ASSERT_EQ(3, index->locationIdCount());
+	ASSERT_EQ(3, index->segmentIdCount());
+	ASSERT_EQ(3, index->arcCount());
+
+	const auto id1 = index->locationId(loc1);
+	const auto id2 = index->locationId(loc2);
+	const auto id3 = index->locationId(loc3);
+	ASSERT_TRUE(index->location(id2) == loc2.ptr());
+	ASSERT_TRUE(index->segment(index->segmentId(seg13)) == seg13.ptr());
+
+	ASSERT_EQ(2, index->outArcIterEnd(id1) - index->outArcIter(id1));
+	ASSERT_EQ(0, index->outArcIterEnd(id2) - index->outArcIter(id2));
+	ASSERT_EQ(2, index->inArcIterEnd(id2) - index->inArcIter(id2));
+	ASSERT_EQ(id2, index->outArcIter(id3)->location);
+	ASSERT_EQ(id3, index->inArcIter(id2)[1].location);
+	ASSERT_EQ(7, index->outArcIter(id3)->length);
+
+	// Changes only mark the index as stale. It is rebuilt the next time it is requested.
+	const auto version = index->version();
+	seg32->lengthIs(9);
+	ASSERT_TRUE(index->isStale());
+	index = manager->index();
+	ASSERT_EQ(version + 1, index->version());
+	ASSERT_EQ(9, index->outArcIter(id3)->length);
+
+	manager->segmentDel("road-13");
+	manager->locationDel("loc1");
+	index = manager->index();
+	ASSERT_EQ(TravelNetworkIndex::nullId, index->locationId(loc1));
+	ASSERT_EQ(TravelNetworkIndex::nullId, index->segmentId(seg13));
+	ASSERT_EQ(1, index->arcCount());
+
+	// Ids of deleted entities are reused
+	const auto loc4 = manager->residenceNew("loc4");
+	ASSERT_EQ(id1, manager->index()->locationId(loc4));
+	ASSERT_EQ(3, manager->index()->locationIdCount());
+}
+
 TEST(TravelNetworkManager, instanceNew) {
 	const auto manager = TravelNetworkManager::instanceNew("manager-1");
 	ASSERT_TRUE(manager != null);
@@ -1445,7 +2691,7 @@ TEST(VehicleManager, nearestVehicle) {
 	const auto loc6 = manager->residenceNew("loc6");
 
 	const auto seg12 = createRoadSegment(manager, "road-1", loc1, loc2, 15);
-	const auto seg13 = createRoadSegment(manager, "road-2", loc1, loc3, 5); 
+	const auto seg13 = createRoadSegment(manager, "road-2", loc1, loc3, 5);
 	const auto seg14 = createRoadSegment(manager, "road-3", loc1, loc4, 20);
 	const auto seg15 = createRoadSegment(manager, "road-4", loc1, loc5, 100);
 
@@ -1504,6 +2750,57 @@ TEST(VehicleManager, nearestVehicle) {
 	ASSERT_EQ(vehicleManager->nearestVehicle(loc5), car2);
 	car2->speedIs(0);
 	ASSERT_EQ(vehicleManager->nearestVehicle(loc5), null);
+
+	sim->activitiesDel();
+}
+
+TEST(VehicleManager, nearestVehicleDispatch) {
+	const auto manager = TravelNetworkManager::instanceNew("manager-1");
+	const auto sim = TravelSim::instanceNew(manager);
+
+	const auto loc1 = manager->residenceNew("loc1");
+	const auto loc2 = manager->residenceNew("loc2");
+	const auto loc3 = manager->residenceNew("loc3");
+	const auto loc4 = manager->residenceNew("loc4");
+	const auto loc5 = manager->residenceNew("loc5");
+
+	createRoadSegment(manager, "road-1", loc2, loc1, 10);
+	createRoadSegment(manager, "road-2", loc3, loc1, 10);
+	createRoadSegment(manager, "road-3", loc4, loc3, 5);
+	createRoadSegment(manager, "road-4", loc1, loc5, 5);
+
+	const auto vehicleManager = sim->vehicleManager();
+	const auto car3 = createCar(manager, loc3, "car-3");
+	const auto car2 = createCar(manager, loc2, "car-2");
+	const auto car4 = createCar(manager, loc4, "car-4");
+
+	// car-2 and car-3 are both 10 miles away: the tie goes to the smaller name
+	auto dispatch = vehicleManager->nearestVehicleDispatch(loc1);
+	ASSERT_EQ(dispatch.first, car2);
+	ASSERT_EQ(10, dispatch.second.value());
+
+	car2->statusIs(Vehicle::assignedForTrip);
+	dispatch = vehicleManager->nearestVehicleDispatch(loc1);
+	ASSERT_EQ(dispatch.first, car3);
+	ASSERT_EQ(10, dispatch.second.value());
+
+	car3->locationIs(loc1);
+	dispatch = vehicleManager->nearestVehicleDispatch(loc1);
+	ASSERT_EQ(dispatch.first, car3);
+	ASSERT_EQ(0, dispatch.second.value());
+
+	car3->statusIs(Vehicle::assignedForTrip);
+	dispatch = vehicleManager->nearestVehicleDispatch(loc1);
+	ASSERT_EQ(dispatch.first, car4);
+	ASSERT_EQ(15, dispatch.second.value());
+
+	dispatch = vehicleManager->nearestVehicleDispatch(loc5);
+	ASSERT_EQ(dispatch.first, car4);
+	ASSERT_EQ(20, dispatch.second.value());
+
+	ASSERT_EQ(vehicleManager->nearestVehicleDispatch(loc2).first, null);
+
+	sim->activitiesDel();
 }
 
 TEST(TravelNetworkManager, trips) {